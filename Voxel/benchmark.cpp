@@ -0,0 +1,2388 @@
+#include "benchmark.h"
+#include "voxelchunk.h"
+#include "voxelworld.h"
+#include "terrain.h"
+#include "mesharena.h"
+#include "frustum.h"
+#include "occlusionculler.h"
+#include "raycast.h"
+#include "lighting.h"
+#include "regionfile.h"
+#include "meshcache.h"
+#include "greedymesher.h"
+#include "bricklayout.h"
+#include "indirectdraw.h"
+#include "radixsort.h"
+#include "uploadscheduler.h"
+#include "stagingring.h"
+#include "shader.h"
+
+#include <SDL2/SDL.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static Log logger{"Benchmark"};
+
+void setup_uniforms(ShaderProgram&); // In main.cpp
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::high_resolution_clock;
+
+// Average milliseconds per call of func over a number of iterations
+template<class F>
+static f64 TimeMs(u32 iterations, F&& func) {
+	auto begin = high_resolution_clock::now();
+	for(u32 i = 0; i < iterations; i++) func();
+	auto end = high_resolution_clock::now();
+
+	return duration_cast<duration<f64, std::milli>>(end-begin).count() / iterations;
+}
+
+static const char* MethodName(MeshMethod method) {
+	switch(method) {
+	case MeshMethod::Stbvox: return "stbvox";
+	case MeshMethod::Greedy: return "greedy";
+	case MeshMethod::BinaryGreedy: return "binary greedy";
+	}
+
+	return "";
+}
+
+static void BenchMeshChunk(const char* name, VoxelChunk& chunk, u32 iterations) {
+	chunk.meshMethod = MeshMethod::Stbvox;
+	f64 stbvoxMs = TimeMs(iterations, [&]{ chunk.Invalidate(); chunk.BuildMesh(); });
+	u32 stbvoxQuads = chunk.numBuiltQuads;
+
+	chunk.meshMethod = MeshMethod::Greedy;
+	f64 greedyMs = TimeMs(iterations, [&]{ chunk.Invalidate(); chunk.BuildMesh(); });
+	u32 greedyQuads = chunk.numBuiltQuads;
+
+	chunk.meshMethod = MeshMethod::BinaryGreedy;
+	f64 binaryMs = TimeMs(iterations, [&]{ chunk.Invalidate(); chunk.BuildMesh(); });
+	u32 binaryQuads = chunk.numBuiltQuads;
+
+	logger << name << " " << chunk.width << "x" << chunk.height << "x" << chunk.depth;
+	logger << "\tstbvox: " << stbvoxQuads << " quads in " << stbvoxMs << "ms";
+	logger << "\tgreedy: " << greedyQuads << " quads in " << greedyMs << "ms"
+		<< " (" << (100.0 * greedyQuads / std::max(stbvoxQuads, 1u)) << "% of quads)";
+	logger << "\tbinary greedy: " << binaryQuads << " quads in " << binaryMs << "ms";
+}
+
+static void BenchMeshing() {
+	{	VoxelChunk chunk{32,32,24};
+		srand(0);
+		GenerateTestTerrain(chunk);
+		BenchMeshChunk("Test terrain", chunk, 50);
+	}
+
+	{	VoxelChunk chunk{32,32,24};
+		for(u32 x = 0; x < chunk.width; x++)
+		for(u32 y = 0; y < chunk.height; y++) {
+			chunk.SetBlock(x,y,0, 1);
+			chunk.SetColor(x,y,0, 100,200,100);
+		}
+		BenchMeshChunk("Flat floor", chunk, 50);
+	}
+
+	for(f32 density: {0.1f, 0.5f, 0.9f}) {
+		VoxelChunk chunk{64,64,64};
+		GenerateRandomTerrain(chunk, 1234, density);
+		string name = "Random " + std::to_string((s32)(density*100.f)) + "%";
+		BenchMeshChunk(name.data(), chunk, 5);
+	}
+}
+
+static void BenchBuildMemory() {
+	constexpr u32 numChunks = 256;
+	constexpr u32 oldBuildBufferSize = 20<<20;
+
+	std::vector<VoxelChunk*> chunks;
+	u64 meshBytes = 0;
+
+	auto ms = TimeMs(1, [&] {
+		for(u32 i = 0; i < numChunks; i++) {
+			auto chunk = new VoxelChunk{32,32,24};
+			GenerateRandomTerrain(*chunk, i, (i%8) / 8.f);
+			chunk->BuildMesh();
+
+			meshBytes += chunk->numBuiltQuads*5*sizeof(u32);
+			chunks.push_back(chunk);
+		}
+	});
+
+	auto& pool = VoxelChunk::buildBufferPool;
+	logger << "Built " << numChunks << " chunks in " << ms << "ms";
+	logger << "	Build buffers: " << pool.numBuffers << " totalling " << (pool.numBytes>>10) << "KB";
+	logger << "	Retained mesh data: " << (meshBytes>>10) << "KB";
+	logger << "	Per chunk build buffers would have been " << ((u64)numChunks*oldBuildBufferSize>>20) << "MB";
+
+	for(auto c: chunks) delete c;
+}
+
+static void BenchPaletteChunk(const char* name, VoxelChunk& chunk) {
+	u32 rawSize = chunk.VoxelMemoryUsage();
+	auto blocks = new u8[chunk.PaddedSize()];
+	auto colors = new stbvox_rgb[chunk.PaddedSize()];
+
+	PaletteStorage storage;
+	f64 packMs = TimeMs(20, [&]{ 
+		storage.Pack(chunk.blockData, chunk.colorData, chunk.width, chunk.height, chunk.depth); 
+	});
+	f64 unpackMs = TimeMs(200, [&]{ storage.Unpack(blocks, colors); });
+
+	bool matches = !memcmp(blocks, chunk.blockData, chunk.PaddedSize())
+		&& !memcmp(colors, chunk.colorData, chunk.PaddedSize()*sizeof(stbvox_rgb));
+
+	f64 numVoxels = chunk.width*chunk.height*chunk.depth;
+	logger << name << ": " << storage.palette.size() << " entries, " 
+		<< storage.bitsPerVoxel << " bits per voxel" << (matches? "" : " MISMATCH");
+	logger << "	" << rawSize << " bytes raw, " << storage.MemoryUsage() << " bytes packed"
+		<< " (" << (100.0 * storage.MemoryUsage() / rawSize) << "%)";
+	logger << "	Pack " << packMs << "ms, unpack " << unpackMs << "ms"
+		<< " (" << (numVoxels / unpackMs / 1000.0) << " Mvoxels/s)";
+
+	delete[] blocks;
+	delete[] colors;
+}
+
+static void BenchPalette() {
+	{	VoxelChunk chunk{32,32,24};
+		BenchPaletteChunk("Empty", chunk);
+	}
+
+	{	VoxelChunk chunk{32,32,24};
+		srand(0);
+		GenerateTestTerrain(chunk);
+		BenchPaletteChunk("Test terrain", chunk);
+	}
+
+	for(f32 density: {0.1f, 0.5f}) {
+		VoxelChunk chunk{64,64,64};
+		GenerateRandomTerrain(chunk, 1234, density);
+		string name = "Random " + std::to_string((s32)(density*100.f)) + "%";
+		BenchPaletteChunk(name.data(), chunk);
+	}
+
+	{	VoxelChunk chunk{32,32,32};
+		for(u32 x = 0; x < chunk.width; x++)
+		for(u32 y = 0; y < chunk.height; y++)
+		for(u32 z = 0; z < chunk.depth; z++) {
+			chunk.SetBlock(x,y,z, 1);
+			chunk.SetColor(x,y,z, x*8, y*8, z*8);
+		}
+		BenchPaletteChunk("Gradient", chunk);
+	}
+
+	// Every voxel different, past what 16 bit indices can hold
+	{	VoxelChunk chunk{64,64,64};
+		for(u32 x = 0; x < chunk.width; x++)
+		for(u32 y = 0; y < chunk.height; y++)
+		for(u32 z = 0; z < chunk.depth; z++) {
+			chunk.SetBlock(x,y,z, 1);
+			chunk.SetColor(x,y,z, x*4, y*4, z*4);
+		}
+		BenchPaletteChunk("Gradient 64^3", chunk);
+
+		chunk.Compress();
+		logger << "\tKept " << (chunk.packedData? "packed" : "raw") << " by Compress";
+	}
+}
+
+static void BenchRemesh() {
+	VoxelChunk chunk{120,120,96};
+
+	// Rolling hills, so edits land on a realistic surface
+	for(u32 x = 0; x < chunk.width; x++)
+	for(u32 y = 0; y < chunk.height; y++) {
+		u32 h = 40 + (u32)(20.f * std::sin(x*0.1f) * std::cos(y*0.13f));
+		for(u32 z = 0; z < h; z++) {
+			chunk.SetBlock(x,y,z, 1);
+			chunk.SetColor(x,y,z, 100, 150 + z, 100);
+		}
+	}
+
+	for(auto method: {MeshMethod::Stbvox, MeshMethod::Greedy, MeshMethod::BinaryGreedy}) {
+		chunk.meshMethod = method;
+		f64 fullMs = TimeMs(5, [&]{ chunk.Invalidate(); chunk.BuildMesh(); });
+		u32 fullQuads = chunk.numBuiltQuads;
+
+		srand(0);
+		u32 rebuiltQuads = 0;
+		f64 editMs = TimeMs(100, [&]{
+			u32 x = rand()%chunk.width;
+			u32 y = rand()%chunk.height;
+			chunk.SetBlock(x, y, 40, rand()%2);
+			chunk.BuildMesh();
+			rebuiltQuads += chunk.numBuiltQuads;
+		});
+
+		logger << MethodName(method) << " " << chunk.width << "x" << chunk.height << "x" << chunk.depth;
+		logger << "\tFull rebuild: " << fullQuads << " quads in " << fullMs << "ms";
+		logger << "\tSingle block edit: " << (rebuiltQuads/100) << " quads in " << editMs << "ms";
+	}
+}
+
+static void BenchBulkEdit() {
+	VoxelChunk chunk{64,64,64};
+	f64 numVoxels = chunk.width*chunk.height*chunk.depth;
+	stbvox_rgb color {100, 200, 100};
+
+	f64 perVoxelMs = TimeMs(20, [&] {
+		for(u32 x = 0; x < chunk.width; x++)
+		for(u32 y = 0; y < chunk.height; y++)
+		for(u32 z = 0; z < chunk.depth; z++) {
+			chunk.SetBlock(x,y,z, 1);
+			chunk.SetColor(x,y,z, color.r, color.g, color.b);
+		}
+	});
+
+	f64 fillMs = TimeMs(20, [&] {
+		chunk.FillBox(0,0,0, chunk.width,chunk.height,chunk.depth, 1, color);
+	});
+
+	std::vector<u8> blocks(numVoxels);
+	std::vector<stbvox_rgb> colors(numVoxels);
+	chunk.CopyBox(0,0,0, chunk.width,chunk.height,chunk.depth, blocks.data(), colors.data());
+
+	f64 pasteMs = TimeMs(20, [&] {
+		chunk.SetAll(blocks.data(), colors.data());
+	});
+
+	logger << "Filling " << chunk.width << "x" << chunk.height << "x" << chunk.depth;
+	logger << "\tSetBlock/SetColor: " << perVoxelMs << "ms (" << (numVoxels / perVoxelMs / 1000.0) << " Mvoxels/s)";
+	logger << "\tFillBox: " << fillMs << "ms (" << (numVoxels / fillMs / 1000.0) << " Mvoxels/s)";
+	logger << "\tSetAll: " << pasteMs << "ms (" << (numVoxels / pasteMs / 1000.0) << " Mvoxels/s)";
+}
+
+// Relayout churn against the arena allocator alone, since there's no GL
+//	context here. Compaction is simulated by packing the live ranges
+static void BenchArena() {
+	const u32 numChunks = 2000;
+	const u32 numSteps = 200000;
+
+	for(bool compact: {false, true}) {
+		FreeListAllocator allocator{1<<20};
+		std::vector<std::pair<u32, u32>> live(numChunks); // offset, size
+
+		srand(0);
+		auto randomSize = []{ return 64 + rand()%4000 + (rand()%8 == 0? rand()%20000 : 0); };
+		auto allocate = [&](u32 size) {
+			u32 offset = allocator.Allocate(size);
+			if(offset == FreeListAllocator::invalid) {
+				allocator.Grow(std::max(allocator.capacity*2, allocator.capacity + size));
+				offset = allocator.Allocate(size);
+			}
+			return offset;
+		};
+
+		for(auto& l: live) {
+			l.second = randomSize();
+			l.first = allocate(l.second);
+		}
+
+		u32 numCompactions = 0;
+		f64 stepMs = TimeMs(numSteps, [&]{
+			// Like RelayoutMesh, the new range is allocated before the old one is freed
+			auto& l = live[rand()%numChunks];
+			u32 size = randomSize();
+			u32 offset = allocate(size);
+			allocator.Free(l.first, l.second);
+			l = {offset, size};
+
+			if(compact && allocator.freeBlocks.size() >= 16 && allocator.Fragmentation() >= 0.5f) {
+				std::sort(live.begin(), live.end());
+				u32 cursor = 0;
+				for(auto& m: live) {
+					m.first = cursor;
+					cursor += m.second;
+				}
+				allocator.Reset(cursor);
+				numCompactions++;
+			}
+		});
+
+		logger << (compact? "With" : "Without") << " defragmentation, " << numChunks << " chunks, " << numSteps << " relayouts";
+		logger << "	" << (stepMs*1000.0) << "us per relayout";
+		logger << "	Capacity: " << (allocator.capacity*20/1024) << "KB, " << (allocator.Utilisation()*100.f) << "% used";
+		logger << "	Fragmentation: " << (allocator.Fragmentation()*100.f) << "% over " << allocator.freeBlocks.size() << " free blocks";
+		if(compact) logger << "	Defragmentations: " << numCompactions;
+	}
+}
+
+// Frustum tests against a flat grid of chunk bounds, with the camera
+//	spinning in the middle the way main.cpp sets it up
+static void BenchCulling() {
+	const s32 gridSize = 64;
+	std::vector<AABB> bounds;
+
+	for(s32 x = -gridSize/2; x < gridSize/2; x++)
+	for(s32 z = -gridSize/2; z < gridSize/2; z++) {
+		AABB b;
+		b.min = vec3{x*32.f, -8.f, z*32.f};
+		b.max = b.min + vec3{32.f, 24.f, 32.f};
+		bounds.push_back(b);
+	}
+
+	mat4 projection = glm::perspective((f32)PI/4.f, 4.f/3.f, 0.001f, 1000.0f);
+
+	u32 numCulled = 0;
+	u32 numTested = 0;
+	u32 numFrames = 360;
+	u32 frame = 0;
+	f64 frameMs = TimeMs(numFrames, [&]{
+		mat4 view = glm::rotate(mat4(1.f), frame++ * (f32)PI/180.f, vec3{0,1,0});
+		auto frustum = Frustum::FromMatrix(projection * view);
+
+		for(auto& b: bounds) {
+			numTested++;
+			numCulled += !frustum.Intersects(b);
+		}
+	});
+
+	logger << bounds.size() << " chunks, " << numFrames << " camera angles";
+	logger << "	" << frameMs << "ms per frame, " << (frameMs*1e6/bounds.size()) << "ns per chunk";
+	logger << "	" << (100.0*numCulled/numTested) << "% culled";
+}
+
+static AABB Box(vec3 min, vec3 max) {
+	AABB b;
+	b.min = min;
+	b.max = max;
+	return b;
+}
+
+// Known scenes first, then the cost of culling against a hilly chunk
+static void BenchOcclusion() {
+	OcclusionCuller culler{256, 192};
+	mat4 projection = glm::perspective((f32)PI/4.f, 4.f/3.f, 0.1f, 1000.0f);
+
+	u32 numFailed = 0;
+	auto check = [&](const char* what, bool occluded, bool expected) {
+		if(occluded == expected) return;
+		logger << "	FAILED: " << what << (expected? " should" : " shouldn't") << " be occluded";
+		numFailed++;
+	};
+
+	// A wall 10 units in front of a camera looking down -z
+	culler.Begin(projection);
+	culler.AddOccluder(Box(vec3{-2,-2,-11}, vec3{2,2,-10}));
+	culler.Rasterise();
+
+	check("box behind the wall", culler.IsOccluded(Box(vec3{-1,-1,-21}, vec3{1,1,-20})), true);
+	check("box in front of the wall", culler.IsOccluded(Box(vec3{-1,-1,-6}, vec3{1,1,-5})), false);
+	check("box beside the wall", culler.IsOccluded(Box(vec3{6,-1,-21}, vec3{7,1,-20})), false);
+	check("box peeking over the wall", culler.IsOccluded(Box(vec3{-1,3.5f,-21}, vec3{1,4.5f,-20})), false);
+	check("box around the camera", culler.IsOccluded(Box(vec3{-1,-1,-30}, vec3{1,1,1})), false);
+
+	// Occluders from a chunk of solid ground, seen from above
+	VoxelChunk ground{64,64,16};
+	ground.FillBox(0,0,0, 64,64,16, 1, stbvox_rgb{100,100,100});
+	ground.BuildMesh();
+
+	u32 numGroundOccluders = 0;
+	mat4 view = glm::lookAt(vec3{33,40,-33}, vec3{33,0,-33}, vec3{0,0,-1});
+	culler.Begin(projection * view);
+	for(auto& boxes: ground.builtSlabOccluders)
+	for(auto& box: boxes) {
+		culler.AddOccluder(box.Transformed(VoxelChunk::coordinateCorrection));
+		numGroundOccluders++;
+	}
+	culler.Rasterise();
+
+	check("cave under the ground", culler.IsOccluded(Box(vec3{30,4,-36}, vec3{36,8,-30})), true);
+	check("box above the ground", culler.IsOccluded(Box(vec3{30,20,-36}, vec3{36,24,-30})), false);
+	check("box on the ground", culler.IsOccluded(Box(vec3{30,16,-36}, vec3{36,18,-30})), false);
+
+	logger << "Known scenes: " << (numFailed? "FAILED" : "ok") << ", ground made of " << numGroundOccluders << " occluders";
+
+	// Rolling hills, with a grid of chunk sized boxes under and over them
+	VoxelChunk hills{120,120,96};
+	for(u32 x = 0; x < hills.width; x++)
+	for(u32 y = 0; y < hills.height; y++) {
+		u32 h = 40 + (u32)(20.f * std::sin(x*0.1f) * std::cos(y*0.13f));
+		hills.FillColumn(x, y, 0, h, 1, stbvox_rgb{100,150,100});
+	}
+	hills.BuildMesh();
+
+	std::vector<AABB> occluders;
+	for(auto& boxes: hills.builtSlabOccluders)
+	for(auto& box: boxes)
+		occluders.push_back(box.Transformed(VoxelChunk::coordinateCorrection));
+
+	std::vector<AABB> tests;
+	for(u32 x = 0; x < 120; x += 8)
+	for(u32 y = 0; y < 96; y += 8)
+	for(u32 z = 0; z < 120; z += 8)
+		tests.push_back(Box(vec3{x+1.f, y+1.f, -(z+9.f)}, vec3{x+9.f, y+9.f, -(z+1.f)}));
+
+	u32 numOccluded = 0;
+	u32 numFrames = 60;
+	u32 frame = 0;
+	f64 rasteriseMs = 0.0;
+	f64 testMs = 0.0;
+
+	for(; frame < numFrames; frame++) {
+		f32 a = frame * 2.f*(f32)PI / numFrames;
+		vec3 eye = vec3{60,70,-60} + vec3{std::cos(a), 0.f, std::sin(a)} * 90.f;
+		culler.Begin(projection * glm::lookAt(eye, vec3{60,40,-60}, vec3{0,1,0}));
+
+		rasteriseMs += TimeMs(1, [&]{
+			for(auto& box: occluders) culler.AddOccluder(box);
+			culler.Rasterise();
+		});
+
+		testMs += TimeMs(1, [&]{
+			for(auto& box: tests) numOccluded += culler.IsOccluded(box);
+		});
+	}
+
+	logger << "Hills: " << occluders.size() << " occluders, " << culler.numTrianglesDrawn << " triangles, " 
+		<< culler.NumBands() << " bands at " << culler.width << "x" << culler.height;
+	logger << "	Rasterise: " << (rasteriseMs/numFrames) << "ms per frame";
+	logger << "	Test: " << (testMs*1e6/numFrames/tests.size()) << "ns per box, " 
+		<< (100.0*numOccluded/numFrames/tests.size()) << "% occluded";
+}
+
+// Quads in range of a camera in the middle of a 24x24 chunk field of 
+//	hills, at full resolution and with lods
+static void BenchLod() {
+	const s32 gridSize = 24;
+	VoxelWorld world{32,32,24};
+
+	for(s32 cx = -gridSize/2; cx < gridSize/2; cx++)
+	for(s32 cy = -gridSize/2; cy < gridSize/2; cy++) {
+		auto chunk = world.GetOrCreateChunk({cx, cy, 0});
+
+		for(u32 x = 0; x < chunk->width; x++)
+		for(u32 y = 0; y < chunk->height; y++) {
+			f32 wx = cx*32.f + x;
+			f32 wy = cy*32.f + y;
+			u32 h = 10 + (u32)(6.f + 6.f * std::sin(wx*0.05f) * std::cos(wy*0.07f));
+			chunk->FillColumn(x, y, 0, h, 1, stbvox_rgb{100, (u8)(120 + h*5), 100});
+		}
+	}
+
+	// Meshes every lod of every chunk up front so distances can be swept
+	std::vector<std::pair<VoxelChunk*, u32[VoxelChunk::numLods]>> quads(world.chunks.count);
+	f64 lodMs[VoxelChunk::numLods] {};
+	u32 i = 0;
+
+	world.chunks.ForEach([&](ChunkCoord c, VoxelChunk* chunk) {
+		chunk->modelMatrix = glm::translate(vec3(VoxelChunk::coordinateCorrection * vec4{c.x*32.f, c.y*32.f, 0.f, 0.f}));
+		quads[i].first = chunk;
+
+		for(u32 l = 0; l < VoxelChunk::numLods; l++) {
+			auto lod = chunk->GetLod(l);
+			lodMs[l] += TimeMs(1, [&]{ lod->BuildMesh(); });
+			quads[i].second[l] = lod->numBuiltQuads;
+		}
+
+		i++;
+	});
+
+	logger << world.chunks.count << " chunks, lod distance " << world.lodDistance;
+	for(u32 l = 0; l < VoxelChunk::numLods; l++)
+		logger << "	lod " << l << " meshing: " << (lodMs[l]/world.chunks.count) << "ms per chunk";
+
+	vec3 cameraPos {0.f, 30.f, 0.f};
+
+	for(f32 viewDistance: {64.f, 128.f, 256.f, 384.f}) {
+		u64 fullQuads = 0;
+		u64 lodQuads = 0;
+
+		for(auto& q: quads) {
+			auto chunk = q.first;
+			vec3 centre = vec3(chunk->modelMatrix * VoxelChunk::coordinateCorrection * vec4{17.f, 17.f, 13.f, 1.f});
+			if(glm::distance(centre, cameraPos) > viewDistance) continue;
+
+			fullQuads += q.second[0];
+			lodQuads += q.second[world.LodLevel(chunk, cameraPos)];
+		}
+
+		logger << "	View distance " << viewDistance << ": " << (fullQuads*2) << " triangles full res, " 
+			<< (lodQuads*2) << " with lods (" << (100.0*lodQuads/std::max<u64>(fullQuads, 1)) << "%)";
+	}
+}
+
+// Known hits first, then line of sight rays between random points above 
+//	hills spread over 8x8 chunks
+static void BenchRaycast() {
+	VoxelWorld world{32,32,24};
+
+	for(s32 x = -128; x < 128; x++)
+	for(s32 y = -128; y < 128; y++) {
+		s32 h = 8 + (s32)(6.f * std::sin(x*0.05f) * std::cos(y*0.07f));
+		world.FillBox(x, y, 0, x+1, y+1, h, 1, stbvox_rgb{100, 150, 100});
+	}
+
+	u32 numFailed = 0;
+	auto check = [&](const char* what, const Ray& ray, bool hit, s32 x, s32 y, s32 z, s32 nx, s32 ny, s32 nz) {
+		RaycastHit h;
+		bool ok = (Raycast(world, ray, &h) == hit);
+		if(hit) ok = ok && h.x == x && h.y == y && h.z == z && h.nx == nx && h.ny == ny && h.nz == nz;
+		if(ok) return;
+
+		logger << "	FAILED: " << what << ", got " << h.hit << " at " 
+			<< h.x << " " << h.y << " " << h.z << " normal " << h.nx << " " << h.ny << " " << h.nz;
+		numFailed++;
+	};
+
+	// A pillar and a hole in the negative chunks, to check every axis and sign
+	world.FillBox(-40, -40, 0, -39, -39, 30, 2, stbvox_rgb{255, 0, 0});
+	world.FillBox(-60, -60, 0, -59, -59, 20, 0, stbvox_rgb{});
+
+	s32 top = 8 + (s32)(6.f * std::sin(-0.05f) * std::cos(0.07f));
+	check("straight down", Ray{vec3{-0.5f, 0.5f, 40.f}, vec3{0,0,-1}, 100.f}, true, -1, 0, top-1, 0, 0, 1);
+	check("pillar from +x across chunks", Ray{vec3{10.5f, -39.5f, 25.5f}, vec3{-1,0,0}, 100.f}, true, -40, -40, 25, 1, 0, 0);
+	check("pillar from -y", Ray{vec3{-39.5f, -100.5f, 25.5f}, vec3{0,1,0}, 100.f}, true, -40, -40, 25, 0, -1, 0);
+	check("down the hole", Ray{vec3{-59.5f, -59.5f, 40.f}, vec3{0,0,-1}, 100.f}, false, 0,0,0, 0,0,0);
+	check("too short", Ray{vec3{-0.5f, 0.5f, 40.f}, vec3{0,0,-1}, 10.f}, false, 0,0,0, 0,0,0);
+	check("starting inside", Ray{vec3{0.5f, 0.5f, 1.5f}, vec3{1,1,1}, 10.f}, true, 0, 0, 1, 0, 0, 0);
+	check("up into the sky", Ray{vec3{0.5f, 0.5f, 30.f}, vec3{0.3f,0.2f,1}, 1000.f}, false, 0,0,0, 0,0,0);
+
+	logger << "Known hits: " << (numFailed? "FAILED" : "ok");
+
+	const u32 numRays = 100000;
+	std::vector<Ray> rays(numRays);
+	std::vector<RaycastHit> hits(numRays);
+
+	srand(0);
+	auto randomPoint = []{
+		return vec3{(rand()%25600)/100.f - 128.f, (rand()%25600)/100.f - 128.f, 4.f + (rand()%2000)/100.f};
+	};
+
+	f64 totalDistance = 0.0;
+	for(auto& r: rays) {
+		vec3 from = randomPoint();
+		vec3 to = randomPoint();
+		r = Ray{from, to - from, glm::distance(from, to)};
+		totalDistance += r.maxDistance;
+	}
+
+	f64 singleMs = TimeMs(1, [&]{ RaycastMany(world, rays.data(), hits.data(), numRays, 1); });
+	f64 manyMs = TimeMs(1, [&]{ RaycastMany(world, rays.data(), hits.data(), numRays); });
+
+	u32 numBlocked = 0;
+	for(auto& h: hits) numBlocked += h.hit;
+
+	logger << numRays << " line of sight rays, " << (totalDistance/numRays) << " voxels long on average, " 
+		<< (100.0*numBlocked/numRays) << "% blocked";
+	logger << "	1 thread: " << singleMs << "ms (" << (numRays/singleMs/1000.0) << " Mrays/s)";
+	logger << "	" << std::max(std::thread::hardware_concurrency(), 1u) << " threads: " << manyMs << "ms (" 
+		<< (numRays/manyMs/1000.0) << " Mrays/s)";
+}
+
+// Quads saved by culling faces against neighbours, and what copying the
+//	borders costs per chunk, unpacked and palette packed
+static void BenchBorders() {
+	VoxelWorld world{32,32,24};
+
+	for(s32 x = -128; x < 128; x++)
+	for(s32 y = -128; y < 128; y++) {
+		s32 h = 8 + (s32)(6.f * std::sin(x*0.05f) * std::cos(y*0.07f));
+		world.FillBox(x, y, 0, x+1, y+1, h, 1, stbvox_rgb{100, 150, 100});
+	}
+
+	u64 syncedQuads = 0;
+	u64 closedQuads = 0;
+
+	world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		chunk->Invalidate();
+		chunk->BuildMesh();
+		syncedQuads += chunk->numBuiltQuads;
+
+		// Each chunk on its own, like before borders were synced
+		VoxelChunk* neighbours[6];
+		std::copy(chunk->neighbours, chunk->neighbours+6, neighbours);
+		std::fill(chunk->neighbours, chunk->neighbours+6, nullptr);
+
+		chunk->Invalidate();
+		chunk->BuildMesh();
+		closedQuads += chunk->numBuiltQuads;
+
+		std::copy(neighbours, neighbours+6, chunk->neighbours);
+	});
+
+	auto chunk = world.GetChunk({0,0,0});
+	std::vector<u8> blocks(chunk->PaddedSize());
+	f64 unpackedMs = TimeMs(10000, [&]{ chunk->CopyBorders(blocks.data()); });
+
+	world.CompressChunks();
+	f64 packedMs = TimeMs(1000, [&]{ chunk->CopyBorders(blocks.data()); });
+
+	logger << world.chunks.count << " chunks of hills";
+	logger << "	Closed borders: " << closedQuads << " quads";
+	logger << "	Synced borders: " << syncedQuads << " quads (" << (100.0*syncedQuads/closedQuads) << "%)";
+	logger << "	CopyBorders: " << (unpackedMs*1000.0) << "us unpacked, " << (packedMs*1000.0) << "us from palette storage";
+}
+
+// Bake times, what single edits cost to relight, and whether incremental
+//	updates end up where a fresh bake would
+static void BenchLighting() {
+	VoxelWorld world{32,32,24};
+
+	for(s32 x = -128; x < 128; x++)
+	for(s32 y = -128; y < 128; y++) {
+		s32 h = 8 + (s32)(6.f * std::sin(x*0.05f) * std::cos(y*0.07f));
+		world.FillBox(x, y, 0, x+1, y+1, h, 1, stbvox_rgb{100, 150, 100});
+	}
+
+	LightEngine lighting {&world};
+
+	f64 singleMs = TimeMs(1, [&]{ lighting.Bake(1); });
+	f64 manyMs = TimeMs(1, [&]{ lighting.Bake(); });
+
+	logger << world.chunks.count << " chunks of hills";
+	logger << "	Bake, 1 thread: " << singleMs << "ms";
+	logger << "	Bake, " << std::max(std::thread::hardware_concurrency(), 1u) << " threads: " << manyMs << "ms";
+
+	world.lighting = &lighting;
+
+	auto lightAt = [&](s32 x, s32 y, s32 z, LightEngine::Channel c) {
+		auto cc = world.ChunkCoordAt(x,y,z);
+		auto chunk = world.GetChunk(cc);
+		if(!chunk) return (u8)0;
+		return LightEngine::Get(chunk, x - cc.x*world.chunkWidth, y - cc.y*world.chunkHeight, z - cc.z*world.chunkDepth, c);
+	};
+
+	u32 numFailed = 0;
+	auto check = [&](const char* what, s32 x, s32 y, s32 z, LightEngine::Channel c, u8 expected) {
+		u8 level = lightAt(x,y,z,c);
+		if(level == expected) return;
+
+		logger << "	FAILED: " << what << ", got " << (u32)level << " expected " << (u32)expected;
+		numFailed++;
+	};
+
+	auto relight = [&] {
+		u64 before = lighting.numSteps;
+		f64 ms = TimeMs(1, [&]{ while(!lighting.Update(~0u)); });
+		return std::make_pair(lighting.numSteps - before, ms);
+	};
+
+	// A roof over open ground shades it by the distance to its edge, across chunk borders
+	check("open sky", 0, 0, 20, LightEngine::Sky, 15);
+	world.FillBox(-10, -10, 20, 11, 11, 21, 1, stbvox_rgb{});
+	auto roof = relight();
+	check("under roof", 0, 0, 19, LightEngine::Sky, 4);
+	check("under roof edge", 10, 0, 19, LightEngine::Sky, 14);
+
+	// A sealed room under the roof, with a lamp in it
+	world.FillBox(-3, -3, 14, 4, 4, 19, 1, stbvox_rgb{});
+	world.FillBox(-2, -2, 15, 3, 3, 18, 0, stbvox_rgb{});
+	relight();
+	check("sealed room", 0, 0, 16, LightEngine::Sky, 0);
+
+	world.SetBlock(0, 0, 15, 8);
+	auto lamp = relight();
+	check("lamp", 0, 0, 15, LightEngine::Block, 14);
+	check("next to lamp", 1, 1, 16, LightEngine::Block, 11);
+	check("lamp behind wall", 0, 4, 16, LightEngine::Block, 0);
+
+	world.SetBlock(0, 3, 16, 0);
+	auto hole = relight();
+	check("through the hole", 0, 4, 16, LightEngine::Block, 9);
+	check("sky through the hole", 0, 2, 16, LightEngine::Sky, 6);
+
+	world.SetBlock(0, 0, 15, 0);
+	auto unlamp = relight();
+	check("lamp removed", 1, 1, 16, LightEngine::Block, 0);
+
+	world.FillBox(-10, -10, 20, 11, 11, 21, 0, stbvox_rgb{});
+	auto unroof = relight();
+	check("roof removed", 0, 0, 19, LightEngine::Sky, 15);
+
+	// Whatever the edits did should match lighting everything again
+	std::vector<std::vector<u8>> incremental;
+	world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		incremental.emplace_back(chunk->lightData, chunk->lightData + chunk->PaddedSize());
+	});
+
+	lighting.Bake();
+
+	u32 i = 0, numDiffering = 0;
+	world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		numDiffering += !std::equal(incremental[i].begin(), incremental[i].end(), chunk->lightData);
+		i++;
+	});
+
+	if(numDiffering) {
+		logger << "	FAILED: " << numDiffering << " chunks differ from a fresh bake";
+		numFailed++;
+	}
+
+	logger << "Known levels: " << (numFailed? "FAILED" : "ok");
+	logger << "	Roof added: " << roof.first << " steps, " << roof.second << "ms";
+	logger << "	Roof removed: " << unroof.first << " steps, " << unroof.second << "ms";
+	logger << "	Lamp added: " << lamp.first << " steps, " << lamp.second << "ms";
+	logger << "	Lamp removed: " << unlamp.first << " steps, " << unlamp.second << "ms";
+	logger << "	Wall opened: " << hole.first << " steps, " << hole.second << "ms";
+}
+
+// Noise and terrain generation rates, AVX2 against scalar, and whether the 
+//	result depends on anything but the seed
+static void BenchTerrain() {
+	TerrainGenerator terrain {1234};
+	auto& noise = terrain.noise;
+	bool hasAVX2 = GradientNoise::HasAVX2();
+
+	const u32 rowLength = 1000;
+	const u32 numRows = 1000;
+	std::vector<f32> scalarRow(rowLength), simdRow(rowLength);
+
+	u32 numFailed = 0;
+	auto compareRows = [&](const vec3& start, const vec3& step) {
+		noise.useAVX2 = false;
+		noise.SampleRow(start, step, rowLength, scalarRow.data());
+		noise.useAVX2 = hasAVX2;
+		noise.SampleRow(start, step, rowLength, simdRow.data());
+		return std::equal(scalarRow.begin(), scalarRow.end(), simdRow.begin());
+	};
+
+	if(!compareRows(vec3{-100.3f, 5.7f, -2.2f}, vec3{0.13f, 0.f, 0.f})
+		|| !compareRows(vec3{3.1f, -300.9f, 0.5f}, vec3{0.01f, 0.07f, -0.11f})) {
+		logger << "	FAILED: AVX2 and scalar noise differ";
+		numFailed++;
+	}
+
+	auto timeNoise = [&](bool avx2) {
+		noise.useAVX2 = avx2;
+		return TimeMs(1, [&]{
+			for(u32 r = 0; r < numRows; r++)
+				noise.SampleRow(vec3{0.5f, r*0.1f, 0.3f}, vec3{0.05f, 0.f, 0.01f}, rowLength, scalarRow.data());
+		});
+	};
+
+	f64 scalarNoiseMs = timeNoise(false);
+	f64 simdNoiseMs = hasAVX2? timeNoise(true) : 0.0;
+
+	// The same chunks generated different ways should come out identical
+	auto snapshot = [](VoxelWorld& world) {
+		std::vector<u8> data;
+		for(s32 cx = -4; cx < 4; cx++)
+		for(s32 cy = -4; cy < 4; cy++)
+		for(s32 cz = 0; cz < 2; cz++) {
+			auto chunk = world.GetChunk({cx,cy,cz});
+			data.insert(data.end(), chunk->blockData, chunk->blockData + chunk->PaddedSize());
+			auto colors = reinterpret_cast<u8*>(chunk->colorData);
+			data.insert(data.end(), colors, colors + chunk->PaddedSize()*sizeof(stbvox_rgb));
+		}
+		return data;
+	};
+
+	u64 numVoxels = 8*8*2 * 32*32*24;
+	auto timeWorld = [&](bool avx2, u32 numThreads, std::vector<u8>* data) {
+		VoxelWorld world{32,32,24};
+		noise.useAVX2 = avx2;
+		f64 ms = TimeMs(1, [&]{ terrain.Generate(world, ChunkCoord{-4,-4,0}, ChunkCoord{3,3,1}, numThreads); });
+		*data = snapshot(world);
+		return ms;
+	};
+
+	std::vector<u8> scalarData, simdData, threadedData;
+	f64 scalarMs = timeWorld(false, 1, &scalarData);
+	f64 simdMs = timeWorld(hasAVX2, 1, &simdData);
+	f64 threadedMs = timeWorld(hasAVX2, 0, &threadedData);
+
+	// One chunk at a time, backwards
+	VoxelWorld reversed{32,32,24};
+	for(s32 cx = 3; cx >= -4; cx--)
+	for(s32 cy = 3; cy >= -4; cy--)
+	for(s32 cz = 1; cz >= 0; cz--)
+		terrain.Generate(*reversed.GetOrCreateChunk({cx,cy,cz}), cx*32, cy*32, cz*24);
+
+	if(scalarData != simdData || simdData != threadedData || threadedData != snapshot(reversed)) {
+		logger << "	FAILED: generated voxels depend on more than the seed";
+		numFailed++;
+	}
+
+	u64 numSolid = 0;
+	reversed.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		for(u32 x = 0; x < chunk->width; x++)
+		for(u32 y = 0; y < chunk->height; y++)
+		for(u32 z = 0; z < chunk->depth; z++)
+			numSolid += (chunk->GetBlock(x,y,z) != 0);
+	});
+
+	auto rate = [](u64 n, f64 ms) { return n/ms/1000.0; };
+
+	logger << "Determinism: " << (numFailed? "FAILED" : "ok");
+	logger << "Noise, " << numRows*rowLength << " samples";
+	logger << "	Scalar: " << scalarNoiseMs << "ms (" << rate(numRows*rowLength, scalarNoiseMs) << " M/s)";
+	if(hasAVX2) logger << "	AVX2: " << simdNoiseMs << "ms (" << rate(numRows*rowLength, simdNoiseMs) << " M/s)";
+	else logger << "	AVX2: not supported";
+
+	logger << "Terrain, 128 chunks, " << (100.0*numSolid/numVoxels) << "% solid";
+	logger << "	Scalar, 1 thread: " << scalarMs << "ms (" << rate(numVoxels, scalarMs) << " Mvoxels/s)";
+	logger << "	" << (hasAVX2? "AVX2" : "Scalar") << ", 1 thread: " << simdMs << "ms (" << rate(numVoxels, simdMs) << " Mvoxels/s)";
+	logger << "	" << (hasAVX2? "AVX2" : "Scalar") << ", " << std::max(std::thread::hardware_concurrency(), 1u) << " threads: " << threadedMs 
+		<< "ms (" << rate(numVoxels, threadedMs) << " Mvoxels/s)";
+}
+
+// Total size of the files in a directory, deleting them if asked
+static u64 DirectorySize(const std::string& directory, bool remove = false) {
+	auto dir = opendir(directory.c_str());
+	if(!dir) return 0;
+
+	u64 size = 0;
+	while(auto file = readdir(dir)) {
+		std::string path = directory + "/" + file->d_name;
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+		size += st.st_size;
+		if(remove) unlink(path.c_str());
+	}
+
+	closedir(dir);
+	if(remove) rmdir(directory.c_str());
+	return size;
+}
+
+// Saving, opening and loading a generated world, and what rewriting 
+//	chunks does to the files before and after compaction
+static void BenchRegions() {
+	const std::string directory = "bench_regions";
+	DirectorySize(directory, true);
+
+	VoxelWorld world{32,32,24};
+	TerrainGenerator{1234}.Generate(world, ChunkCoord{-4,-4,0}, ChunkCoord{3,3,1});
+	world.CompressChunks();
+
+	u32 numChunks = world.chunks.count;
+	u64 rawSize = (u64)numChunks*32*32*24*(1 + sizeof(stbvox_rgb));
+
+	f64 saveMs;
+	{	RegionStore store {directory, 32, 32, 24};
+		store.Open();
+		saveMs = TimeMs(1, [&]{ store.SaveAll(world); });
+	}
+
+	u64 fileSize = DirectorySize(directory);
+
+	// Compares every chunk's interior against the generated world
+	u32 numFailed = 0;
+	auto verify = [&](const char* what, VoxelWorld& loaded) {
+		u32 size = 32*32*24;
+		std::vector<u8> blocksA(size), blocksB(size);
+		std::vector<stbvox_rgb> colorsA(size), colorsB(size);
+		u32 numDiffering = 0;
+
+		world.chunks.ForEach([&](ChunkCoord c, VoxelChunk* chunk) {
+			auto other = loaded.GetChunk(c);
+			if(!other) {
+				numDiffering++;
+				return;
+			}
+
+			chunk->CopyBox(0,0,0, 32,32,24, blocksA.data(), colorsA.data());
+			other->CopyBox(0,0,0, 32,32,24, blocksB.data(), colorsB.data());
+			bool same = blocksA == blocksB 
+				&& !memcmp(colorsA.data(), colorsB.data(), size*sizeof(stbvox_rgb));
+			numDiffering += !same;
+		});
+
+		if(!numDiffering && loaded.chunks.count == world.chunks.count) return;
+
+		logger << "	FAILED: " << what << ", " << numDiffering << " chunks differ";
+		numFailed++;
+	};
+
+	RegionStore store {directory, 32, 32, 24};
+	u32 numSaved = 0;
+	f64 openMs = TimeMs(1, [&]{ numSaved = store.Open(); });
+
+	VoxelWorld loaded{32,32,24};
+	f64 maxLoadMs = 0.0;
+	f64 totalLoadMs = 0.0;
+
+	world.chunks.ForEach([&](ChunkCoord c, VoxelChunk*) {
+		f64 ms = TimeMs(1, [&]{ store.LoadChunk(loaded, c); });
+		maxLoadMs = std::max(maxLoadMs, ms);
+		totalLoadMs += ms;
+	});
+
+	verify("loaded chunks", loaded);
+	if(numSaved != numChunks) {
+		logger << "	FAILED: " << numSaved << " chunks saved, expected " << numChunks;
+		numFailed++;
+	}
+
+	VoxelWorld loadedAll{32,32,24};
+	f64 loadAllMs = TimeMs(1, [&]{ store.LoadAll(loadedAll); });
+	verify("LoadAll", loadedAll);
+
+	// Edit a few chunks and save them over and over, like a long session would
+	for(u32 round = 0; round < 4; round++) {
+		for(s32 i = 0; i < 32; i++) {
+			ChunkCoord c {i%8 - 4, i/8 - 4, 0};
+			world.SetBlock(c.x*32 + round, c.y*32, 1, round+1);
+			store.SaveChunk(world, c);
+		}
+	}
+
+	f32 worstFragmentation = 0.f;
+	for(auto& r: store.regions) worstFragmentation = std::max(worstFragmentation, r.second->Fragmentation());
+	u64 fragmentedSize = DirectorySize(directory);
+
+	f64 compactMs = TimeMs(1, [&]{ store.CompactIfNeeded(0.f); });
+	u64 compactedSize = DirectorySize(directory);
+
+	{	RegionStore reopened {directory, 32, 32, 24};
+		reopened.Open();
+		VoxelWorld compacted{32,32,24};
+		reopened.LoadAll(compacted);
+		verify("after compaction", compacted);
+	}
+
+	// Damaged records have to fail to load rather than read past them
+	{	VoxelChunk saved{32,32,24};
+		TerrainGenerator{1234}.Generate(saved, 0, 0, 0);
+
+		RegionFile file;
+		file.Open(directory + "/damaged", 32, 32, 24);
+		file.Save(0, saved);
+		auto entry = file.GetEntry(0);
+
+		VoxelChunk other{16,16,16};
+		if(file.Load(0, other)) numFailed++;
+
+		auto damaged = [&](u32 field, u32 value) {
+			RegionFile::Record record;
+			memcpy(&record, file.mapping + entry.offset, sizeof(record));
+			file.Write(entry.offset + field*sizeof(u32), &value, sizeof(value));
+
+			VoxelChunk loaded{32,32,24};
+			bool ok = file.Load(0, loaded);
+			file.Write(entry.offset, &record, sizeof(record));
+			return ok;
+		};
+
+		// numWords, bitsPerVoxel, and a palette too small for its indices
+		if(damaged(5, 1u<<20) || damaged(4, 3) || damaged(3, 1)) numFailed++;
+
+		file.SetEntry(0, RegionFile::Entry{entry.offset, entry.size + (1u<<20)});
+		VoxelChunk loaded{32,32,24};
+		if(file.Load(0, loaded)) numFailed++;
+
+		file.SetEntry(0, entry);
+		if(!file.Load(0, loaded)) numFailed++;
+	}
+
+	// Nor leave an empty chunk behind for SaveAll to write over the record
+	{	VoxelWorld source{32,32,24};
+		TerrainGenerator{1234}.Generate(source, ChunkCoord{0,0,0}, ChunkCoord{0,0,0});
+
+		RegionStore damagedStore {directory + "/damagedstore", 32, 32, 24};
+		damagedStore.Open();
+		damagedStore.SaveAll(source);
+
+		ChunkCoord c {0,0,0};
+		auto region = damagedStore.GetRegion(c, false);
+		auto entry = region->GetEntry(RegionFile::EntryIndex(c.x, c.y, c.z));
+		u32 badBits = 3;
+		region->Write(entry.offset + 4*sizeof(u32), &badBits, sizeof(badBits));
+
+		VoxelWorld loaded{32,32,24};
+		if(damagedStore.LoadChunk(loaded, c) || loaded.GetChunk(c)) numFailed++;
+	}
+
+	DirectorySize(directory, true);
+
+	logger << "Round trips, damaged records refused: " << (numFailed? "FAILED" : "ok");
+	logger << numChunks << " chunks, " << (rawSize>>10) << "KB raw, " << (fileSize>>10) << "KB in " 
+		<< store.regions.size() << " region files";
+	logger << "	Save: " << saveMs << "ms";
+	logger << "	Open: " << openMs << "ms";
+	logger << "	Load per chunk: " << (totalLoadMs*1000.0/numChunks) << "us average, " << (maxLoadMs*1000.0) << "us worst";
+	logger << "	LoadAll: " << loadAllMs << "ms";
+	logger << "	After 4 rewrites of 32 chunks: " << (fragmentedSize>>10) << "KB, " 
+		<< (worstFragmentation*100.f) << "% garbage in the worst region";
+	logger << "	Compacted: " << (compactedSize>>10) << "KB in " << compactMs << "ms";
+}
+
+// Meshing a lit world from nothing, with an empty cache, and with a warm one
+static void BenchMeshCache() {
+	const std::string directory = "bench_meshcache";
+	DirectorySize(directory, true);
+
+	VoxelWorld world{32,32,24};
+	world.SetMeshMethod(MeshMethod::Greedy);
+	TerrainGenerator{1234}.Generate(world, ChunkCoord{-4,-4,0}, ChunkCoord{3,3,1});
+
+	LightEngine lighting {&world};
+	lighting.Bake();
+
+	u64 numQuads = 0;
+	auto meshAll = [&] {
+		numQuads = 0;
+		world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+			chunk->Invalidate();
+			chunk->BuildMesh();
+			numQuads += chunk->numBuiltQuads;
+		});
+	};
+
+	// Every chunk's built mesh, to check hits against
+	auto snapshot = [&] {
+		std::vector<u32> data;
+		world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+			data.insert(data.end(), chunk->vertexData, chunk->vertexData + chunk->numBuiltQuads*4);
+			data.insert(data.end(), chunk->faceData, chunk->faceData + chunk->numBuiltQuads);
+			data.insert(data.end(), chunk->builtSlabQuads.begin(), chunk->builtSlabQuads.end());
+		});
+		return data;
+	};
+
+	f64 uncachedMs = TimeMs(1, meshAll);
+	auto uncached = snapshot();
+
+	MeshCache cold {directory};
+	VoxelChunk::meshCache = &cold;
+	f64 coldMs = TimeMs(1, meshAll);
+
+	MeshCache warm {directory};
+	VoxelChunk::meshCache = &warm;
+	f64 warmMs = TimeMs(1, meshAll);
+	auto cached = snapshot();
+
+	// Damaged files, one way each: a quad count whose vertex buffer would
+	//	overflow, an occluder count past the end, and a truncated file
+	u32 numDamaged = 0;
+	if(auto dir = opendir(directory.c_str())) {
+		while(auto entry = readdir(dir)) {
+			std::string path = directory + "/" + entry->d_name;
+			if(path.find(".mesh") == std::string::npos) continue;
+
+			struct stat st;
+			if(numDamaged == 2) {
+				if(stat(path.c_str(), &st) == 0 && truncate(path.c_str(), st.st_size - 4) == 0) numDamaged++;
+				break;
+			}
+
+			// numQuads, then the first slab's numOccluders
+			const long offsets[2] {16, 64};
+			const u32 values[2] {1u<<30, ~0u};
+			auto file = fopen(path.c_str(), "r+b");
+			if(!file) continue;
+
+			if(fseek(file, offsets[numDamaged], SEEK_SET) == 0 && fwrite(&values[numDamaged], sizeof(u32), 1, file) == 1) 
+				numDamaged++;
+			fclose(file);
+		}
+
+		closedir(dir);
+	}
+
+	MeshCache damaged {directory};
+	VoxelChunk::meshCache = &damaged;
+	meshAll();
+	auto rebuilt = snapshot();
+
+	// Edited chunks miss, along with the neighbours sharing their borders
+	MeshCache edited {directory};
+	VoxelChunk::meshCache = &edited;
+	world.SetBlock(0, 0, 30, 1);
+	world.SetBlock(31, 31, 30, 1);
+	meshAll();
+
+	VoxelChunk::meshCache = nullptr;
+	u64 cacheSize = DirectorySize(directory);
+
+	// Reopened with half the room, it trims itself to 3/4 of that
+	MeshCache trimmed {directory, cacheSize/2};
+	u64 trimmedSize = DirectorySize(directory, true);
+
+	// Identical chunks, like all air, hit even when cold
+	bool ok = (uncached == cached) && warm.numMisses == 0;
+	bool rejected = (uncached == rebuilt) && numDamaged == 3 && damaged.numMisses >= numDamaged;
+	logger << "Cached meshes: " << (ok? "ok" : "FAILED");
+	bool evicted = trimmed.numEvicted > 0 && trimmedSize <= cacheSize/2/4*3 && trimmedSize == trimmed.numBytes;
+	logger << "Damaged files rejected: " << (rejected? "ok" : "FAILED");
+	logger << "Evicted to the cap: " << (evicted? "ok" : "FAILED");
+	logger << world.chunks.count << " lit chunks, " << numQuads << " quads, " << (cacheSize>>10) << "KB cached";
+	logger << "	No cache: " << uncachedMs << "ms";
+	logger << "	Cold: " << coldMs << "ms, " << cold.numHits << " hits " << cold.numMisses << " misses";
+	logger << "	Warm: " << warmMs << "ms, " << warm.numHits << " hits " << warm.numMisses << " misses";
+	logger << "	After damaging " << numDamaged << " files: " << damaged.numHits << " hits " << damaged.numMisses << " misses";
+	logger << "	After editing 2 voxels: " << edited.numHits << " hits " << edited.numMisses << " misses";
+	logger << "	Capped at " << (cacheSize>>11) << "KB: " << trimmed.numEvicted << " files evicted, " << (trimmedSize>>10) << "KB left";
+}
+
+// What snapshotting costs against copying the whole chunk, and a reader 
+//	thread meshing snapshots while the chunk is edited underneath it
+static void BenchSnapshots() {
+	VoxelWorld world{32,32,24};
+	TerrainGenerator{1234}.Generate(world, ChunkCoord{-1,-1,0}, ChunkCoord{0,0,1});
+
+	auto chunk = world.GetChunk({0,0,0});
+	u32 paddedSize = chunk->PaddedSize();
+	std::vector<u8> blocks(paddedSize);
+	std::vector<stbvox_rgb> colors(paddedSize);
+
+	// FNV-1a of the interior only, since padding differs between copies
+	auto interiorHash = [&](const u8* b, const stbvox_rgb* c) {
+		u64 hash = 0xcbf29ce484222325ull;
+		for(u32 x = 0; x < chunk->width; x++)
+		for(u32 y = 0; y < chunk->height; y++)
+		for(u32 z = 0; z < chunk->depth; z++) {
+			u32 i = chunk->Index(x,y,z);
+			hash = (hash ^ b[i]) * 0x100000001b3ull;
+			hash = (hash ^ (c[i].r | c[i].g<<8 | c[i].b<<16)) * 0x100000001b3ull;
+		}
+		return hash;
+	};
+
+	auto liveHash = [&] {
+		chunk->CopyVoxelData(blocks.data(), colors.data());
+		return interiorHash(blocks.data(), colors.data());
+	};
+
+	f64 copyMs = TimeMs(1000, [&]{
+		chunk->CopyVoxelData(blocks.data(), colors.data());
+		chunk->CopyBorders(blocks.data());
+	});
+
+	f64 fullMs = TimeMs(100, [&]{
+		chunk->version.reset();
+		chunk->Snapshot();
+	});
+
+	u32 edit = 0;
+	f64 editMs = TimeMs(1000, [&]{
+		chunk->SetBlock(edit%32, (edit/32)%32, 20, edit&1);
+		chunk->Snapshot();
+		edit++;
+	});
+
+	auto before = chunk->Snapshot();
+	chunk->SetBlock(5, 5, 5, 0);
+	auto after = chunk->Snapshot();
+
+	u32 numShared = 0;
+	for(u32 i = 0; i < before->NumBricks(); i++)
+		numShared += (before->bricks[i] == after->bricks[i]);
+
+	// Edits after a snapshot mustn't show up in it
+	u64 beforeHash = 0;
+	before->Unpack(blocks.data(), colors.data());
+	beforeHash = interiorHash(blocks.data(), colors.data());
+
+	chunk->FillBox(0,0,0, 16,16,12, 1, stbvox_rgb{255, 0, 0});
+	before->Unpack(blocks.data(), colors.data());
+
+	u32 numFailed = 0;
+	if(interiorHash(blocks.data(), colors.data()) != beforeHash) {
+		logger << "	FAILED: snapshot changed after an edit";
+		numFailed++;
+	}
+
+	// The reader meshes whatever it's handed while the main thread edits on
+	std::mutex mutex;
+	std::condition_variable available;
+	std::deque<std::pair<std::shared_ptr<const ChunkVersion>, u64>> queue;
+	bool finished = false;
+	u32 numMeshed = 0;
+	u32 numMismatched = 0;
+
+	std::thread reader([&] {
+		VoxelChunk scratch {chunk->width, chunk->height, chunk->depth};
+		scratch.meshMethod = MeshMethod::Greedy;
+		std::vector<u8> readerBlocks(paddedSize);
+		std::vector<stbvox_rgb> readerColors(paddedSize);
+
+		while(true) {
+			std::pair<std::shared_ptr<const ChunkVersion>, u64> item;
+
+			{	std::unique_lock<std::mutex> lock{mutex};
+				available.wait(lock, [&]{ return finished || !queue.empty(); });
+				if(queue.empty()) return;
+
+				item = queue.front();
+				queue.pop_front();
+			}
+
+			item.first->Unpack(readerBlocks.data(), readerColors.data());
+			numMismatched += interiorHash(readerBlocks.data(), readerColors.data()) != item.second;
+
+			scratch.Invalidate();
+			scratch.BeginBuild();
+			scratch.BuildMesh(readerBlocks.data(), readerColors.data());
+			numMeshed++;
+		}
+	});
+
+	srand(0);
+	const u32 numEdits = 200;
+	f64 publishMs = 0.0;
+
+	for(u32 i = 0; i < numEdits; i++) {
+		u32 x = rand()%28, y = rand()%28, z = rand()%20;
+		chunk->FillBox(x, y, z, x + rand()%4 + 1, y + rand()%4 + 1, z + rand()%4 + 1, rand()%2, stbvox_rgb{0, 0, 255});
+
+		u64 expected = liveHash();
+		std::shared_ptr<const ChunkVersion> version;
+		publishMs += TimeMs(1, [&]{ version = chunk->Snapshot(); });
+
+		{	std::lock_guard<std::mutex> lock{mutex};
+			queue.emplace_back(version, expected);
+		}
+
+		available.notify_one();
+	}
+
+	{	std::lock_guard<std::mutex> lock{mutex};
+		finished = true;
+	}
+
+	available.notify_one();
+	reader.join();
+
+	if(numMismatched) {
+		logger << "	FAILED: " << numMismatched << " of " << numMeshed << " snapshots didn't match the chunk when taken";
+		numFailed++;
+	}
+
+	logger << "Snapshots: " << (numFailed? "FAILED" : "ok");
+	logger << "	Copying the whole chunk: " << (copyMs*1000.0) << "us";
+	logger << "	Snapshot from scratch: " << (fullMs*1000.0) << "us";
+	logger << "	Snapshot after a one voxel edit: " << (editMs*1000.0) << "us, " 
+		<< numShared << "/" << before->NumBricks() << " bricks shared";
+	logger << "	" << numEdits << " box edits meshed on another thread, " 
+		<< (publishMs*1000.0/numEdits) << "us per snapshot";
+}
+
+// Hardware cache misses for the calling thread, if the kernel lets us count them
+struct CacheMissCounter {
+	s32 fd;
+
+	CacheMissCounter() {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	~CacheMissCounter() { if(fd >= 0) close(fd); }
+
+	template<class F>
+	s64 Count(F&& func) {
+		if(fd < 0) { func(); return -1; }
+
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		func();
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+		u64 count = 0;
+		if(read(fd, &count, sizeof count) != sizeof count) return -1;
+		return count;
+	}
+};
+
+// The padded blockData layout behind the same interface as BrickLayout
+struct PaddedLayout {
+	u32 width, height, depth;
+	const u8* blocks;
+
+	u32 Index(u32 x, u32 y, u32 z) const {
+		return 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
+	}
+};
+
+// Exposed faces of every voxel not on the chunk border, visiting in 
+//	x-y-z order with x innermost if asked, which is the worst case for
+//	the padded layout. Also totals the distinct cache lines each voxel's 
+//	neighbourhood touches
+template<class L>
+static u64 ScanExposedFaces(const L& layout, bool xInner, u64* numLines) {
+	u64 numFaces = 0;
+	u64 lines = 0;
+
+	auto visit = [&](u32 x, u32 y, u32 z) {
+		u32 idx[7] = {
+			layout.Index(x,y,z),
+			layout.Index(x-1,y,z), layout.Index(x+1,y,z),
+			layout.Index(x,y-1,z), layout.Index(x,y+1,z),
+			layout.Index(x,y,z-1), layout.Index(x,y,z+1),
+		};
+
+		if(layout.blocks[idx[0]])
+			for(u32 i = 1; i < 7; i++)
+				numFaces += !layout.blocks[idx[i]];
+
+		if(numLines) {
+			for(u32 i = 0; i < 7; i++) {
+				bool seen = false;
+				for(u32 j = 0; j < i; j++)
+					seen |= (idx[i]>>6) == (idx[j]>>6);
+				lines += !seen;
+			}
+		}
+	};
+
+	if(xInner) {
+		for(u32 z = 1; z < layout.depth-1; z++)
+		for(u32 y = 1; y < layout.height-1; y++)
+		for(u32 x = 1; x < layout.width-1; x++)
+			visit(x,y,z);
+	} else {
+		for(u32 x = 1; x < layout.width-1; x++)
+		for(u32 y = 1; y < layout.height-1; y++)
+		for(u32 z = 1; z < layout.depth-1; z++)
+			visit(x,y,z);
+	}
+
+	if(numLines) *numLines = lines;
+	return numFaces;
+}
+
+// Breadth first fill of the air from the top layer, losing a level per
+//	step like block light does. levels is in the same layout as blocks
+template<class L>
+static u64 FloodFill(const L& layout, u8* levels, u32 size) {
+	struct Node { u16 x, y, z; };
+	static std::vector<Node> queue;
+	queue.clear();
+	memset(levels, 0, size);
+
+	const u32 top = layout.depth-1;
+	for(u32 x = 0; x < layout.width; x++)
+	for(u32 y = 0; y < layout.height; y++) {
+		u32 i = layout.Index(x,y,top);
+		if(layout.blocks[i]) continue;
+		levels[i] = 15;
+		queue.push_back(Node{u16(x), u16(y), u16(top)});
+	}
+
+	u64 numVisited = 0;
+	for(size_t head = 0; head < queue.size(); head++) {
+		Node n = queue[head];
+		u8 level = levels[layout.Index(n.x, n.y, n.z)];
+		numVisited++;
+		if(level <= 1) continue;
+
+		auto spread = [&](u32 x, u32 y, u32 z) {
+			u32 i = layout.Index(x,y,z);
+			if(layout.blocks[i] || levels[i] >= level-1) return;
+			levels[i] = level-1;
+			queue.push_back(Node{u16(x), u16(y), u16(z)});
+		};
+
+		if(n.x > 0) spread(n.x-1, n.y, n.z);
+		if(n.x+1u < layout.width) spread(n.x+1, n.y, n.z);
+		if(n.y > 0) spread(n.x, n.y-1, n.z);
+		if(n.y+1u < layout.height) spread(n.x, n.y+1, n.z);
+		if(n.z > 0) spread(n.x, n.y, n.z-1);
+		if(n.z+1u < layout.depth) spread(n.x, n.y, n.z+1);
+	}
+
+	return numVisited;
+}
+
+static void BenchLayout() {
+	CacheMissCounter counter;
+	u32 numFailed = 0;
+
+	auto benchChunk = [&](u32 w, u32 h, u32 d, u32 iterations) {
+		VoxelChunk chunk{w,h,d};
+		TerrainGenerator{1234}.Generate(chunk, 0, 0, 0);
+
+		BrickLayout bricks{w,h,d};
+		bricks.Pack(chunk.blockData, chunk.colorData);
+
+		PaddedLayout padded{w, h, d, chunk.blockData};
+		u32 paddedSize = chunk.PaddedSize();
+		u64 numVoxels = u64(w)*h*d;
+
+		// The adapter should give back exactly what went in
+		std::vector<u8> blocks(paddedSize);
+		std::vector<stbvox_rgb> colors(paddedSize);
+		bricks.Unpack(blocks.data(), colors.data());
+		for(u32 x = 0; x < w; x++)
+		for(u32 y = 0; y < h; y++)
+		for(u32 z = 0; z < d; z++) {
+			u32 i = padded.Index(x,y,z);
+			auto& a = colors[i];
+			auto& b = chunk.colorData[i];
+			if(blocks[i] != chunk.blockData[i] || bricks.GetBlock(x,y,z) != chunk.blockData[i]
+				|| a.r != b.r || a.g != b.g || a.b != b.b) {
+				numFailed++;
+				x = w; y = h; break;
+			}
+		}
+
+		logger << w << "x" << h << "x" << d << ", " << bricks.size << " brick slots for " << numVoxels << " voxels";
+
+		auto missesPerK = [&](s64 misses) {
+			return misses < 0? string{"n/a"} : std::to_string(1000.0*misses/numVoxels);
+		};
+
+		for(bool xInner : {false, true}) {
+			u64 paddedLines, brickLines;
+			u64 paddedFaces = ScanExposedFaces(padded, xInner, &paddedLines);
+			u64 brickFaces = ScanExposedFaces(bricks, xInner, &brickLines);
+			if(paddedFaces != brickFaces) numFailed++;
+
+			u64 result = 0;
+			s64 paddedMisses = counter.Count([&]{ result += ScanExposedFaces(padded, xInner, nullptr); });
+			s64 brickMisses = counter.Count([&]{ result += ScanExposedFaces(bricks, xInner, nullptr); });
+			f64 paddedMs = TimeMs(iterations, [&]{ result += ScanExposedFaces(padded, xInner, nullptr); });
+			f64 brickMs = TimeMs(iterations, [&]{ result += ScanExposedFaces(bricks, xInner, nullptr); });
+			if(result == 0) logger << "	(no faces)";
+
+			logger << "	Face scan, " << (xInner? "x" : "z") << " innermost";
+			logger << "		Padded: " << paddedMs << "ms, " << (f64(paddedLines)/numVoxels) << " lines/voxel, "
+				<< missesPerK(paddedMisses) << " misses/kvoxel";
+			logger << "		Bricks: " << brickMs << "ms, " << (f64(brickLines)/numVoxels) << " lines/voxel, "
+				<< missesPerK(brickMisses) << " misses/kvoxel";
+		}
+
+		std::vector<u8> paddedLevels(paddedSize), brickLevels(bricks.size);
+		u64 paddedVisited = 0, brickVisited = 0;
+		s64 paddedMisses = counter.Count([&]{ paddedVisited = FloodFill(padded, paddedLevels.data(), paddedSize); });
+		s64 brickMisses = counter.Count([&]{ brickVisited = FloodFill(bricks, brickLevels.data(), bricks.size); });
+		f64 paddedMs = TimeMs(iterations, [&]{ FloodFill(padded, paddedLevels.data(), paddedSize); });
+		f64 brickMs = TimeMs(iterations, [&]{ FloodFill(bricks, brickLevels.data(), bricks.size); });
+
+		for(u32 x = 0; x < w; x++)
+		for(u32 y = 0; y < h; y++)
+		for(u32 z = 0; z < d; z++)
+			if(paddedLevels[padded.Index(x,y,z)] != brickLevels[bricks.Index(x,y,z)]) {
+				numFailed++;
+				x = w; y = h; break;
+			}
+
+		if(paddedVisited != brickVisited) numFailed++;
+
+		logger << "	Flood fill, " << paddedVisited << " nodes";
+		logger << "		Padded: " << paddedMs << "ms, " << missesPerK(paddedMisses) << " misses/kvoxel";
+		logger << "		Bricks: " << brickMs << "ms, " << missesPerK(brickMisses) << " misses/kvoxel";
+
+		// The mesher only reads the padded layout, so bricks pay for Unpack first
+		chunk.meshMethod = MeshMethod::Stbvox;
+		f64 meshMs = TimeMs(iterations, [&]{ chunk.Invalidate(); chunk.BuildMesh(); });
+		f64 unpackMs = TimeMs(iterations, [&]{ bricks.Unpack(blocks.data(), colors.data()); });
+		f64 brickMeshMs = TimeMs(iterations, [&]{
+			bricks.Unpack(blocks.data(), colors.data());
+			chunk.CopyBorders(blocks.data());
+			chunk.Invalidate();
+			chunk.BeginBuild();
+			chunk.BuildMesh(blocks.data(), colors.data());
+		});
+
+		logger << "	Meshing, " << chunk.numBuiltQuads << " quads";
+		logger << "		Padded: " << meshMs << "ms";
+		logger << "		Bricks: " << brickMeshMs << "ms, of which Unpack " << unpackMs << "ms";
+	};
+
+	benchChunk(32, 32, 24, 20);
+	benchChunk(124, 124, 64, 3);
+
+	if(counter.fd < 0) logger << "Hardware cache miss counter unavailable";
+	logger << "Checks: " << (numFailed? "FAILED" : "ok");
+}
+
+// Every exposed solid cube face in a built mesh, as one entry per voxel
+//	face, so meshes that merge faces differently can be compared
+static std::vector<u64> UnitFaces(const VoxelChunk& chunk) {
+	std::vector<u64> unitFaces;
+
+	for(u32 q = 0; q < chunk.numBuiltQuads; q++) {
+		u32 mins[3] {~0u, ~0u, ~0u};
+		u32 maxs[3] {0, 0, 0};
+
+		for(u32 v = 0; v < 4; v++) {
+			u32 vert = chunk.vertexData[q*4 + v];
+			const u32 p[3] {vert & 127u, (vert>>7) & 127u, ((vert>>14) & 511u)/2};
+			for(u32 a = 0; a < 3; a++) {
+				mins[a] = std::min(mins[a], p[a]);
+				maxs[a] = std::max(maxs[a], p[a]);
+			}
+		}
+
+		u64 light = (chunk.vertexData[q*4] >> 23) & 63;
+		u64 face = chunk.faceData[q];
+		for(u32 a = 0; a < 3; a++) maxs[a] = std::max(maxs[a], mins[a]+1);
+
+		for(u32 x = mins[0]; x < maxs[0]; x++)
+		for(u32 y = mins[1]; y < maxs[1]; y++)
+		for(u32 z = mins[2]; z < maxs[2]; z++)
+			unitFaces.push_back(face<<32 | light<<26 | x<<18 | y<<9 | z);
+	}
+
+	std::sort(unitFaces.begin(), unitFaces.end());
+	return unitFaces;
+}
+
+static void BenchOccupancy() {
+	u32 numFailed = 0;
+
+	auto matchesRebuild = [](VoxelChunk& chunk) {
+		auto blocks = new u8[chunk.PaddedSize()];
+		auto colors = new stbvox_rgb[chunk.PaddedSize()];
+		chunk.CopyVoxelData(blocks, colors);
+
+		Occupancy rebuilt;
+		rebuilt.Resize(chunk.width, chunk.height, chunk.depth);
+		rebuilt.Update(blocks, 0,0,0, chunk.width, chunk.height, chunk.depth);
+		delete[] blocks;
+		delete[] colors;
+
+		auto& live = chunk.occupancy;
+		return live.occupied == rebuilt.occupied && live.solid == rebuilt.solid
+			&& live.numOccupied == rebuilt.numOccupied && live.numSolid == rebuilt.numSolid;
+	};
+
+	// Edits of every kind, including across a compression and on a chunk 
+	//	deeper than one word per column
+	for(u32 depth : {24u, 150u}) {
+		VoxelChunk chunk{32,32,depth};
+		if(!chunk.occupancy.IsEmpty()) numFailed++;
+
+		srand(1);
+		GenerateTestTerrain(chunk);
+		for(u32 i = 0; i < 2000; i++)
+			chunk.SetBlock(rand()%32, rand()%32, rand()%depth, rand()%9);
+
+		chunk.FillBox(3,4,5, 20,9,depth, 1, stbvox_rgb{1,2,3});
+		chunk.FillBox(0,0,60, 32,32,70, 0, stbvox_rgb{255,255,255});
+		chunk.Compress();
+		chunk.SetBlock(5,5,5, 2);
+
+		std::vector<u8> box(7*7*7, 1);
+		chunk.PasteBox(28,28,depth-4, 7,7,7, box.data(), nullptr);
+		if(!matchesRebuild(chunk)) numFailed++;
+
+		chunk.FillBox(0,0,0, 32,32,depth, 1, stbvox_rgb{1,2,3});
+		if(!chunk.occupancy.IsSolid() || !matchesRebuild(chunk)) numFailed++;
+		chunk.FillBox(0,0,0, 32,32,depth, 0, stbvox_rgb{1,2,3});
+		if(!chunk.occupancy.IsEmpty()) numFailed++;
+	}
+
+	VoxelWorld world{32,32,24};
+	TerrainGenerator{1234}.Generate(world, ChunkCoord{-1,-1,0}, ChunkCoord{1,1,1});
+	world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		if(!matchesRebuild(*chunk)) numFailed++;
+	});
+
+	// Binary greedy should cover exactly the faces greedy does, however it
+	//	merges them
+	auto compareMeshers = [&](VoxelChunk& chunk) {
+		chunk.meshMethod = MeshMethod::Greedy;
+		chunk.Invalidate();
+		chunk.BuildMesh();
+		auto greedyFaces = UnitFaces(chunk);
+
+		chunk.meshMethod = MeshMethod::BinaryGreedy;
+		chunk.Invalidate();
+		chunk.BuildMesh();
+		auto binaryFaces = UnitFaces(chunk);
+
+		if(greedyFaces != binaryFaces) numFailed++;
+	};
+
+	world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) { compareMeshers(*chunk); });
+
+	{	VoxelChunk chunk{32,32,24};
+		GenerateRandomTerrain(chunk, 7, 0.4f);
+		compareMeshers(chunk);
+	}
+
+	{	VoxelChunk chunk{64,64,200};
+		srand(2);
+		GenerateTestTerrain(chunk);
+		GenerateRandomTerrain(chunk, 3, 0.05f);
+		chunk.FillBox(10,10,60, 50,50,140, 1, stbvox_rgb{1,2,3});
+		compareMeshers(chunk);
+	}
+
+	// Exposed faces a byte at a time, as the meshers used to find them
+	auto chunk = world.GetChunk({0,0,0});
+	auto blocks = new u8[chunk->PaddedSize()];
+	auto colors = new stbvox_rgb[chunk->PaddedSize()];
+	chunk->CopyVoxelData(blocks, colors);
+	chunk->CopyBorders(blocks);
+
+	auto countBytewise = [&] {
+		const s32 offsets[6] {
+			(s32)((chunk->depth+2)*(chunk->height+2)), (s32)(chunk->depth+2), 1,
+			-(s32)((chunk->depth+2)*(chunk->height+2)), -(s32)(chunk->depth+2), -1,
+		};
+
+		u32 numFaces = 0;
+		for(u32 x = 0; x < chunk->width; x++)
+		for(u32 y = 0; y < chunk->height; y++)
+		for(u32 z = 0; z < chunk->depth; z++) {
+			u32 idx = chunk->Index(x,y,z);
+			if(!VoxelChunk::IsSolidCube(blocks[idx])) continue;
+			for(u32 f = 0; f < 6; f++)
+				numFaces += !VoxelChunk::IsSolidCube(blocks[idx + offsets[f]]);
+		}
+
+		return numFaces;
+	};
+
+	u32 bytewiseFaces = 0, bitwiseFaces = 0;
+	f64 bytewiseMs = TimeMs(200, [&]{ bytewiseFaces = countBytewise(); });
+	f64 bitwiseMs = TimeMs(200, [&]{ bitwiseFaces = CountExposedFaces(*chunk, chunk->occupancy, blocks, 0, chunk->width); });
+	if(bytewiseFaces != bitwiseFaces) numFailed++;
+
+	delete[] blocks;
+	delete[] colors;
+
+	logger << "Checks: " << (numFailed? "FAILED" : "ok");
+	logger << "Exposed faces of a 32x32x24 terrain chunk, " << bitwiseFaces << " faces";
+	logger << "	Byte at a time: " << bytewiseMs << "ms";
+	logger << "	Bitmask columns: " << bitwiseMs << "ms";
+
+	// Whole world, every method, including the empty chunks above ground
+	for(auto method: {MeshMethod::Stbvox, MeshMethod::Greedy, MeshMethod::BinaryGreedy}) {
+		u32 numQuads = 0;
+		world.SetMeshMethod(method);
+		f64 ms = TimeMs(5, [&]{
+			numQuads = 0;
+			world.chunks.ForEach([&](ChunkCoord, VoxelChunk* c) {
+				c->Invalidate();
+				c->BuildMesh();
+				numQuads += c->numBuiltQuads;
+			});
+		});
+
+		logger << "18 chunks, " << MethodName(method) << ": " << numQuads << " quads in " << ms << "ms";
+	}
+
+	for(u8 fill : {(u8)0, (u8)1}) {
+		VoxelChunk solid{32,32,24};
+		solid.FillBox(0,0,0, 32,32,24, fill, stbvox_rgb{1,2,3});
+		solid.meshMethod = MeshMethod::Stbvox;
+		f64 ms = TimeMs(50, [&]{ solid.Invalidate(); solid.BuildMesh(); });
+		logger << (fill? "Solid" : "Empty") << " chunk: " << solid.numBuiltQuads << " quads in " << ms << "ms";
+	}
+}
+
+// A hidden window's context drawing into a size x size framebuffer, for
+//	the benchmarks that need GL. Run with LIBGL_ALWAYS_SOFTWARE=1 to 
+//	compare on llvmpipe
+struct OffscreenContext {
+	SDL_Window* window = nullptr;
+	SDL_GLContext context = nullptr;
+	u32 size = 0;
+	u32 vao = 0, fbo = 0, renderbuffers[2] {0, 0};
+
+	bool Open(s32 major, s32 minor, u32 size);
+	void Close();
+
+	std::vector<u8> ReadPixels() const;
+	static void LoadProgram(ShaderProgram&, const char* vertexShader); // With voxel.fs
+};
+
+bool OffscreenContext::Open(s32 major, s32 minor, u32 newSize) {
+	if(SDL_Init(SDL_INIT_VIDEO) < 0) {
+		logger << "Skipped, SDL init failed";
+		return false;
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, major);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, minor);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+	window = SDL_CreateWindow("Benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
+		64, 64, SDL_WINDOW_OPENGL|SDL_WINDOW_HIDDEN);
+	context = window? SDL_GL_CreateContext(window) : nullptr;
+
+	if(!context) {
+		logger << "Skipped, needs a GL " << major << "." << minor << " context";
+		Close();
+		return false;
+	}
+
+	logger << "Renderer: " << (const char*)glGetString(GL_RENDERER);
+
+	size = newSize;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glEnableVertexAttribArray(0);
+
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	glViewport(0, 0, size, size);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	return true;
+}
+
+void OffscreenContext::Close() {
+	if(vao) {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(2, renderbuffers);
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+
+	// The statics' buffers go with the context, so the next one starts over
+	VoxelChunk::meshArena = MeshArena{};
+	VoxelChunk::instanceArena = MeshArena{2};
+	VoxelChunk::elementBO = 0;
+	VoxelChunk::elementBufferSize = 0;
+
+	if(context) SDL_GL_DeleteContext(context);
+	if(window) SDL_DestroyWindow(window);
+	context = nullptr;
+	window = nullptr;
+	SDL_Quit();
+}
+
+std::vector<u8> OffscreenContext::ReadPixels() const {
+	std::vector<u8> pixels(size*size*4);
+	glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+void OffscreenContext::LoadProgram(ShaderProgram& program, const char* vertexShader) {
+	Shader vsh{vertexShader};
+	Shader fsh{"shaders/voxel.fs"};
+	vsh.Compile();
+	fsh.Compile();
+	program.Attach(vsh);
+	program.Attach(fsh);
+	program.Link();
+}
+
+static void BenchIndirect() {
+	OffscreenContext gl;
+	if(!gl.Open(4, 3, 256)) return;
+
+	if(!IndirectDrawer::IsSupported()) {
+		logger << "Skipped, needs GL 4.3";
+		gl.Close();
+		return;
+	}
+
+	u32 numFailed = 0;
+
+	{	ShaderProgram chunkProgram, indirectProgram;
+		OffscreenContext::LoadProgram(chunkProgram, "shaders/voxel.vs");
+		OffscreenContext::LoadProgram(indirectProgram, "shaders/voxel_indirect.vs");
+
+		IndirectDrawer indirectDrawer;
+
+		for(u32 side : {32u, 100u}) {
+			// Few quads per chunk, so it's the per chunk cost being measured
+			VoxelWorld world{16,16,16};
+			world.lodDistance = 0.f;
+			world.SetMeshMethod(MeshMethod::BinaryGreedy);
+
+			for(s32 cx = 0; cx < (s32)side; cx++)
+			for(s32 cy = 0; cy < (s32)side; cy++) {
+				auto chunk = world.GetOrCreateChunk({cx, cy, 0});
+				u8 shade = 100 + ((cx*7 + cy*3) % 8)*16;
+				chunk->FillBox(4,4,0, 12,12, 1 + (cx+cy)%15, 1, stbvox_rgb{shade, 200, 100});
+			}
+
+			// Looking straight down on all of it
+			f32 extent = side*16.f;
+			mat4 projection = glm::ortho(-extent/2.f, extent/2.f, -extent/2.f, extent/2.f, 1.f, 100.f);
+			vec3 centre {extent/2.f, 0.f, -extent/2.f};
+			mat4 view = glm::lookAt(centre + vec3{0.f, 50.f, 0.f}, centre, vec3{0.f, 0.f, -1.f});
+			mat4 viewProjection = projection * view;
+
+			auto frame = [&](bool indirect) {
+				auto& program = indirect? indirectProgram : chunkProgram;
+				world.indirectDrawer = indirect? &indirectDrawer : nullptr;
+
+				glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+				setup_uniforms(program);
+				glUniformMatrix4fv(program.GetUniform("view_projection"), 1, false, glm::value_ptr(viewProjection));
+				world.Render(program, viewProjection, vec3{centre.x, 50.f, centre.z});
+			};
+
+			// Meshes everything
+			frame(false);
+
+			std::vector<u8> pixels[2];
+			for(bool indirect : {false, true}) {
+				frame(indirect);
+				pixels[indirect] = gl.ReadPixels();
+			}
+
+			u32 numDrawn = world.numChunksDrawn;
+			if(pixels[0] != pixels[1] || numDrawn != side*side || glGetError() != GL_NO_ERROR) numFailed++;
+
+			std::vector<VoxelChunk*> drawn;
+			world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) { drawn.push_back(chunk); });
+
+			// Just the draw calls, without the culling Render does first
+			auto submit = [&](bool indirect) {
+				if(!indirect) {
+					for(auto chunk: drawn) chunk->Render(chunkProgram);
+					return;
+				}
+
+				indirectDrawer.Begin();
+				for(auto chunk: drawn) indirectDrawer.Add(*chunk);
+				indirectDrawer.Draw(indirectProgram);
+			};
+
+			// CPU time is until the calls return, the frame waits for the GPU too. 
+			//	On llvmpipe vertex processing happens inside the draw calls, so 
+			//	it counts as CPU time whichever way they're made
+			const u32 numFrames = 20;
+			for(bool indirect : {false, true}) {
+				f64 cpuMs = 0.0, submitMs = 0.0;
+				auto begin = high_resolution_clock::now();
+
+				for(u32 f = 0; f < numFrames; f++) {
+					auto start = high_resolution_clock::now();
+					frame(indirect);
+					cpuMs += duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - start).count();
+					glFinish();
+				}
+
+				f64 frameMs = duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - begin).count();
+
+				for(u32 f = 0; f < numFrames; f++) {
+					auto start = high_resolution_clock::now();
+					submit(indirect);
+					submitMs += duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - start).count();
+					glFinish();
+				}
+
+				logger << numDrawn << " chunks, " << (indirect? "indirect" : "chunk by chunk") << ": " 
+					<< (cpuMs/numFrames) << "ms CPU of which " << (submitMs/numFrames) << "ms drawing, " 
+					<< (frameMs/numFrames) << "ms per frame";
+			}
+		}
+	}
+
+	logger << "Same image both ways, no GL errors: " << (numFailed? "FAILED" : "ok");
+	gl.Close();
+}
+
+static void BenchTransparent() {
+	u32 numFailed = 0;
+
+	// The sort itself, against the standard library on the same keys
+	for(u32 count: {1000u, 100000u, 1000000u}) {
+		std::vector<SortKey> keys(count), sorted, scratch;
+		srand(count);
+		for(u32 i = 0; i < count; i++)
+			keys[i] = SortKey{~FloatKey(rand() / (f32)RAND_MAX * 1000.f), i};
+
+		u32 iterations = std::max(1000000u / count, 5u);
+		f64 radixMs = TimeMs(iterations, [&]{ sorted = keys; RadixSort(sorted, scratch); });
+
+		auto expected = keys;
+		f64 stdMs = TimeMs(iterations, [&]{ 
+			expected = keys;
+			std::stable_sort(expected.begin(), expected.end(), 
+				[](const SortKey& a, const SortKey& b) { return a.key < b.key; });
+		});
+
+		for(u32 i = 0; i < count; i++)
+			if(sorted[i].index != expected[i].index) { numFailed++; break; }
+
+		logger << count << " keys: radix sort " << radixMs << "ms, std::stable_sort " << stdMs << "ms";
+	}
+
+	// A glass box in air only keeps its outside faces, in every mesh method,
+	//	and none of them end up in the opaque mesh
+	for(auto method: {MeshMethod::Stbvox, MeshMethod::Greedy, MeshMethod::BinaryGreedy}) {
+		VoxelChunk chunk{16,16,16};
+		chunk.meshMethod = method;
+		chunk.FillBox(4,4,4, 8,8,8, 9, stbvox_rgb{160,220,255});
+		chunk.BuildMesh();
+
+		bool ok = chunk.numBuiltQuads == 0 && chunk.builtTransparentFaces.size() == 6*4*4;
+
+		// Against a stone floor, the floor's top faces stay under the glass
+		chunk.FillBox(0,0,0, 16,16,4, 1, stbvox_rgb{100,100,100});
+		chunk.Invalidate();
+		chunk.BuildMesh();
+		ok = ok && chunk.builtTransparentFaces.size() == 6*4*4;
+		if(!ok) numFailed++;
+
+		logger << MethodName(method) << ": " << chunk.numBuiltQuads << " opaque, " 
+			<< chunk.builtTransparentFaces.size() << " transparent quads";
+	}
+
+	// Scattered glass and water over test terrain, sorted as the camera 
+	//	walks across it. Meshes are handed over as UploadMesh would, 
+	//	without touching GL
+	VoxelChunk chunk{32,32,24};
+	srand(2);
+	GenerateTestTerrain(chunk);
+	for(u32 i = 0; i < 3000; i++)
+		chunk.SetBlock(rand()%32, rand()%32, rand()%24, 9 + rand()%2);
+
+	chunk.meshMethod = MeshMethod::BinaryGreedy;
+	chunk.BuildMesh();
+	chunk.transparentVertices = chunk.builtTransparentVertices;
+	chunk.transparentFaces = chunk.builtTransparentFaces;
+	chunk.numTransparentQuads = chunk.transparentFaces.size();
+
+	auto backToFront = [&] {
+		vec3 center = vec3{(f32)chunk.sortCell[0], (f32)chunk.sortCell[1], (f32)chunk.sortCell[2]} + 0.5f;
+		f32 last = 1e30f;
+
+		for(u32 q: chunk.transparentOrder) {
+			vec3 quadCenter {0.f};
+			for(u32 v = 0; v < 4; v++) {
+				u32 vert = chunk.transparentVertices[q*4+v];
+				quadCenter += vec3{(f32)(vert & 127u), (f32)((vert>>7) & 127u), ((vert>>14) & 511u) * 0.5f} * 0.25f;
+			}
+
+			f32 dist = glm::length(quadCenter - center);
+			if(dist > last + 1e-4f) return false;
+			last = dist;
+		}
+
+		return chunk.transparentOrder.size() == chunk.numTransparentQuads;
+	};
+
+	u32 numSteps = 2000, numSorts = 0, numCrossings = 0;
+	s32 lastCell[3] {0,0,0};
+	f64 sortMs = 0.0;
+
+	for(u32 i = 0; i < numSteps; i++) {
+		// In mesh space, then into world space for SortTransparent
+		f32 t = i / (f32)numSteps;
+		vec3 eye {2.f + 30.f*t, 16.f + 10.f*std::sin(t*6.f), 20.f};
+		vec3 cameraPos = vec3(VoxelChunk::coordinateCorrection * vec4{eye, 1.f});
+
+		// Back again the same way, so cell boundaries round the same
+		eye = vec3(glm::inverse(VoxelChunk::coordinateCorrection) * vec4{cameraPos, 1.f});
+		s32 cell[3] {(s32)std::floor(eye.x), (s32)std::floor(eye.y), (s32)std::floor(eye.z)};
+		if(!i || memcmp(cell, lastCell, sizeof(cell))) numCrossings++;
+		memcpy(lastCell, cell, sizeof(cell));
+
+		auto start = high_resolution_clock::now();
+		bool sorted = chunk.SortTransparent(cameraPos);
+		sortMs += duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - start).count();
+
+		if(sorted) {
+			numSorts++;
+			if(!backToFront()) numFailed++;
+		}
+	}
+
+	if(numSorts != numCrossings) numFailed++;
+
+	logger << chunk.numTransparentQuads << " transparent quads, " << numSorts << " sorts over " 
+		<< numSteps << " camera steps, " << (sortMs/std::max(numSorts, 1u)) << "ms per sort";
+	logger << "Sorted back to front, only on cell changes: " << (numFailed? "FAILED" : "ok");
+}
+
+static void BenchInstancing() {
+	u32 numFailed = 0;
+
+	// Corners put back the way voxel_instanced.vs does, which has to be 
+	//	exactly where the greedy meshers put them
+	static const u8 faceCorners[6][4] {
+		{5, 7, 3, 1}, {7, 6, 2, 3}, {6, 4, 0, 2}, {4, 5, 1, 0}, {6, 7, 5, 4}, {0, 1, 3, 2},
+	};
+
+	for(u32 seed: {1u, 2u, 3u}) {
+		VoxelChunk chunk{64,64,64};
+		GenerateRandomTerrain(chunk, seed, 0.3f*seed);
+		chunk.meshMethod = MeshMethod::BinaryGreedy;
+		chunk.BuildMesh();
+
+		std::vector<u32> instances(chunk.numBuiltQuads*2);
+		EncodeInstances(chunk.vertexData, chunk.faceData, chunk.numBuiltQuads, instances.data());
+
+		for(u32 q = 0; q < chunk.numBuiltQuads; q++) {
+			u32 a = instances[q*2], b = instances[q*2+1];
+			u32 origin[3] {a & 127u, (a>>7) & 127u, (a>>14) & 511u};
+			u32 extent[3] {b & 255u, (b>>8) & 255u, (b>>16) & 255u};
+
+			for(u32 v = 0; v < 4; v++) {
+				u32 corner = faceCorners[a>>29][v];
+				u32 p[3];
+				for(u32 i = 0; i < 3; i++) p[i] = origin[i] + ((corner>>i) & 1)*extent[i];
+
+				// Everything but texlerp, which voxel.vs doesn't use
+				u32 expected = chunk.vertexData[q*4+v] & ((1u<<29)-1);
+				u32 vertex = p[0] | (p[1]<<7) | ((p[2]*2)<<14) | (((a>>23) & 63)<<23);
+				if(vertex != expected) { numFailed++; break; }
+			}
+		}
+	}
+
+	logger << "Instances match the greedy quads: " << (numFailed? "FAILED" : "ok");
+
+	OffscreenContext gl;
+	if(!gl.Open(3, 3, 256)) return;
+
+	if(!VoxelChunk::SupportsInstancing()) {
+		logger << "Skipped, needs GL 3.3";
+		gl.Close();
+		return;
+	}
+
+	{	ShaderProgram vertexProgram, instanceProgram;
+		OffscreenContext::LoadProgram(vertexProgram, "shaders/voxel.vs");
+		OffscreenContext::LoadProgram(instanceProgram, "shaders/voxel_instanced.vs");
+
+		VoxelWorld world{32,32,24};
+		world.lodDistance = 0.f;
+		world.SetMeshMethod(MeshMethod::BinaryGreedy);
+		TerrainGenerator{1234}.Generate(world, ChunkCoord{-2,-2,0}, ChunkCoord{1,1,1});
+
+		std::vector<VoxelChunk*> chunks;
+		world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) { chunks.push_back(chunk); });
+
+		// Looking straight down on all of it
+		mat4 projection = glm::ortho(-64.f, 64.f, -64.f, 64.f, 1.f, 200.f);
+		mat4 view = glm::lookAt(vec3{0.f, 100.f, 0.f}, vec3{0.f}, vec3{0.f, 0.f, -1.f});
+		mat4 viewProjection = projection * view;
+
+		auto frame = [&](bool instances) {
+			world.instanceProgram = instances? &instanceProgram : nullptr;
+			glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+			for(auto program: {&instanceProgram, &vertexProgram}) {
+				setup_uniforms(*program);
+				glUniformMatrix4fv(program->GetUniform("view_projection"), 1, false, glm::value_ptr(viewProjection));
+			}
+
+			world.Render(vertexProgram, viewProjection, vec3{0.f, 100.f, 0.f});
+		};
+
+		std::vector<u8> pixels[2];
+		for(bool instances : {false, true}) {
+			// The first frame remeshes into the new format
+			frame(instances);
+			frame(instances);
+			pixels[instances] = gl.ReadPixels();
+
+			u32 numQuads = 0, numAllocated = 0, numInstanced = 0;
+			for(auto chunk: chunks) {
+				numQuads += chunk->numQuads;
+				numAllocated += chunk->meshAllocation.size;
+				numInstanced += chunk->instanced;
+			}
+
+			if(numInstanced != (instances? chunks.size() : 0)) numFailed++;
+
+			// Vertex words and a face per quad, with the slabs' headroom. The
+			//	element buffer is shared by every chunk drawn with vertices
+			u32 quadSize = (instances? VoxelChunk::instanceArena : VoxelChunk::meshArena).wordsPerQuad*4 + 4;
+			u32 elementBytes = instances? 0 : VoxelChunk::elementBufferSize*6*sizeof(u32);
+
+			// Uploads only, every chunk already built
+			for(auto chunk: chunks) {
+				chunk->Invalidate();
+				chunk->BuildMesh();
+			}
+
+			glFinish();
+			auto start = high_resolution_clock::now();
+			for(auto chunk: chunks) chunk->UploadMesh();
+			glFinish();
+			f64 uploadMs = duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - start).count();
+
+			const u32 numFrames = 20;
+			f64 frameMs = TimeMs(numFrames, [&]{ frame(instances); glFinish(); });
+
+			logger << chunks.size() << " chunks, " << numQuads << " quads as " << (instances? "instances" : "vertices") << ":";
+			logger << "\t" << (numAllocated*quadSize >> 10) << "KB of meshes, " 
+				<< (numAllocated*quadSize / chunks.size()) << " bytes per chunk, " 
+				<< (elementBytes >> 10) << "KB of element buffer";
+			logger << "\t" << (numQuads*quadSize >> 10) << "KB uploaded in " << uploadMs << "ms, " 
+				<< frameMs << "ms per frame";
+		}
+
+		if(pixels[0] != pixels[1] || glGetError() != GL_NO_ERROR) numFailed++;
+		world.instanceProgram = nullptr;
+	}
+
+	logger << "Same image both ways, no GL errors: " << (numFailed? "FAILED" : "ok");
+	gl.Close();
+}
+
+static void BenchUploads() {
+	OffscreenContext gl;
+	if(!gl.Open(3, 3, 256)) return;
+
+	u32 numFailed = 0;
+
+	{	ShaderProgram program;
+		OffscreenContext::LoadProgram(program, "shaders/voxel.vs");
+
+		// Meshed synchronously, so every chunk is queued in the same frame
+		//	and the order they're uploaded in only depends on the scheduler
+		VoxelWorld world{32,32,24};
+		world.lodDistance = 0.f;
+		TerrainGenerator{1234}.Generate(world, ChunkCoord{-3,-3,0}, ChunkCoord{2,2,1});
+
+		std::vector<VoxelChunk*> chunks;
+		world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) { chunks.push_back(chunk); });
+
+		// Above the middle looking along x, so half of it is behind the camera
+		vec3 cameraPos {0.f, 60.f, 0.f};
+		mat4 projection = glm::perspective((f32)PI/3.f, 1.f, 0.1f, 500.f);
+		mat4 view = glm::lookAt(cameraPos, vec3{80.f, 0.f, 0.f}, vec3{0.f, 1.f, 0.f});
+		mat4 viewProjection = projection * view;
+		auto frustum = Frustum::FromMatrix(viewProjection);
+
+		auto frame = [&] {
+			glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+			setup_uniforms(program);
+			glUniformMatrix4fv(program.GetUniform("view_projection"), 1, false, glm::value_ptr(viewProjection));
+			world.Render(program, viewProjection, cameraPos);
+		};
+
+		frame();
+		u32 numDrawn = world.numChunksDrawn;
+
+		// Everything at once, as happens without the scheduler
+		u32 totalBytes = 0;
+		for(auto chunk: chunks) {
+			chunk->Invalidate();
+			chunk->BuildMesh();
+			totalBytes += UploadScheduler::UploadSize(chunk);
+		}
+
+		glFinish();
+		auto start = high_resolution_clock::now();
+		for(auto chunk: chunks) chunk->UploadMesh();
+		glFinish();
+		f64 allMs = duration_cast<duration<f64, std::milli>>(high_resolution_clock::now() - start).count();
+
+		logger << chunks.size() << " chunks, " << numDrawn << " drawn, all at once: " 
+			<< (totalBytes >> 10) << "KB uploaded in " << allMs << "ms";
+
+		world.SetMeshMethod(MeshMethod::Greedy);
+		frame();
+		auto expected = gl.ReadPixels();
+
+		for(u32 budget : {256u<<10, 64u<<10}) {
+			world.SetMeshMethod(MeshMethod::Stbvox);
+			frame();
+
+			// Byte budget only, so what's uploaded when doesn't depend on timing
+			UploadScheduler uploads {budget, 0.f};
+			world.uploadScheduler = &uploads;
+			world.SetMeshMethod(MeshMethod::Greedy);
+
+			u32 numFrames = 0, numUploaded = 0, maxQueued = 0, maxBytes = 0;
+			u32 numOversized = 0; // Frames over budget from one chunk bigger than it
+			f32 maxMs = 0.f;
+			bool invisibleUploaded = false;
+
+			do {
+				std::vector<VoxelChunk*> waiting;
+				for(auto chunk: chunks)
+					if(chunk->meshing) waiting.push_back(chunk);
+
+				frame();
+				glFinish();
+				numFrames++;
+
+				bool invisibleThisFrame = false;
+				for(auto chunk: waiting) {
+					if(chunk->meshing) continue;
+
+					// Everything in view goes before anything out of it
+					bool visible = frustum.Intersects(chunk->ChunkBounds());
+					if(visible && invisibleUploaded) numFailed++;
+					invisibleThisFrame |= !visible;
+					numUploaded++;
+				}
+
+				invisibleUploaded |= invisibleThisFrame;
+				// Over is only allowed for a chunk that doesn't fit on its own,
+				//	and then nothing else may go in the same frame
+				if(uploads.bytesUploaded > budget) {
+					if(uploads.numUploaded == 1) numOversized++;
+					else numFailed++;
+				}
+
+				// Queued chunks keep drawing what they had
+				if(world.numChunksDrawn != numDrawn) numFailed++;
+
+				maxQueued = std::max<u32>(maxQueued, uploads.queue.size());
+				maxBytes = std::max(maxBytes, uploads.bytesUploaded);
+				maxMs = std::max(maxMs, uploads.uploadMs);
+			} while(!uploads.queue.empty() && numFrames < 1000);
+
+			if(numUploaded != chunks.size()) numFailed++;
+			if(gl.ReadPixels() != expected) numFailed++;
+			world.uploadScheduler = nullptr;
+
+			logger << "\t" << (budget >> 10) << "KB budget: " << numFrames << " frames, up to " << maxQueued 
+				<< " queued, at most " << (maxBytes >> 10) << "KB and " << maxMs << "ms a frame";
+			logger << "\t\t" << numOversized << " frames over budget with a single chunk bigger than it";
+		}
+
+		if(glGetError() != GL_NO_ERROR) numFailed++;
+	}
+
+	logger << "Budgets kept but for lone oversized chunks, nearest visible first, stale meshes drawn: " 
+		<< (numFailed? "FAILED" : "ok");
+	gl.Close();
+}
+
+static void BenchStaging() {
+	OffscreenContext gl;
+	if(!gl.Open(3, 3, 256)) return;
+
+	u32 numFailed = 0;
+	bool persistentSupported = StagingRing::SupportsPersistentMapping();
+	logger << "Persistent mapping " << (persistentSupported? "supported" : "not supported, needs GL 4.4 or ARB_buffer_storage");
+
+	{	ShaderProgram program;
+		OffscreenContext::LoadProgram(program, "shaders/voxel.vs");
+
+		VoxelWorld world{32,32,24};
+		world.lodDistance = 0.f;
+		TerrainGenerator{1234}.Generate(world, ChunkCoord{-2,-2,0}, ChunkCoord{1,1,1});
+
+		std::vector<VoxelChunk*> chunks;
+		world.chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) { chunks.push_back(chunk); });
+
+		mat4 projection = glm::ortho(-64.f, 64.f, -64.f, 64.f, 1.f, 200.f);
+		mat4 view = glm::lookAt(vec3{0.f, 100.f, 0.f}, vec3{0.f}, vec3{0.f, 0.f, -1.f});
+		mat4 viewProjection = projection * view;
+
+		auto frame = [&] {
+			glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+			setup_uniforms(program);
+			glUniformMatrix4fv(program.GetUniform("view_projection"), 1, false, glm::value_ptr(viewProjection));
+			world.Render(program, viewProjection, vec3{0.f, 100.f, 0.f});
+		};
+
+		// Switching mesh method changes every upload, so a ring handing out
+		//	space the GPU is still copying from would show up in the images
+		const MeshMethod methods[] {MeshMethod::Greedy, MeshMethod::Stbvox, MeshMethod::BinaryGreedy};
+		const u32 numRounds = 4;
+		std::vector<u8> expected[3];
+
+		struct Mode {
+			const char* name;
+			u32 ringSize; // 0 for glBufferSubData
+			bool persistent;
+		};
+
+		const Mode modes[] {
+			{"glBufferSubData", 0, false},
+			{"persistent ring", 8u<<20, true},
+			{"mapped ring", 8u<<20, false},
+			{"persistent 256KB ring", 256u<<10, true},
+			{"mapped 256KB ring", 256u<<10, false},
+		};
+
+		for(auto& mode: modes) {
+			if(mode.persistent && !persistentSupported) continue;
+
+			StagingRing ring {mode.ringSize, mode.persistent};
+			VoxelChunk::meshArena.staging = mode.ringSize? &ring : nullptr;
+
+			f64 uploadMs = 0.0;
+			u64 numBytes = 0;
+
+			for(u32 round = 0; round < numRounds; round++)
+			for(u32 m = 0; m < 3; m++) {
+				world.SetMeshMethod(methods[m]);
+				for(auto chunk: chunks) {
+					chunk->BuildMesh();
+					numBytes += UploadScheduler::UploadSize(chunk);
+				}
+
+				// Not waiting on the GPU, that's what the ring is meant to avoid
+				uploadMs += TimeMs(1, [&]{ for(auto chunk: chunks) chunk->UploadMesh(); });
+				ring.EndFrame();
+
+				frame();
+				auto pixels = gl.ReadPixels();
+				if(!mode.ringSize) expected[m] = pixels;
+				else if(pixels != expected[m]) numFailed++;
+			}
+
+			VoxelChunk::meshArena.staging = nullptr;
+			logger << mode.name << ": " << (numBytes >> 10) << "KB in " << uploadMs << "ms, " 
+				<< ring.numWaits << " waits, " << ring.numDirect << " too big for the ring";
+		}
+
+		if(glGetError() != GL_NO_ERROR) numFailed++;
+	}
+
+	logger << "Same images through the ring, no GL errors: " << (numFailed? "FAILED" : "ok");
+	gl.Close();
+}
+
+static const struct {
+	const char* name;
+	void (*func)();
+} benchmarks[] {
+	{"meshing", BenchMeshing},
+	{"buildmemory", BenchBuildMemory},
+	{"palette", BenchPalette},
+	{"remesh", BenchRemesh},
+	{"bulkedit", BenchBulkEdit},
+	{"arena", BenchArena},
+	{"culling", BenchCulling},
+	{"occlusion", BenchOcclusion},
+	{"lod", BenchLod},
+	{"raycast", BenchRaycast},
+	{"borders", BenchBorders},
+	{"lighting", BenchLighting},
+	{"terrain", BenchTerrain},
+	{"regions", BenchRegions},
+	{"meshcache", BenchMeshCache},
+	{"snapshots", BenchSnapshots},
+	{"layout", BenchLayout},
+	{"occupancy", BenchOccupancy},
+	{"indirect", BenchIndirect},
+	{"transparent", BenchTransparent},
+	{"instancing", BenchInstancing},
+	{"uploads", BenchUploads},
+	{"staging", BenchStaging},
+};
+
+s32 RunBenchmarks(s32 argc, char** argv) {
+	u32 numRun = 0;
+
+	for(auto& bench: benchmarks) {
+		bool selected = (argc == 0);
+		for(s32 i = 0; i < argc; i++)
+			selected |= !strcmp(argv[i], bench.name);
+
+		if(!selected) continue;
+
+		logger << "-- " << bench.name << " --";
+		bench.func();
+		numRun++;
+	}
+
+	if(!numRun) {
+		logger << "No matching benchmarks";
+		return 1;
+	}
+
+	return 0;
+}
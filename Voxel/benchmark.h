@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "common.h"
+
+// Headless benchmarks, run with './build bench [name...]'. 'indirect', 
+//	'instancing', 'uploads' and 'staging' open a hidden window, since they need a GL context
+// Runs everything if no names are given
+s32 RunBenchmarks(s32 argc, char** argv);
+
+#endif
@@ -0,0 +1,79 @@
+#include "bricklayout.h"
+
+constexpr u32 BrickLayout::brickShift;
+constexpr u32 BrickLayout::brickSize;
+
+u32 BrickLayout::SpreadBits(u32 v) {
+	u32 r = 0;
+	for(u32 b = 0; v >> b; b++)
+		r |= ((v >> b) & 1u) << (b*3);
+
+	return r;
+}
+
+BrickLayout::BrickLayout(u32 w, u32 h, u32 d)
+	: width{w}, height{h}, depth{d} {
+	const u32 brickVoxels = brickSize*brickSize*brickSize;
+	const u32 mask = brickSize-1;
+
+	bricksX = (width + mask) >> brickShift;
+	bricksY = (height + mask) >> brickShift;
+	bricksZ = (depth + mask) >> brickShift;
+
+	// Start of the brick plus position within it
+	auto offsets = [&](std::vector<u32>& table, u32 dim, u32 brickStride, u32 axis) {
+		table.resize(dim);
+		for(u32 i = 0; i < dim; i++)
+			table[i] = (i >> brickShift)*brickStride*brickVoxels + (SpreadBits(i & mask) << axis);
+	};
+
+	offsets(xOffsets, width, bricksY*bricksZ, 2);
+	offsets(yOffsets, height, bricksZ, 1);
+	offsets(zOffsets, depth, 1, 0);
+
+	size = bricksX*bricksY*bricksZ*brickVoxels;
+	blocks = new u8[size];
+	colors = new stbvox_rgb[size];
+	memset(blocks, 0, size);
+	memset(colors, 255, size*sizeof(stbvox_rgb));
+}
+
+BrickLayout::~BrickLayout() {
+	delete[] blocks;
+	delete[] colors;
+}
+
+void BrickLayout::Pack(const u8* paddedBlocks, const stbvox_rgb* paddedColors) {
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	for(u32 x = 0; x < width; x++)
+	for(u32 y = 0; y < height; y++) {
+		u32 src = 1 + (y+1)*yStride + (x+1)*xStride;
+		u32 base = xOffsets[x] + yOffsets[y];
+
+		for(u32 z = 0; z < depth; z++) {
+			blocks[base + zOffsets[z]] = paddedBlocks[src+z];
+			colors[base + zOffsets[z]] = paddedColors[src+z];
+		}
+	}
+}
+
+void BrickLayout::Unpack(u8* paddedBlocks, stbvox_rgb* paddedColors) const {
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	memset(paddedBlocks, 0, (width+2)*xStride);
+	memset(paddedColors, 255, (width+2)*xStride*sizeof(stbvox_rgb));
+
+	for(u32 x = 0; x < width; x++)
+	for(u32 y = 0; y < height; y++) {
+		u32 dst = 1 + (y+1)*yStride + (x+1)*xStride;
+		u32 base = xOffsets[x] + yOffsets[y];
+
+		for(u32 z = 0; z < depth; z++) {
+			paddedBlocks[dst+z] = blocks[base + zOffsets[z]];
+			paddedColors[dst+z] = colors[base + zOffsets[z]];
+		}
+	}
+}
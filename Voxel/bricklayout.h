@@ -0,0 +1,49 @@
+#ifndef BRICKLAYOUT_H
+#define BRICKLAYOUT_H
+
+#include "common.h"
+#include "stb_voxel_render.h"
+
+// Chunk voxels stored as 4x4x4 bricks of 64 bytes, with the voxels in
+//	each brick in Morton order, so neighbours along every axis are 
+//	usually within the same cache line or the next brick rather than a 
+//	whole x or y slice apart as in the padded blockData layout.
+// Bricks are laid out like the padded layout, z fastest, and both parts
+//	are separable so Index is three table lookups added together.
+//	Dimensions are rounded up to whole bricks
+// stbvox and the greedy mesher only take the padded layout, so Unpack
+//	converts for them
+struct BrickLayout {
+	static constexpr u32 brickShift = 2;
+	static constexpr u32 brickSize = 1u << brickShift;
+
+	u32 width, height, depth;
+	u32 bricksX, bricksY, bricksZ;
+	u32 size; // Voxels allocated, including the rounding
+
+	std::vector<u32> xOffsets, yOffsets, zOffsets;
+	u8* blocks;
+	stbvox_rgb* colors;
+
+	BrickLayout(u32 width, u32 height, u32 depth);
+	~BrickLayout();
+
+	BrickLayout(const BrickLayout&) = delete;
+	BrickLayout& operator=(const BrickLayout&) = delete;
+
+	u32 Index(u32 x, u32 y, u32 z) const { return xOffsets[x] + yOffsets[y] + zOffsets[z]; }
+
+	u8 GetBlock(u32 x, u32 y, u32 z) const { return blocks[Index(x,y,z)]; }
+	void SetBlock(u32 x, u32 y, u32 z, u8 block) { blocks[Index(x,y,z)] = block; }
+	stbvox_rgb GetColor(u32 x, u32 y, u32 z) const { return colors[Index(x,y,z)]; }
+	void SetColor(u32 x, u32 y, u32 z, stbvox_rgb color) { colors[Index(x,y,z)] = color; }
+
+	// To and from the padded blockData/colorData layout. Unpack zeroes the padding
+	void Pack(const u8* paddedBlocks, const stbvox_rgb* paddedColors);
+	void Unpack(u8* paddedBlocks, stbvox_rgb* paddedColors) const;
+
+	// Spreads the bits of v out to every third bit
+	static u32 SpreadBits(u32 v);
+};
+
+#endif
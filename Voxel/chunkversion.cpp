@@ -0,0 +1,80 @@
+#include "chunkversion.h"
+
+ChunkVersion::ChunkVersion(u32 w, u32 h, u32 d) 
+	: width{w}, height{h}, depth{d} {
+	const u32 n = VoxelBrick::brickSize;
+	bricksX = (width + n-1)/n;
+	bricksY = (height + n-1)/n;
+	bricksZ = (depth + n-1)/n;
+	bricks.resize(NumBricks());
+}
+
+std::shared_ptr<const VoxelBrick> ChunkVersion::EmptyBrick() {
+	static std::shared_ptr<const VoxelBrick> empty = [] {
+		auto brick = std::make_shared<VoxelBrick>();
+		memset(brick->blocks, 0, sizeof(brick->blocks));
+		memset(brick->colors, 255, sizeof(brick->colors));
+		return brick;
+	}();
+
+	return empty;
+}
+
+u8 ChunkVersion::GetBlock(u32 x, u32 y, u32 z) const {
+	if(x >= width || y >= height || z >= depth) return 0;
+
+	const u32 n = VoxelBrick::brickSize;
+	auto& brick = bricks[BrickIndex(x/n, y/n, z/n)];
+	return brick->blocks[z%n + (y%n)*n + (x%n)*n*n];
+}
+
+void ChunkVersion::Unpack(u8* blocks, stbvox_rgb* colors) const {
+	const u32 n = VoxelBrick::brickSize;
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	memset(blocks, 0, (width+2)*xStride);
+	memset(colors, 255, (width+2)*xStride*sizeof(stbvox_rgb));
+
+	// A brick's z rows are contiguous on both sides, clipped at the chunk edge
+	for(u32 bx = 0; bx < bricksX; bx++)
+	for(u32 by = 0; by < bricksY; by++)
+	for(u32 bz = 0; bz < bricksZ; bz++) {
+		auto& brick = bricks[BrickIndex(bx, by, bz)];
+		u32 rowLength = std::min(n, depth - bz*n);
+
+		for(u32 x = 0; x < n && bx*n + x < width; x++)
+		for(u32 y = 0; y < n && by*n + y < height; y++) {
+			u32 src = (y + x*n)*n;
+			u32 dst = 1 + bz*n + (by*n + y + 1)*yStride + (bx*n + x + 1)*xStride;
+			memcpy(&blocks[dst], &brick->blocks[src], rowLength);
+			memcpy(&colors[dst], &brick->colors[src], rowLength*sizeof(stbvox_rgb));
+		}
+	}
+}
+
+void ChunkVersion::CopyBorders(u8* blocks, const std::shared_ptr<const ChunkVersion>* neighbours) const {
+	const u32 dims[3] {width, height, depth};
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	for(u32 face = 0; face < 6; face++) {
+		auto& n = neighbours[face];
+
+		// Padded coordinate of the border on the face axis, and the 
+		//	neighbour's boundary layer that it mirrors
+		u32 a = face/2;
+		u32 u = (a+1)%3, v = (a+2)%3;
+		u32 dst = (face & 1)? dims[a]+1 : 0;
+		u32 src = (face & 1)? 0 : dims[a]-1;
+
+		for(u32 i = 0; i < dims[u]; i++)
+		for(u32 j = 0; j < dims[v]; j++) {
+			u32 p[3], q[3];
+			p[a] = dst; p[u] = i+1; p[v] = j+1;
+			q[a] = src; q[u] = i; q[v] = j;
+
+			blocks[p[2] + p[1]*yStride + p[0]*xStride] = n? n->GetBlock(q[0], q[1], q[2]) : 0;
+		}
+	}
+}
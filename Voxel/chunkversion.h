@@ -0,0 +1,46 @@
+#ifndef CHUNKVERSION_H
+#define CHUNKVERSION_H
+
+#include "common.h"
+#include "occupancy.h"
+#include "stb_voxel_render.h"
+
+// brickSize^3 voxels of a chunk, in x, y, z order with z changing fastest
+struct VoxelBrick {
+	static constexpr u32 brickSize = 8;
+	static constexpr u32 numVoxels = brickSize*brickSize*brickSize;
+
+	u8 blocks[numVoxels];
+	stbvox_rgb colors[numVoxels];
+};
+
+// An immutable copy of a chunk's voxels, made by VoxelChunk::Snapshot. 
+//	Bricks nothing has touched since the previous version are shared with
+//	it, so a snapshot after an edit only copies the bricks the edit touched.
+// Versions are only ever read once made, so any number of threads can hold
+//	one while the chunk goes on being edited
+struct ChunkVersion {
+	u32 width, height, depth;
+	u32 bricksX, bricksY, bricksZ;
+	std::vector<std::shared_ptr<const VoxelBrick>> bricks;
+	Occupancy occupancy; // Copied whole, it's a bit per voxel
+
+	ChunkVersion(u32 width, u32 height, u32 depth);
+
+	u32 BrickIndex(u32 bx, u32 by, u32 bz) const { return bz + by*bricksZ + bx*bricksZ*bricksY; }
+	u32 NumBricks() const { return bricksX*bricksY*bricksZ; }
+
+	u8 GetBlock(u32 x, u32 y, u32 z) const;
+
+	// Into the padded blockData layout, with zeroed padding
+	void Unpack(u8* blocks, stbvox_rgb* colors) const;
+
+	// Like VoxelChunk::CopyBorders, from versions of the neighbours in the 
+	//	same face order. Null neighbours leave an empty border
+	void CopyBorders(u8* blocks, const std::shared_ptr<const ChunkVersion>* neighbours) const;
+
+	// Shared by every brick with nothing in it
+	static std::shared_ptr<const VoxelBrick> EmptyBrick();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "frustum.h"
+
+AABB AABB::Transformed(const mat4& m) const {
+	AABB ret;
+	if(Empty()) return ret;
+
+	for(u32 i = 0; i < 8; i++) {
+		vec3 corner {
+			(i&1)? max.x : min.x,
+			(i&2)? max.y : min.y,
+			(i&4)? max.z : min.z,
+		};
+
+		ret.Add(vec3(m * vec4{corner, 1.f}));
+	}
+
+	return ret;
+}
+
+// Gribb/Hartmann, each plane is the last row of the matrix plus or minus another
+Frustum Frustum::FromMatrix(const mat4& m) {
+	auto row = [&](u32 r) { return vec4{m[0][r], m[1][r], m[2][r], m[3][r]}; };
+
+	Frustum f;
+	f.planes[0] = row(3) + row(0);
+	f.planes[1] = row(3) - row(0);
+	f.planes[2] = row(3) + row(1);
+	f.planes[3] = row(3) - row(1);
+	f.planes[4] = row(3) + row(2);
+	f.planes[5] = row(3) - row(2);
+
+	for(auto& p: f.planes)
+		p = p / glm::length(vec3(p));
+
+	return f;
+}
+
+bool Frustum::Intersects(const AABB& b) const {
+	if(b.Empty()) return false;
+
+	for(auto& p: planes) {
+		// The corner furthest along the plane normal
+		vec3 corner {
+			p.x > 0.f? b.max.x : b.min.x,
+			p.y > 0.f? b.max.y : b.min.y,
+			p.z > 0.f? b.max.z : b.min.z,
+		};
+
+		if(glm::dot(vec3(p), corner) + p.w < 0.f)
+			return false;
+	}
+
+	return true;
+}
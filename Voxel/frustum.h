@@ -0,0 +1,29 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "common.h"
+
+// Empty when min > max, which is how it starts
+struct AABB {
+	vec3 min {1e30f};
+	vec3 max {-1e30f};
+
+	bool Empty() const { return min.x > max.x; }
+	void Add(const vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+	void Add(const AABB& b) { if(!b.Empty()) { Add(b.min); Add(b.max); } }
+
+	AABB Transformed(const mat4&) const;
+};
+
+struct Frustum {
+	// Left, right, bottom, top, near, far. xyz points inwards, normalised
+	vec4 planes[6];
+
+	// Planes are in whatever space the matrix transforms from, so
+	//	projection*view gives world space planes
+	static Frustum FromMatrix(const mat4&);
+
+	bool Intersects(const AABB&) const;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "greedymesher.h"
+#include "voxelchunk.h"
+#include "occupancy.h"
+
+// Same as stbvox_vertex_vector, ordered east, north, west, south, up, down
+static const u8 faceVertices[6][4][3] {
+	{ {1,0,1}, {1,1,1}, {1,1,0}, {1,0,0} },
+	{ {1,1,1}, {0,1,1}, {0,1,0}, {1,1,0} },
+	{ {0,1,1}, {0,0,1}, {0,0,0}, {0,1,0} },
+	{ {0,0,1}, {1,0,1}, {1,0,0}, {0,0,0} },
+	{ {0,1,1}, {1,1,1}, {1,0,1}, {0,0,1} },
+	{ {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0} },
+};
+
+static const u8 faceAxis[6] {0, 1, 0, 1, 2, 2};
+static const s8 faceDir[6] {1, 1, -1, -1, 1, -1};
+
+// The default texlerp, same as stbvox emits
+static const u32 vertexBase = 7u<<29;
+
+static u32 EncodeVertex(u32 x, u32 y, u32 z, u32 light) {
+	return vertexBase + x + (y<<7) + ((z<<1)<<14) + (light<<23);
+}
+
+// Faces are lit flat by the voxel in front of them, 6 bits like stbvox
+static u64 FaceKey(const u8* blocks, const stbvox_rgb* colors, const u8* lighting, u32 idx, s32 neighbourOffset) {
+	auto& c = colors[idx];
+	u64 light = lighting? (lighting[idx + neighbourOffset] >> 2) : 63;
+	return (light<<32) | ((u64)blocks[idx]<<24) | (c.r<<16) | (c.g<<8) | c.b;
+}
+
+// origin and extent are in padded voxel coordinates, as stbvox uses
+static void WriteQuad(u32 face, const u32 origin[3], const u32 extent[3], u64 key, u32* vertices, u32* faces) {
+	for(u32 vert = 0; vert < 4; vert++) {
+		u32 p[3];
+		for(u32 a = 0; a < 3; a++)
+			p[a] = origin[a] + faceVertices[face][vert][a]*extent[a];
+
+		vertices[vert] = EncodeVertex(p[0], p[1], p[2], key>>32);
+	}
+
+	// tex1, tex2, color, face_info == r, g, b, normal<<2
+	auto faceData = reinterpret_cast<u8*>(faces);
+	faceData[0] = (key>>16) & 0xff;
+	faceData[1] = (key>>8) & 0xff;
+	faceData[2] = key & 0xff;
+	faceData[3] = face<<2;
+}
+
+u32 GreedyMesh(const VoxelChunk& chunk, const u8* blocks, const stbvox_rgb* colors, const u8* lighting, 
+	u32 x0, u32 x1, u32* vertices, u32* faces, u32 maxQuads, bool* full) {
+	const u32 lo[3] {x0, 0, 0};
+	const u32 hi[3] {x1, chunk.height, chunk.depth};
+	const s32 strides[3] {
+		(s32)((chunk.depth+2)*(chunk.height+2)), 
+		(s32)(chunk.depth+2), 
+		1
+	};
+
+	std::vector<u64> mask;
+	u32 numQuads = 0;
+	if(full) *full = false;
+
+	for(u8 face = 0; face < 6; face++) {
+		u32 n = faceAxis[face];
+		u32 u = (n+1)%3;
+		u32 v = (n+2)%3;
+		if(u > v) std::swap(u, v);
+
+		u32 sizeU = hi[u]-lo[u];
+		u32 sizeV = hi[v]-lo[v];
+
+		s32 neighbourOffset = faceDir[face] * strides[n];
+		mask.resize(sizeU*sizeV);
+
+		for(u32 s = lo[n]; s < hi[n]; s++) {
+			// Build mask of exposed faces keyed on block type and color
+			for(u32 j = 0; j < sizeV; j++) {
+				u32 pos[3];
+				pos[n] = s; pos[u] = lo[u]; pos[v] = lo[v]+j;
+				u32 idx = chunk.Index(pos[0], pos[1], pos[2]);
+				auto row = &mask[j*sizeU];
+
+				for(u32 i = 0; i < sizeU; i++, idx += strides[u]) {
+					u8 block = blocks[idx];
+					u64 key = 0;
+
+					if(VoxelChunk::IsSolidCube(block) 
+						&& !VoxelChunk::IsSolidCube(blocks[idx + neighbourOffset]))
+						key = FaceKey(blocks, colors, lighting, idx, neighbourOffset);
+
+					row[i] = key;
+				}
+			}
+
+			// Merge runs along u then extend along v
+			for(u32 j = 0; j < sizeV; j++)
+			for(u32 i = 0; i < sizeU;) {
+				u64 key = mask[i + j*sizeU];
+				if(!key) {
+					i++;
+					continue;
+				}
+
+				u32 w = 1;
+				while(i+w < sizeU && mask[i+w + j*sizeU] == key) w++;
+
+				u32 h = 1;
+				for(; j+h < sizeV; h++) {
+					auto row = &mask[i + (j+h)*sizeU];
+					u32 k = 0;
+					while(k < w && row[k] == key) k++;
+					if(k < w) break;
+				}
+
+				if(numQuads >= maxQuads) {
+					if(full) *full = true;
+					return numQuads;
+				}
+
+				for(u32 r = 0; r < h; r++)
+					std::fill_n(&mask[i + (j+r)*sizeU], w, 0ull);
+
+				// Padded voxel coordinates, as stbvox uses
+				u32 origin[3], extent[3];
+				origin[n] = s+1; extent[n] = 1;
+				origin[u] = lo[u]+i+1; extent[u] = w;
+				origin[v] = lo[v]+j+1; extent[v] = h;
+
+				WriteQuad(face, origin, extent, key, &vertices[numQuads*4], &faces[numQuads]);
+				numQuads++;
+				i += w;
+			}
+		}
+	}
+
+	return numQuads;
+}
+
+// Solid column at x,y, which can be one outside the chunk where it comes 
+//	from the padding instead
+static void SolidColumn(const VoxelChunk& chunk, const Occupancy& occupancy, const u8* blocks, u32 x, u32 y, u64* column) {
+	if(x < chunk.width && y < chunk.height) {
+		memcpy(column, occupancy.Solid(x,y), occupancy.columnWords*sizeof(u64));
+		return;
+	}
+
+	// Index wraps ~0u around to the padding
+	auto padding = &blocks[chunk.Index(x,y,0)];
+	for(u32 w = 0; w < occupancy.columnWords; w++) column[w] = 0;
+	for(u32 z = 0; z < chunk.depth; z++)
+		column[z/64] |= (u64)VoxelChunk::IsSolidCube(padding[z]) << (z&63);
+}
+
+// Bits of the column at x,y whose face in direction face is exposed
+static void ExposedFaces(const VoxelChunk& chunk, const Occupancy& occupancy, const u8* blocks, 
+	u32 x, u32 y, u32 face, u64* exposed) {
+	const u32 words = occupancy.columnWords;
+	const u32 top = chunk.depth-1;
+	auto self = occupancy.Solid(x,y);
+	u64 cover[Occupancy::maxColumnWords];
+
+	switch(face) {
+	case 0: SolidColumn(chunk, occupancy, blocks, x+1, y, cover); break;
+	case 1: SolidColumn(chunk, occupancy, blocks, x, y+1, cover); break;
+	case 2: SolidColumn(chunk, occupancy, blocks, x-1, y, cover); break;
+	case 3: SolidColumn(chunk, occupancy, blocks, x, y-1, cover); break;
+
+	case 4: // The voxel above, carried across words
+		for(u32 w = 0; w < words; w++)
+			cover[w] = (self[w] >> 1) | (w+1 < words? self[w+1] << 63 : 0);
+		cover[top/64] |= (u64)VoxelChunk::IsSolidCube(blocks[chunk.Index(x,y,top)+1]) << (top&63);
+		break;
+
+	case 5: // And below
+		for(u32 w = 0; w < words; w++)
+			cover[w] = (self[w] << 1) | (w > 0? self[w-1] >> 63 : 0);
+		cover[0] |= (u64)VoxelChunk::IsSolidCube(blocks[chunk.Index(x,y,0)-1]);
+		break;
+	}
+
+	for(u32 w = 0; w < words; w++)
+		exposed[w] = self[w] & ~cover[w];
+}
+
+static bool TestBit(const u64* row, u32 bit) {
+	return (row[bit/64] >> (bit&63)) & 1;
+}
+
+// Merges the set bits of numRows rows of rowWords words into rectangles of
+//	the same key, first along a row then across rows, clearing them as it
+//	goes. emit gets row, bit, rows spanned, bits spanned and the key, and
+//	returns false to stop
+template<class Key, class Emit>
+static bool MergeRows(u64* rows, u32 numRows, u32 rowWords, Key&& keyAt, Emit&& emit) {
+	const u32 rowBits = rowWords*64;
+
+	for(u32 r = 0; r < numRows; r++) {
+		u64* row = &rows[r*rowWords];
+
+		for(u32 wd = 0; wd < rowWords; wd++)
+		while(row[wd]) {
+			u32 b = wd*64 + __builtin_ctzll(row[wd]);
+			u64 key = keyAt(r, b);
+
+			u32 w = 1;
+			while(b+w < rowBits && TestBit(row, b+w) && keyAt(r, b+w) == key) w++;
+
+			u32 h = 1;
+			for(; r+h < numRows; h++) {
+				u64* next = &rows[(r+h)*rowWords];
+				bool matches = true;
+
+				for(u32 nw = b/64; nw*64 < b+w && matches; nw++) {
+					u64 range = Occupancy::RangeBits(nw, b, b+w);
+					matches = (next[nw] & range) == range;
+				}
+
+				for(u32 i = 0; i < w && matches; i++)
+					matches = (keyAt(r+h, b+i) == key);
+
+				if(!matches) break;
+			}
+
+			for(u32 i = 0; i < h; i++) {
+				u64* clear = &rows[(r+i)*rowWords];
+				for(u32 nw = b/64; nw*64 < b+w; nw++)
+					clear[nw] &= ~Occupancy::RangeBits(nw, b, b+w);
+			}
+
+			if(!emit(r, b, h, w, key)) return false;
+		}
+	}
+
+	return true;
+}
+
+u32 BinaryGreedyMesh(const VoxelChunk& chunk, const Occupancy& occupancy, const u8* blocks, const stbvox_rgb* colors, 
+	const u8* lighting, u32 x0, u32 x1, u32* vertices, u32* faces, u32 maxQuads, bool* full) {
+	const u32 words = occupancy.columnWords;
+	const u32 numX = x1-x0;
+	const s32 strides[3] {
+		(s32)((chunk.depth+2)*(chunk.height+2)), 
+		(s32)(chunk.depth+2), 
+		1
+	};
+
+	std::vector<u64> rows;
+	u32 numQuads = 0;
+	if(full) *full = false;
+
+	auto write = [&](u32 face, const u32 origin[3], const u32 extent[3], u64 key) {
+		if(numQuads >= maxQuads) {
+			if(full) *full = true;
+			return false;
+		}
+
+		WriteQuad(face, origin, extent, key, &vertices[numQuads*4], &faces[numQuads]);
+		numQuads++;
+		return true;
+	};
+
+	for(u32 face = 0; face < 6; face++) {
+		s32 neighbourOffset = faceDir[face] * strides[faceAxis[face]];
+
+		if(faceAxis[face] == 0) {
+			// A slice per x, rows along y of bits along z
+			rows.resize(chunk.height*words);
+			for(u32 x = x0; x < x1; x++) {
+				for(u32 y = 0; y < chunk.height; y++)
+					ExposedFaces(chunk, occupancy, blocks, x, y, face, &rows[y*words]);
+
+				bool room = MergeRows(rows.data(), chunk.height, words,
+					[&](u32 y, u32 z) { return FaceKey(blocks, colors, lighting, chunk.Index(x,y,z), neighbourOffset); },
+					[&](u32 y, u32 z, u32 h, u32 w, u64 key) {
+						const u32 origin[3] {x+1, y+1, z+1};
+						const u32 extent[3] {1, h, w};
+						return write(face, origin, extent, key);
+					});
+
+				if(!room) return numQuads;
+			}
+
+		}else if(faceAxis[face] == 1) {
+			// A slice per y, rows along x of bits along z
+			rows.resize(numX*words);
+			for(u32 y = 0; y < chunk.height; y++) {
+				for(u32 x = x0; x < x1; x++)
+					ExposedFaces(chunk, occupancy, blocks, x, y, face, &rows[(x-x0)*words]);
+
+				bool room = MergeRows(rows.data(), numX, words,
+					[&](u32 r, u32 z) { return FaceKey(blocks, colors, lighting, chunk.Index(x0+r,y,z), neighbourOffset); },
+					[&](u32 r, u32 z, u32 h, u32 w, u64 key) {
+						const u32 origin[3] {x0+r+1, y+1, z+1};
+						const u32 extent[3] {h, 1, w};
+						return write(face, origin, extent, key);
+					});
+
+				if(!room) return numQuads;
+			}
+
+		}else{
+			// Exposed bits are scattered into a slice per z, rows along x of 
+			//	bits along y. Only exposed faces are visited
+			const u32 yWords = (chunk.height + 63)/64;
+			const u32 sliceWords = numX*yWords;
+			rows.assign(chunk.depth*sliceWords, 0);
+
+			u64 exposed[Occupancy::maxColumnWords];
+			for(u32 x = x0; x < x1; x++)
+			for(u32 y = 0; y < chunk.height; y++) {
+				ExposedFaces(chunk, occupancy, blocks, x, y, face, exposed);
+
+				for(u32 w = 0; w < words; w++)
+				for(u64 bits = exposed[w]; bits; bits &= bits-1) {
+					u32 z = w*64 + __builtin_ctzll(bits);
+					rows[z*sliceWords + (x-x0)*yWords + y/64] |= 1ull << (y&63);
+				}
+			}
+
+			for(u32 z = 0; z < chunk.depth; z++) {
+				bool room = MergeRows(&rows[z*sliceWords], numX, yWords,
+					[&](u32 r, u32 y) { return FaceKey(blocks, colors, lighting, chunk.Index(x0+r,y,z), neighbourOffset); },
+					[&](u32 r, u32 y, u32 h, u32 w, u64 key) {
+						const u32 origin[3] {x0+r+1, y+1, z+1};
+						const u32 extent[3] {h, w, 1};
+						return write(face, origin, extent, key);
+					});
+
+				if(!room) return numQuads;
+			}
+		}
+	}
+
+	return numQuads;
+}
+
+u32 CountExposedFaces(const VoxelChunk& chunk, const Occupancy& occupancy, const u8* blocks, u32 x0, u32 x1) {
+	u64 exposed[Occupancy::maxColumnWords];
+	u32 numFaces = 0;
+
+	for(u32 face = 0; face < 6; face++)
+	for(u32 x = x0; x < x1; x++)
+	for(u32 y = 0; y < chunk.height; y++) {
+		ExposedFaces(chunk, occupancy, blocks, x, y, face, exposed);
+		for(u32 w = 0; w < occupancy.columnWords; w++)
+			numFaces += __builtin_popcountll(exposed[w]);
+	}
+
+	return numFaces;
+}
+
+void EncodeInstances(const u32* vertices, const u32* faces, u32 numQuads, u32* instances) {
+	for(u32 q = 0; q < numQuads; q++) {
+		auto quad = &vertices[q*4];
+		u32 face = (faces[q] >> 26) & 7;
+		u32 light = (quad[0] >> 23) & 63;
+
+		// Half voxel z goes back to whole voxels
+		u32 lo[3] {~0u, ~0u, ~0u}, hi[3] {0, 0, 0};
+		for(u32 vert = 0; vert < 4; vert++) {
+			u32 p[3] {quad[vert] & 127u, (quad[vert]>>7) & 127u, ((quad[vert]>>14) & 511u) >> 1};
+			for(u32 a = 0; a < 3; a++) {
+				lo[a] = std::min(lo[a], p[a]);
+				hi[a] = std::max(hi[a], p[a]);
+			}
+		}
+
+		// The quad is flat along the face's axis, on the far side of the box
+		//	for positive faces
+		u32 n = faceAxis[face];
+		if(faceDir[face] > 0) lo[n]--;
+		else hi[n]++;
+
+		instances[q*2+0] = lo[0] | (lo[1]<<7) | (lo[2]<<14) | (light<<23) | (face<<29);
+		instances[q*2+1] = (hi[0]-lo[0]) | ((hi[1]-lo[1])<<8) | ((hi[2]-lo[2])<<16);
+	}
+}
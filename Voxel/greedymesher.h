@@ -0,0 +1,38 @@
+#ifndef GREEDYMESHER_H
+#define GREEDYMESHER_H
+
+#include "common.h"
+#include "stb_voxel_render.h"
+
+struct VoxelChunk;
+struct Occupancy;
+
+// Meshes the solid cube voxels of a chunk, merging coplanar faces that share
+//	a block type and color into single quads. Output is in the same format as
+//	stbvox mode 21 so it can be drawn with voxel.vs. Non-cube geometry is
+//	ignored and must be meshed separately.
+// blocks, colors and lighting are laid out like the chunk's blockData and 
+//	colorData, and only voxels with x0 <= x < x1 are meshed. lighting is 
+//	stbvox lighting input and can be null for full brightness.
+// Returns number of quads written, sets full if maxQuads was reached
+u32 GreedyMesh(const VoxelChunk&, const u8* blocks, const stbvox_rgb* colors, const u8* lighting, 
+	u32 x0, u32 x1, u32* vertices, u32* faces, u32 maxQuads, bool* full = nullptr);
+
+// As GreedyMesh, but exposed faces come from the occupancy bits a column
+//	at a time, and merging only visits faces that are actually exposed.
+//	occupancy must match blocks, which still provides the padding
+u32 BinaryGreedyMesh(const VoxelChunk&, const Occupancy&, const u8* blocks, const stbvox_rgb* colors, 
+	const u8* lighting, u32 x0, u32 x1, u32* vertices, u32* faces, u32 maxQuads, bool* full = nullptr);
+
+// Solid cube faces not hidden by another solid cube, over x0 <= x < x1
+u32 CountExposedFaces(const VoxelChunk&, const Occupancy&, const u8* blocks, u32 x0, u32 x1);
+
+// Rewrites quads from the greedy meshers as one instance record each, 2 
+//	words instead of 4 vertices. The first holds the padded position of the
+//	box the face is on in 7, 7 and 9 bits, then the light and the face, the
+//	second the box's extent along x, y and z in 8 bits each. voxel_instanced.vs
+//	puts the corners back where WriteQuad had them. Only flat lit, whole 
+//	voxel quads survive this, so not stbvox's
+void EncodeInstances(const u32* vertices, const u32* faces, u32 numQuads, u32* instances);
+
+#endif
@@ -0,0 +1,111 @@
+#include "indirectdraw.h"
+#include "voxelchunk.h"
+#include "shader.h"
+
+// Attribute location of the draw index in voxel_indirect.vs
+static const u32 drawIndexAttribute = 1;
+
+IndirectDrawer::IndirectDrawer() {
+	maxQuads = 0;
+	commandBO = transformBO = drawIndexBO = 0;
+	drawIndexCapacity = 0;
+}
+
+IndirectDrawer::~IndirectDrawer() {
+	if(!commandBO) return;
+
+	glDeleteBuffers(1, &commandBO);
+	glDeleteBuffers(1, &transformBO);
+	glDeleteBuffers(1, &drawIndexBO);
+}
+
+bool IndirectDrawer::IsSupported() {
+	s32 major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major > 4 || (major == 4 && minor >= 3);
+}
+
+void IndirectDrawer::Begin() {
+	commands.clear();
+	transforms.clear();
+	maxQuads = 0;
+}
+
+void IndirectDrawer::Add(const VoxelChunk& chunk) {
+	AddRange(chunk.modelMatrix * VoxelChunk::coordinateCorrection, chunk.meshAllocation.offset, chunk.drawQuads);
+}
+
+void IndirectDrawer::AddTransparent(const VoxelChunk& chunk) {
+	AddRange(chunk.modelMatrix * VoxelChunk::coordinateCorrection, chunk.transparentAllocation.offset, chunk.numTransparentQuads);
+}
+
+void IndirectDrawer::AddRange(const mat4& model, u32 quadOffset, u32 numQuads) {
+	Command command;
+	command.count = numQuads*6;
+	command.instanceCount = 1;
+	command.firstIndex = 0;
+	command.baseVertex = quadOffset*4;
+	command.baseInstance = commands.size();
+
+	commands.push_back(command);
+	transforms.push_back(model);
+	maxQuads = std::max(maxQuads, numQuads);
+}
+
+void IndirectDrawer::Draw(ShaderProgram& program) {
+	if(commands.empty()) return;
+
+	if(!commandBO) {
+		glGenBuffers(1, &commandBO);
+		glGenBuffers(1, &transformBO);
+		glGenBuffers(1, &drawIndexBO);
+	}
+
+	// Never changes, so it only grows
+	if(commands.size() > drawIndexCapacity) {
+		drawIndexCapacity = std::max<u32>(commands.size(), drawIndexCapacity*2);
+		std::vector<u32> indices(drawIndexCapacity);
+		for(u32 i = 0; i < drawIndexCapacity; i++) indices[i] = i;
+
+		glBindBuffer(GL_ARRAY_BUFFER, drawIndexBO);
+		glBufferData(GL_ARRAY_BUFFER, drawIndexCapacity*sizeof(u32), indices.data(), GL_STATIC_DRAW);
+	}
+
+	// Orphaned every frame so the driver doesn't wait on last frame's draw
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBO);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size()*sizeof(Command), commands.data(), GL_STREAM_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size()*sizeof(mat4), transforms.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBO);
+
+	if(maxQuads >= VoxelChunk::elementBufferSize) 
+		VoxelChunk::LengthenElementBuffer(maxQuads);
+
+	auto& arena = VoxelChunk::meshArena;
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBO);
+	glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 4, nullptr);
+
+	glBindBuffer(GL_ARRAY_BUFFER, drawIndexBO);
+	glVertexAttribIPointer(drawIndexAttribute, 1, GL_UNSIGNED_INT, 4, nullptr);
+	glVertexAttribDivisor(drawIndexAttribute, 1);
+	glEnableVertexAttribArray(drawIndexAttribute);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, arena.faceTex);
+	glUniform1i(program.GetUniform("facearray"), 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VoxelChunk::elementBO);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commands.size(), 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// The chunk by chunk path shares the vertex array
+	glDisableVertexAttribArray(drawIndexAttribute);
+	glVertexAttribDivisor(drawIndexAttribute, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
@@ -0,0 +1,44 @@
+#ifndef INDIRECTDRAW_H
+#define INDIRECTDRAW_H
+
+#include "common.h"
+
+struct ShaderProgram;
+struct VoxelChunk;
+
+// Draws every chunk added since Begin with one glMultiDrawElementsIndirect.
+//	Each chunk's model matrix goes into a shader storage buffer, found by
+//	an instanced attribute that baseInstance offsets, since gl_DrawID needs
+//	GL 4.6. Meshes are found by baseVertex, which also offsets gl_VertexID
+//	so faces are looked up the same as when drawing chunk by chunk.
+// Needs GL 4.3 and shaders/voxel_indirect.vs. Begin and Add don't touch GL
+struct IndirectDrawer {
+	// Laid out as GL expects
+	struct Command {
+		u32 count;
+		u32 instanceCount;
+		u32 firstIndex;
+		s32 baseVertex;
+		u32 baseInstance;
+	};
+
+	std::vector<Command> commands;
+	std::vector<mat4> transforms;
+	u32 maxQuads; // Of any one chunk, for the element buffer
+
+	u32 commandBO, transformBO, drawIndexBO;
+	u32 drawIndexCapacity;
+
+	IndirectDrawer();
+	~IndirectDrawer();
+
+	static bool IsSupported(); // Needs a current context
+
+	void Begin();
+	void Add(const VoxelChunk&);
+	void AddTransparent(const VoxelChunk&); // Commands are drawn in the order they're added
+	void AddRange(const mat4& model, u32 quadOffset, u32 numQuads); // Of the mesh arena
+	void Draw(ShaderProgram&);
+};
+
+#endif
@@ -0,0 +1,357 @@
+#include "lighting.h"
+#include "voxelworld.h"
+
+#include <atomic>
+#include <thread>
+
+static Log logger{"Lighting"};
+
+// Faces are in VoxelChunk::neighbours order, so -z is down and +z is up
+static const u32 down = 4;
+static const u32 up = 5;
+
+bool LightEngine::Queues::Empty() const {
+	for(u32 c = 0; c < NumChannels; c++)
+		if(!add[c].empty() || !remove[c].empty()) return false;
+
+	return true;
+}
+
+LightEngine::LightEngine(VoxelWorld* w) : world{w} {
+	numSteps = 0;
+}
+
+u8 LightEngine::Get(const VoxelChunk* chunk, u32 x, u32 y, u32 z, Channel c) {
+	u8 light = chunk->lightData[chunk->Index(x,y,z)];
+	return (c == Sky)? (light >> 4) : (light & 15);
+}
+
+void LightEngine::Set(VoxelChunk* chunk, u32 x, u32 y, u32 z, Channel c, u8 level) {
+	u8& light = chunk->lightData[chunk->Index(x,y,z)];
+	light = (c == Sky)? ((light & 15) | (level << 4)) : ((light & 0xf0) | level);
+}
+
+bool LightEngine::IsOpaque(VoxelChunk* chunk, u32 x, u32 y, u32 z) {
+	return VoxelChunk::IsSolidCube(chunk->GetBlock(x,y,z));
+}
+
+// Moves a node across face, into the neighbouring chunk if it has to
+static bool Step(LightEngine::Node& n, u32 face, bool crossChunks) {
+	auto chunk = n.chunk;
+	const s32 dims[3] {(s32)chunk->width, (s32)chunk->height, (s32)chunk->depth};
+	s32 p[3] {n.x, n.y, n.z};
+
+	u32 a = face/2;
+	p[a] += (face & 1)? 1 : -1;
+
+	if(p[a] < 0 || p[a] >= dims[a]) {
+		if(!crossChunks || !chunk->neighbours[face] || !chunk->neighbours[face]->lightData) 
+			return false;
+
+		n.chunk = chunk->neighbours[face];
+		p[a] = (face & 1)? 0 : dims[a]-1;
+	}
+
+	n.x = p[0]; n.y = p[1]; n.z = p[2];
+	return true;
+}
+
+u32 LightEngine::Propagate(Queues& queues, u32 maxSteps, bool crossChunks) {
+	u32 steps = 0;
+
+	auto markDirty = [&](const Node& n) {
+		if(crossChunks) n.chunk->MarkLightDirty(n.x, n.y, n.z);
+	};
+
+	for(u32 ci = 0; ci < NumChannels; ci++) {
+		auto c = (Channel)ci;
+		auto& removals = queues.remove[c];
+
+		while(!removals.empty() && steps < maxSteps) {
+			Node node = removals.front();
+			removals.pop_front();
+			steps++;
+
+			for(u32 face = 0; face < 6; face++) {
+				Node n = node;
+				if(!Step(n, face, crossChunks)) continue;
+
+				u8 level = Get(n.chunk, n.x, n.y, n.z, c);
+				if(!level) continue;
+
+				// Lit by the removed node, so it goes too. Full sky light 
+				//	going straight down doesn't fade so it always depends on above
+				bool dependent = level < node.level 
+					|| (c == Sky && face == down && node.level == 15 && level == 15);
+
+				if(dependent) {
+					Set(n.chunk, n.x, n.y, n.z, c, 0);
+					markDirty(n);
+					n.level = level;
+					removals.push_back(n);
+
+					u8 emitted = VoxelChunk::blockLight[n.chunk->GetBlock(n.x, n.y, n.z)];
+					if(c == Block && emitted) {
+						Set(n.chunk, n.x, n.y, n.z, c, emitted);
+						queues.add[c].push_back(n);
+					}
+
+				}else{
+					// Brighter from somewhere else, so it fills back in
+					queues.add[c].push_back(n);
+				}
+			}
+		}
+	}
+
+	for(u32 ci = 0; ci < NumChannels; ci++) {
+		auto c = (Channel)ci;
+		auto& adds = queues.add[c];
+
+		// Removals have to finish first, or this could spread light that's on its way out
+		if(!queues.remove[c].empty()) continue;
+
+		while(!adds.empty() && steps < maxSteps) {
+			Node node = adds.front();
+			adds.pop_front();
+			steps++;
+
+			u8 level = Get(node.chunk, node.x, node.y, node.z, c);
+			if(level <= 1 && !(c == Sky && level == 15)) continue;
+
+			for(u32 face = 0; face < 6; face++) {
+				Node n = node;
+				if(!Step(n, face, crossChunks)) continue;
+				if(IsOpaque(n.chunk, n.x, n.y, n.z)) continue;
+
+				u8 spread = (c == Sky && face == down && level == 15)? 15 : level-1;
+				if(Get(n.chunk, n.x, n.y, n.z, c) >= spread) continue;
+
+				Set(n.chunk, n.x, n.y, n.z, c, spread);
+				markDirty(n);
+				adds.push_back(n);
+			}
+		}
+	}
+
+	return steps;
+}
+
+void LightEngine::BakeChunk(VoxelChunk* chunk, const bool* skyAbove, bool* skyBelow, Queues& local) {
+	if(!chunk->lightData) chunk->lightData = new u8[chunk->PaddedSize()];
+	memset(chunk->lightData, 0, chunk->PaddedSize());
+
+	for(u32 x = 0; x < chunk->width; x++)
+	for(u32 y = 0; y < chunk->height; y++) {
+		u32 column = x + y*chunk->width;
+		bool open = skyAbove[column];
+
+		for(u32 z = chunk->depth; z-- > 0;) {
+			u8 block = chunk->GetBlock(x,y,z);
+			if(VoxelChunk::IsSolidCube(block)) open = false;
+
+			if(open) {
+				Set(chunk, x,y,z, Sky, 15);
+				local.add[Sky].push_back(Node{chunk, (u16)x, (u16)y, (u16)z, 15});
+			}
+
+			if(VoxelChunk::blockLight[block]) {
+				Set(chunk, x,y,z, Block, VoxelChunk::blockLight[block]);
+				local.add[Block].push_back(Node{chunk, (u16)x, (u16)y, (u16)z, 0});
+			}
+		}
+
+		skyBelow[column] = open;
+	}
+
+	Propagate(local, ~0u, false);
+}
+
+void LightEngine::Bake(u32 numThreads) {
+	u32 w = world->chunkWidth;
+	u32 h = world->chunkHeight;
+
+	// Columns of chunks, top first, since sky light has to come down through them in order
+	std::map<std::pair<s32, s32>, std::vector<std::pair<s32, VoxelChunk*>>> columnMap;
+	world->chunks.ForEach([&](ChunkCoord c, VoxelChunk* chunk) {
+		columnMap[{c.x, c.y}].emplace_back(-c.z, chunk);
+	});
+
+	std::vector<std::vector<std::pair<s32, VoxelChunk*>>*> columns;
+	for(auto& c: columnMap) {
+		std::sort(c.second.begin(), c.second.end());
+		columns.push_back(&c.second);
+	}
+
+	std::atomic<u32> nextColumn {0};
+
+	auto bakeColumns = [&] {
+		Queues local;
+		auto skyAbove = new bool[w*h];
+		auto skyBelow = new bool[w*h];
+
+		for(u32 i = nextColumn++; i < columns.size(); i = nextColumn++) {
+			// Gaps between chunks are open air
+			std::fill_n(skyAbove, w*h, true);
+
+			for(auto& c: *columns[i]) {
+				BakeChunk(c.second, skyAbove, skyBelow, local);
+				std::swap(skyAbove, skyBelow);
+			}
+		}
+
+		delete[] skyAbove;
+		delete[] skyBelow;
+	};
+
+	if(!numThreads) numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<std::thread> threads;
+	for(u32 i = 1; i < numThreads; i++)
+		threads.emplace_back(bakeColumns);
+
+	bakeColumns();
+	for(auto& t: threads) t.join();
+
+	// Every chunk is lit on its own, so spreading from the borders 
+	//	is all that's needed to join them up
+	queues = Queues{};
+	world->chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		SeedBorders(chunk);
+	});
+
+	numSteps += Propagate(queues, ~0u, true);
+
+	world->chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		chunk->Invalidate();
+	});
+
+	logger << "Baked " << world->chunks.count << " chunks in " << columns.size() << " columns";
+}
+
+// Queues the boundary voxels so they spread into the neighbours
+void LightEngine::SeedBorders(VoxelChunk* chunk) {
+	const u32 dims[3] {chunk->width, chunk->height, chunk->depth};
+
+	for(u32 face = 0; face < 6; face++) {
+		if(!chunk->neighbours[face]) continue;
+
+		u32 a = face/2;
+		u32 u = (a+1)%3, v = (a+2)%3;
+
+		for(u32 i = 0; i < dims[u]; i++)
+		for(u32 j = 0; j < dims[v]; j++) {
+			u32 p[3];
+			p[a] = (face & 1)? dims[a]-1 : 0;
+			p[u] = i;
+			p[v] = j;
+
+			Node n {chunk, (u16)p[0], (u16)p[1], (u16)p[2], 0};
+			if(Get(chunk, p[0], p[1], p[2], Sky) > 1) queues.add[Sky].push_back(n);
+			if(Get(chunk, p[0], p[1], p[2], Block) > 1) queues.add[Block].push_back(n);
+		}
+	}
+}
+
+void LightEngine::OnChunkCreated(VoxelChunk* chunk) {
+	u32 size = chunk->width*chunk->height;
+	auto skyAbove = new bool[size];
+	auto skyBelow = new bool[size];
+	std::fill_n(skyAbove, size, true);
+
+	// Sky comes down from the chunk above, if there is one
+	auto above = chunk->neighbours[up];
+	if(above && above->lightData) {
+		for(u32 x = 0; x < chunk->width; x++)
+		for(u32 y = 0; y < chunk->height; y++)
+			skyAbove[x + y*chunk->width] = (Get(above, x, y, 0, Sky) == 15);
+	}
+
+	Queues local;
+	BakeChunk(chunk, skyAbove, skyBelow, local);
+
+	delete[] skyAbove;
+	delete[] skyBelow;
+
+	SeedBorders(chunk);
+	for(u32 face = 0; face < 6; face++) {
+		auto n = chunk->neighbours[face];
+		if(n && n->lightData) SeedBorders(n);
+	}
+
+	chunk->Invalidate();
+}
+
+void LightEngine::OnChunkDestroyed(VoxelChunk* chunk) {
+	auto inChunk = [chunk](const Node& n) { return n.chunk == chunk; };
+
+	for(u32 c = 0; c < NumChannels; c++) {
+		auto& add = queues.add[c];
+		auto& remove = queues.remove[c];
+		add.erase(std::remove_if(add.begin(), add.end(), inChunk), add.end());
+		remove.erase(std::remove_if(remove.begin(), remove.end(), inChunk), remove.end());
+	}
+}
+
+void LightEngine::OnBlockChanged(VoxelChunk* chunk, u32 x, u32 y, u32 z, u8 oldBlock, u8 newBlock) {
+	if(!chunk->lightData || oldBlock == newBlock) return;
+
+	Node node {chunk, (u16)x, (u16)y, (u16)z, 0};
+	bool wasOpaque = VoxelChunk::IsSolidCube(oldBlock);
+	bool isOpaque = VoxelChunk::IsSolidCube(newBlock);
+
+	// Whatever was lit through here, or by what used to be here, goes
+	for(u32 ci = 0; ci < NumChannels; ci++) {
+		auto c = (Channel)ci;
+		bool blocked = isOpaque && !wasOpaque;
+		bool emitterGone = (c == Block) && VoxelChunk::blockLight[oldBlock];
+		if(!blocked && !emitterGone) continue;
+
+		node.level = Get(chunk, x,y,z, c);
+		if(!node.level) continue;
+
+		Set(chunk, x,y,z, c, 0);
+		chunk->MarkLightDirty(x,y,z);
+		queues.remove[c].push_back(node);
+	}
+
+	if(u8 emitted = VoxelChunk::blockLight[newBlock]) {
+		Set(chunk, x,y,z, Block, emitted);
+		chunk->MarkLightDirty(x,y,z);
+		queues.add[Block].push_back(node);
+	}
+
+	if(!wasOpaque || isOpaque) return;
+
+	// Newly open, so it takes light from its brightest neighbour
+	for(u32 ci = 0; ci < NumChannels; ci++) {
+		auto c = (Channel)ci;
+		u8 best = Get(chunk, x,y,z, c);
+
+		for(u32 face = 0; face < 6; face++) {
+			Node n = node;
+			if(!Step(n, face, true)) {
+				if(c == Sky && face == up && !chunk->neighbours[up] && z == chunk->depth-1)
+					best = 15;
+				continue;
+			}
+
+			u8 level = Get(n.chunk, n.x, n.y, n.z, c);
+			if(c == Sky && face == up && level == 15) best = 15;
+			else if(level > best+1) best = level-1;
+		}
+
+		if(!best) continue;
+
+		Set(chunk, x,y,z, c, best);
+		chunk->MarkLightDirty(x,y,z);
+		queues.add[c].push_back(node);
+	}
+}
+
+bool LightEngine::Update(u32 maxSteps) {
+	if(queues.Empty()) return true;
+
+	numSteps += Propagate(queues, maxSteps, true);
+	return queues.Empty();
+}
@@ -0,0 +1,62 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "common.h"
+
+#include <deque>
+
+struct VoxelChunk;
+struct VoxelWorld;
+
+// Flood filled sky and block light, 0 to 15 each, stored as sky<<4 | block
+//	in each chunk's lightData. Sky light comes down columns open to the top
+//	of the world without fading and fades by one per voxel sideways, block
+//	light spreads out from blocks with a VoxelChunk::blockLight level.
+// Edits queue incremental updates, removals first so that anything lit by
+//	what was removed gets cleared and then refilled from whatever is left.
+//	Update works through the queues a bounded number of steps at a time
+struct LightEngine {
+	enum Channel { Sky, Block, NumChannels };
+
+	struct Node {
+		VoxelChunk* chunk;
+		u16 x, y, z;
+		u8 level; // The level it had, for removals
+	};
+
+	// Separate so the bake can have one per thread
+	struct Queues {
+		std::deque<Node> add[NumChannels];
+		std::deque<Node> remove[NumChannels];
+
+		bool Empty() const;
+	};
+
+	VoxelWorld* world;
+	Queues queues;
+	u64 numSteps; // Nodes visited, ever
+
+	LightEngine(VoxelWorld*);
+
+	// Lights every chunk from scratch, one column of chunks per task spread
+	//	across threads, then spreads light across chunk borders
+	void Bake(u32 numThreads = 0);
+
+	void OnChunkCreated(VoxelChunk*);
+	void OnChunkDestroyed(VoxelChunk*); // Drops its queued updates
+	void OnBlockChanged(VoxelChunk*, u32 x, u32 y, u32 z, u8 oldBlock, u8 newBlock);
+
+	// Returns true once the queues are empty
+	bool Update(u32 maxSteps);
+
+	static u8 Get(const VoxelChunk*, u32 x, u32 y, u32 z, Channel);
+	static void Set(VoxelChunk*, u32 x, u32 y, u32 z, Channel, u8 level);
+	static bool IsOpaque(VoxelChunk*, u32 x, u32 y, u32 z);
+
+	// Chunk local light with sky columns and emitters, nothing from neighbours
+	static void BakeChunk(VoxelChunk*, const bool* skyAbove, bool* skyBelow, Queues&);
+	static u32 Propagate(Queues&, u32 maxSteps, bool crossChunks);
+	void SeedBorders(VoxelChunk*);
+};
+
+#endif
@@ -1,4 +1,15 @@
-#include "voxelchunk.h"
+#include "voxelworld.h"
+#include "meshworkers.h"
+#include "occlusionculler.h"
+#include "benchmark.h"
+#include "raycast.h"
+#include "lighting.h"
+#include "regionfile.h"
+#include "meshcache.h"
+#include "indirectdraw.h"
+#include "uploadscheduler.h"
+#include "stagingring.h"
+#include "terrain.h"
 #include "shader.h"
 #include "common.h"
 
@@ -69,38 +80,12 @@ void setup_uniforms(ShaderProgram& shader/*, float camera_pos[4], GLuint tex1, G
 
 static Log logger{"Main"};
 
-s32 main() {
-	constexpr u32 wwidth = 800;
-	constexpr u32 wheight = 600;
-
-	if(SDL_Init(SDL_INIT_EVERYTHING) < 0){
-		logger << "SDL init failed";
-		return 1;
-	}
-
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
-	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
-	
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-
-	auto window = SDL_CreateWindow("Voxel", 
-		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, wwidth, wheight, SDL_WINDOW_OPENGL);
-
-	if(!window) {
-		logger << "Window creation failed";
-		return 1;
-	}
-
-	auto glctx = SDL_GL_CreateContext(window);
-	if(!glctx) {
-		logger << "OpenGL context creation failed";
-		throw 0;
-	}
+static constexpr u32 wwidth = 800;
+static constexpr u32 wheight = 600;
 
+// The world and everything drawing it, until the window is closed. 
+//	Needs a current context, which has to outlive it
+static void Run(SDL_Window* window) {
 	u32 vao;
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -124,42 +109,87 @@ s32 main() {
 		program.Link();
 	}
 
+	bool indirectSupported = IndirectDrawer::IsSupported();
+	ShaderProgram indirectProgram;
+	if(indirectSupported) {
+		Shader vsh{"shaders/voxel_indirect.vs"};
+		Shader fsh{"shaders/voxel.fs"};
+
+		vsh.Compile();
+		fsh.Compile();
+		indirectProgram.Attach(vsh);
+		indirectProgram.Attach(fsh);
+		indirectProgram.Link();
+	}
+
+	bool instancingSupported = VoxelChunk::SupportsInstancing();
+	ShaderProgram instancedProgram;
+	if(instancingSupported) {
+		Shader vsh{"shaders/voxel_instanced.vs"};
+		Shader fsh{"shaders/voxel.fs"};
+
+		vsh.Compile();
+		fsh.Compile();
+		instancedProgram.Attach(vsh);
+		instancedProgram.Attach(fsh);
+		instancedProgram.Link();
+	}
+
 	mat4 projectionMatrix = glm::perspective((f32)PI/4.f, 4.f/3.f, 0.001f, 1000.0f);
 	mat4 viewMatrix = mat4(1.f);
 	mat4 modelMatrix = glm::translate<f32>(-0.2f,-0.2f,-1.f);
 
-	VoxelChunk chunk{32,32,24};
-	chunk.modelMatrix = modelMatrix;
-
-	for(u32 x = 0; x < chunk.width; x++)
-	for(u32 y = 0; y < chunk.height; y++) {
-		chunk.SetBlock(x,y,0, rand()%2 + 1);
-		chunk.SetColor(x,y,0, 100,200,100);
+	// Before the workers, which use it until they're destroyed
+	MeshCache meshCache {"meshcache"};
+	VoxelChunk::meshCache = &meshCache;
+
+	// Shared by both arenas, fenced once a frame
+	StagingRing stagingRing;
+	VoxelChunk::meshArena.staging = &stagingRing;
+	VoxelChunk::instanceArena.staging = &stagingRing;
+
+	MeshWorkerPool meshWorkers;
+	UploadScheduler uploadScheduler;
+	OcclusionCuller occlusionCuller {256, 192};
+
+	// Before the world, so it outlives the world pointing at it, and 
+	//	destroyed with the rest when Run returns, while there's a context
+	IndirectDrawer indirectDrawer;
+
+	VoxelWorld world{32,32,24};
+	world.modelMatrix = modelMatrix;
+	world.meshWorkers = &meshWorkers;
+	world.uploadScheduler = &uploadScheduler;
+	world.occlusionCuller = &occlusionCuller;
+
+	if(indirectSupported) world.indirectDrawer = &indirectDrawer;
+	logger << "Indirect drawing " << (indirectSupported? "supported" : "not supported, needs GL 4.3");
+
+	// The world is generated once, then edits persist between runs
+	TerrainGenerator terrain {1234};
+	RegionStore regions {"world", world.chunkWidth, world.chunkHeight, world.chunkDepth};
+
+	if(regions.Open()) {
+		regions.LoadAll(world);
+	}else{
+		terrain.Generate(world, ChunkCoord{-4,-4,0}, ChunkCoord{3,3,1});
+		regions.SaveAll(world);
 	}
 
-	for(u32 x = 0; x < chunk.width; x++)
-	for(u32 y = 0; y < chunk.height; y++) {
-		chunk.SetBlock(x,y,1, (chunk.GetBlock(x,y,0)==1 && rand()%5==0)?7:0);
-		chunk.SetColor(x,y,1, 127,255,127);
-	}
-	
-	for(u32 x = 0; x < chunk.width; x++) {
-		chunk.SetBlock(x,0,4, 1);
-		chunk.SetColor(x,0,4, 255,0,0);
-	}
-	for(u32 y = 0; y < chunk.height; y++) {
-		chunk.SetBlock(0,y,5, 1);
-		chunk.SetColor(0,y,5, 255,0,0);
-	}
+	world.CompressChunks();
+	logger << "Num chunks: " << world.chunks.count;
 
-	chunk.GenerateMesh();
-	logger << "Num quads generated: " << chunk.numQuads;
+	LightEngine lighting {&world};
+	lighting.Bake();
+	world.lighting = &lighting;
 
 	glEnableVertexAttribArray(0);
 
 	vec2 cameraRot {0,0};
 	vec3 cameraPos {0,0,0.f};
 	s8 keys[5] = {false};
+	auto meshMethod = MeshMethod::Stbvox;
+	bool placeGlass = false;
 	f32 dt = 0.001f;
 	f32 t = 0.f;
 
@@ -185,6 +215,30 @@ s32 main() {
 					case SDLK_a: keys[2] = true; break;
 					case SDLK_d: keys[3] = true; break;
 					case SDLK_LSHIFT: keys[4] = true; break;
+
+					case SDLK_g:
+						if(meshMethod == MeshMethod::Stbvox) meshMethod = MeshMethod::Greedy;
+						else if(meshMethod == MeshMethod::Greedy) meshMethod = MeshMethod::BinaryGreedy;
+						else meshMethod = MeshMethod::Stbvox;
+						world.SetMeshMethod(meshMethod);
+						break;
+
+					case SDLK_i:
+						if(!indirectSupported) break;
+						world.indirectDrawer = world.indirectDrawer? nullptr : &indirectDrawer;
+						break;
+
+					case SDLK_t: placeGlass = !placeGlass; break;
+
+					case SDLK_n:
+						if(!instancingSupported) break;
+						world.instanceProgram = world.instanceProgram? nullptr : &instancedProgram;
+						break;
+
+					case SDLK_u:
+						uploadScheduler.Flush();
+						world.uploadScheduler = world.uploadScheduler? nullptr : &uploadScheduler;
+						break;
 					}
 				} break;
 				case SDL_KEYUP: {
@@ -198,12 +252,31 @@ s32 main() {
 				} break;
 
 				case SDL_MOUSEBUTTONDOWN: {
-					vec4 hcpos = vec4{cameraPos, 1.f};
-					hcpos = glm::inverse(chunk.modelMatrix * glm::rotate<f32>(-PI/2.f, vec3{1,0,0})) * hcpos - vec4{1.f};
-					logger << hcpos;
-
-					chunk.SetBlock((u32)hcpos.x, (u32)hcpos.y, (u32)hcpos.z, 1);
-					chunk.SetColor((u32)hcpos.x, (u32)hcpos.y, (u32)hcpos.z, 0, 0, 255);
+					// Into voxel space, where voxel v spans v to v+1 instead of v+1 to v+2
+					mat4 toVoxel = glm::inverse(world.modelMatrix * VoxelChunk::coordinateCorrection);
+
+					Ray ray;
+					ray.origin = vec3(toVoxel * vec4{cameraPos, 1.f}) - vec3{1.f};
+					ray.direction = vec3(toVoxel * glm::inverse(viewMatrix) * vec4{0.f, 0.f, -1.f, 0.f});
+					ray.maxDistance = 64.f;
+
+					RaycastHit hit;
+					if(!Raycast(world, ray, &hit)) break;
+
+					// Left places against the face that was hit, glass if toggled with t, 
+					//	middle places a lamp, right removes
+					if(e.button.button == SDL_BUTTON_RIGHT) {
+						world.SetBlock(hit.x, hit.y, hit.z, 0);
+					}else{
+						s32 x = hit.x + hit.nx;
+						s32 y = hit.y + hit.ny;
+						s32 z = hit.z + hit.nz;
+						bool lamp = (e.button.button == SDL_BUTTON_MIDDLE);
+						world.SetBlock(x, y, z, lamp? 8 : placeGlass? 9 : 1);
+						if(lamp) world.SetColor(x, y, z, 255, 220, 120);
+						else if(placeGlass) world.SetColor(x, y, z, 160, 220, 255);
+						else world.SetColor(x, y, z, 0, 0, 255);
+					}
 				} break;
 			}
 		}
@@ -239,13 +312,23 @@ s32 main() {
 
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-		chunk.modelMatrix = glm::translate<f32>(-(chunk.width/2.f), -8.f, (chunk.height/2.f));
+		world.modelMatrix = glm::translate<f32>(-(world.chunkWidth/2.f), -(terrain.baseHeight + terrain.hillHeight), (world.chunkHeight/2.f));
 
-		setup_uniforms(program);
-		glUniformMatrix4fv(program.GetUniform("view_projection"), 1, false, 
-			glm::value_ptr(projectionMatrix * viewMatrix));
+		auto& drawProgram = world.indirectDrawer? indirectProgram : program;
+		setup_uniforms(drawProgram);
+		mat4 viewProjection = projectionMatrix * viewMatrix;
+		glUniformMatrix4fv(drawProgram.GetUniform("view_projection"), 1, false, 
+			glm::value_ptr(viewProjection));
+
+		if(world.instanceProgram) {
+			setup_uniforms(instancedProgram);
+			glUniformMatrix4fv(instancedProgram.GetUniform("view_projection"), 1, false, 
+				glm::value_ptr(viewProjection));
+			drawProgram.Use();
+		}
 
-		chunk.Render(program);
+		world.Render(drawProgram, viewProjection, cameraPos);
+		stagingRing.EndFrame();
 
 		SDL_GL_SwapWindow(window);
 		SDL_Delay(1);
@@ -255,10 +338,74 @@ s32 main() {
 		t += dt;
 		begin = end;
 
-		string fps = "FPS: " + std::to_string(1.f/dt) + " NumTris: " + std::to_string(chunk.numQuads*2);
+		auto& arena = VoxelChunk::meshArena.allocator;
+		string fps = "FPS: " + std::to_string(1.f/dt) + (world.indirectDrawer? " Indirect" : "") 
+			+ (world.instanceProgram? " Instanced: " + std::to_string(world.numChunksInstanced) : "") + " NumTris: " + std::to_string(world.numQuadsDrawn*2)
+			+ " NumChunks: " + std::to_string(world.numChunksDrawn)
+			+ "/" + std::to_string(world.numChunksTested) + " (" + std::to_string(world.numChunksCulled) + " culled, " 
+				+ std::to_string(world.numChunksOccluded) + " occluded)"
+			+ " Transparent: " + std::to_string(world.numTransparentChunks) 
+				+ " (" + std::to_string(world.numTransparentSorts) + " sorted)"
+			+ " Lods: " + std::to_string(world.numChunksAtLod[0]) + "/" + std::to_string(world.numChunksAtLod[1])
+			+ "/" + std::to_string(world.numChunksAtLod[2]) + "/" + std::to_string(world.numChunksAtLod[3])
+			+ " MeshJobs: " + std::to_string(meshWorkers.numInFlight) 
+			+ "/" + std::to_string(meshWorkers.numCompleted)
+			+ (world.uploadScheduler? " Uploads: " + std::to_string(uploadScheduler.queue.size()) + " queued " 
+				+ std::to_string(uploadScheduler.bytesUploaded>>10) + "KB" : "")
+			+ " MeshCache: " + std::to_string(meshCache.numHits) + " hits " + std::to_string(meshCache.numMisses) + " misses"
+			+ " Arena: " + std::to_string((s32)(arena.Utilisation()*100.f)) 
+			+ "% used " + std::to_string((s32)(arena.Fragmentation()*100.f)) + "% fragmented";
 		SDL_SetWindowTitle(window, fps.data());
 	}
 
+	regions.SaveAll(world);
+}
+
+s32 main(s32 argc, char** argv) {
+	if(argc > 1 && string{argv[1]} == "bench")
+		return RunBenchmarks(argc-2, argv+2);
+
+	if(SDL_Init(SDL_INIT_EVERYTHING) < 0){
+		logger << "SDL init failed";
+		return 1;
+	}
+
+	// 4.3 for indirect drawing, 3.2 draws chunk by chunk
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+	
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+
+	auto window = SDL_CreateWindow("Voxel", 
+		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, wwidth, wheight, SDL_WINDOW_OPENGL);
+
+	if(!window) {
+		logger << "Window creation failed";
+		return 1;
+	}
+
+	auto glctx = SDL_GL_CreateContext(window);
+	if(!glctx) {
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, 0);
+		glctx = SDL_GL_CreateContext(window);
+	}
+
+	if(!glctx) {
+		logger << "OpenGL context creation failed";
+		throw 0;
+	}
+
+	// Everything holding GL objects is destroyed before the context is
+	Run(window);
+
+	SDL_GL_DeleteContext(glctx);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 	return 0;
@@ -0,0 +1,258 @@
+#include "mesharena.h"
+#include "stagingring.h"
+
+static Log logger{"MeshArena"};
+
+// FreeListAllocator
+
+FreeListAllocator::FreeListAllocator(u32 c) : capacity{c}, used{0} {
+	if(capacity) freeBlocks[0] = capacity;
+}
+
+u32 FreeListAllocator::Allocate(u32 size) {
+	for(auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+		if(it->second < size) continue;
+
+		u32 offset = it->first;
+		u32 remaining = it->second - size;
+		freeBlocks.erase(it);
+		if(remaining) freeBlocks[offset+size] = remaining;
+
+		used += size;
+		return offset;
+	}
+
+	return invalid;
+}
+
+void FreeListAllocator::Free(u32 offset, u32 size) {
+	used -= size;
+
+	auto next = freeBlocks.lower_bound(offset);
+	if(next != freeBlocks.end() && offset+size == next->first) {
+		size += next->second;
+		next = freeBlocks.erase(next);
+	}
+
+	if(next != freeBlocks.begin()) {
+		auto prev = std::prev(next);
+		if(prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+
+	freeBlocks[offset] = size;
+}
+
+void FreeListAllocator::Grow(u32 newCapacity) {
+	if(newCapacity <= capacity) return;
+
+	u32 oldCapacity = capacity;
+	capacity = newCapacity;
+
+	// Free takes care of merging with a free block at the end
+	used += newCapacity - oldCapacity;
+	Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+void FreeListAllocator::Reset(u32 u) {
+	used = u;
+	freeBlocks.clear();
+	if(used < capacity) freeBlocks[used] = capacity - used;
+}
+
+u32 FreeListAllocator::LargestFreeBlock() const {
+	u32 largest = 0;
+	for(auto& b: freeBlocks) largest = std::max(largest, b.second);
+	return largest;
+}
+
+f32 FreeListAllocator::Utilisation() const {
+	return capacity? used / (f32)capacity : 0.f;
+}
+
+f32 FreeListAllocator::Fragmentation() const {
+	u32 free = capacity - used;
+	if(!free) return 0.f;
+	return 1.f - LargestFreeBlock() / (f32)free;
+}
+
+// MeshArena
+
+MeshArena::MeshArena(u32 words) : wordsPerQuad{words} {
+	vertexBO = faceBO = faceTex = 0;
+	numDefragmentations = 0;
+	staging = nullptr;
+}
+
+void MeshArena::InitBuffers() {
+	allocator = FreeListAllocator{initialQuads};
+
+	glGenBuffers(1, &vertexBO);
+	glGenBuffers(1, &faceBO);
+	glGenTextures(1, &faceTex);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
+	glBufferData(GL_ARRAY_BUFFER, initialQuads*wordsPerQuad*sizeof(u32), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, faceBO);
+	glBufferData(GL_TEXTURE_BUFFER, initialQuads*sizeof(u32), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, faceTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, faceBO);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Copies (from, to) quad ranges from the current buffers into new ones
+//	of newCapacity quads and swaps them in
+static void MoveToNewBuffers(u32& vertexBO, u32& faceBO, u32 faceTex, u32 wordsPerQuad, u32 newCapacity, 
+	const std::vector<std::pair<u32, u32>>& moves, const std::vector<u32>& sizes) {
+	u32 newVertexBO, newFaceBO;
+	glGenBuffers(1, &newVertexBO);
+	glGenBuffers(1, &newFaceBO);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBO);
+	u32 quadSize = wordsPerQuad*sizeof(u32);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity*quadSize, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, vertexBO);
+	for(u32 i = 0; i < moves.size(); i++)
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+			moves[i].first*quadSize, moves[i].second*quadSize, sizes[i]*quadSize);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newFaceBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity*sizeof(u32), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, faceBO);
+	for(u32 i = 0; i < moves.size(); i++)
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+			moves[i].first*sizeof(u32), moves[i].second*sizeof(u32), sizes[i]*sizeof(u32));
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &vertexBO);
+	glDeleteBuffers(1, &faceBO);
+	vertexBO = newVertexBO;
+	faceBO = newFaceBO;
+
+	glBindTexture(GL_TEXTURE_BUFFER, faceTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, faceBO);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void MeshArena::ResizeBuffers(u32 newCapacity) {
+	logger << "Growing from " << allocator.capacity << " to " << newCapacity << " quads";
+
+	MoveToNewBuffers(vertexBO, faceBO, faceTex, wordsPerQuad, newCapacity, 
+		{{0, 0}}, {allocator.capacity});
+	allocator.Grow(newCapacity);
+}
+
+void MeshArena::Allocate(MeshAllocation* alloc, u32 numQuads) {
+	alloc->offset = 0;
+	alloc->size = 0;
+	if(!numQuads) return;
+	if(!vertexBO) InitBuffers();
+
+	u32 offset = allocator.Allocate(numQuads);
+	if(offset == FreeListAllocator::invalid) {
+		ResizeBuffers(std::max(allocator.capacity*2, allocator.capacity + numQuads));
+		offset = allocator.Allocate(numQuads);
+	}
+
+	alloc->offset = offset;
+	alloc->size = numQuads;
+	allocations[offset] = alloc;
+}
+
+void MeshArena::Free(MeshAllocation* alloc) {
+	if(!alloc->size) return;
+
+	allocator.Free(alloc->offset, alloc->size);
+	allocations.erase(alloc->offset);
+	alloc->offset = 0;
+	alloc->size = 0;
+}
+
+void MeshArena::Move(MeshAllocation* from, MeshAllocation* to) {
+	*to = *from;
+	if(to->size) allocations[to->offset] = to;
+
+	from->offset = 0;
+	from->size = 0;
+}
+
+void MeshArena::UploadVertices(const MeshAllocation& alloc, u32 quadOffset, u32 numQuads, const u32* data) {
+	u32 quadSize = wordsPerQuad*sizeof(u32);
+	if(staging) {
+		staging->Upload(vertexBO, (alloc.offset+quadOffset)*quadSize, numQuads*quadSize, data);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
+	glBufferSubData(GL_ARRAY_BUFFER, (alloc.offset+quadOffset)*quadSize, numQuads*quadSize, data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshArena::UploadFaces(const MeshAllocation& alloc, u32 quadOffset, u32 numQuads, const u32* data) {
+	if(staging) {
+		staging->Upload(faceBO, (alloc.offset+quadOffset)*sizeof(u32), numQuads*sizeof(u32), data);
+		return;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, faceBO);
+	glBufferSubData(GL_TEXTURE_BUFFER, (alloc.offset+quadOffset)*sizeof(u32), numQuads*sizeof(u32), data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void MeshArena::Copy(const MeshAllocation& from, u32 fromOffset, const MeshAllocation& to, u32 toOffset, u32 numQuads) {
+	// Same buffer for both, which is fine as long as the ranges don't overlap
+	u32 quadSize = wordsPerQuad*sizeof(u32);
+	glBindBuffer(GL_COPY_READ_BUFFER, vertexBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+		(from.offset+fromOffset)*quadSize, (to.offset+toOffset)*quadSize, numQuads*quadSize);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, faceBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, faceBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+		(from.offset+fromOffset)*sizeof(u32), (to.offset+toOffset)*sizeof(u32), numQuads*sizeof(u32));
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MeshArena::Defragment() {
+	if(!vertexBO) return;
+
+	std::vector<std::pair<u32, u32>> moves;
+	std::vector<u32> sizes;
+	std::map<u32, MeshAllocation*> packed;
+
+	u32 cursor = 0;
+	for(auto& a: allocations) {
+		auto alloc = a.second;
+		moves.emplace_back(alloc->offset, cursor);
+		sizes.push_back(alloc->size);
+
+		alloc->offset = cursor;
+		packed[cursor] = alloc;
+		cursor += alloc->size;
+	}
+
+	MoveToNewBuffers(vertexBO, faceBO, faceTex, wordsPerQuad, allocator.capacity, moves, sizes);
+
+	allocations = std::move(packed);
+	allocator.Reset(cursor);
+	numDefragmentations++;
+}
+
+void MeshArena::DefragmentIfNeeded(f32 maxFragmentation) {
+	// A few small holes aren't worth moving everything for
+	if(allocator.freeBlocks.size() < 16) return;
+	if(allocator.Fragmentation() < maxFragmentation) return;
+
+	Defragment();
+}
@@ -0,0 +1,73 @@
+#ifndef MESHARENA_H
+#define MESHARENA_H
+
+#include "common.h"
+
+struct StagingRing;
+
+// First fit free list over a range of units, coalescing on free.
+//	Doesn't touch GL so it can be exercised headless
+struct FreeListAllocator {
+	static constexpr u32 invalid = ~0u;
+
+	std::map<u32, u32> freeBlocks; // offset -> size
+	u32 capacity;
+	u32 used;
+
+	FreeListAllocator(u32 capacity = 0);
+
+	u32 Allocate(u32 size); // Returns invalid if there's no room
+	void Free(u32 offset, u32 size);
+	void Grow(u32 newCapacity);
+	void Reset(u32 used); // Everything before used is allocated, the rest is free
+
+	u32 LargestFreeBlock() const;
+	f32 Utilisation() const;
+	// 0 when all free space is contiguous, approaching 1 as it gets split up
+	f32 Fragmentation() const;
+};
+
+// A chunk's range of the arena, in quads. Owned by the chunk, but the arena
+//	keeps a pointer so it can move it when defragmenting
+struct MeshAllocation {
+	u32 offset;
+	u32 size;
+};
+
+// All chunk meshes live in one vertex buffer and one face buffer, so
+//	remeshing sub-allocates instead of reallocating driver storage.
+//	Vertex and face ranges share offsets, wordsPerQuad vertex words and 
+//	1 face per quad. That's 4 vertices, or 2 for an instance record
+struct MeshArena {
+	static constexpr u32 initialQuads = 1<<20; // 16MB of vertices at 4 words, 4MB of faces
+
+	FreeListAllocator allocator;
+	std::map<u32, MeshAllocation*> allocations; // By offset
+
+	u32 wordsPerQuad;
+	u32 vertexBO, faceBO, faceTex;
+	u32 numDefragmentations;
+
+	// If set, uploads are copied through it rather than with glBufferSubData
+	StagingRing* staging;
+
+	MeshArena(u32 wordsPerQuad = 4);
+
+	// Allocation size 0 means no allocation
+	void Allocate(MeshAllocation*, u32 numQuads);
+	void Free(MeshAllocation*);
+	void Move(MeshAllocation* from, MeshAllocation* to); // Hands an allocation to another owner
+
+	void UploadVertices(const MeshAllocation&, u32 quadOffset, u32 numQuads, const u32* data);
+	void UploadFaces(const MeshAllocation&, u32 quadOffset, u32 numQuads, const u32* data);
+	void Copy(const MeshAllocation& from, u32 fromOffset, const MeshAllocation& to, u32 toOffset, u32 numQuads);
+
+	// Packs every allocation together at the start of fresh buffers
+	void Defragment();
+	void DefragmentIfNeeded(f32 maxFragmentation = 0.5f);
+
+	void InitBuffers();
+	void ResizeBuffers(u32 newCapacity);
+};
+
+#endif
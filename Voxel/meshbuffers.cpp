@@ -0,0 +1,59 @@
+#include "meshbuffers.h"
+
+MeshBuildBuffers::MeshBuildBuffers(u32 q) : maxQuads{q} {
+	vertices = new u32[maxQuads*4];
+	faces = new u32[maxQuads];
+}
+
+MeshBuildBuffers::~MeshBuildBuffers() {
+	delete[] vertices;
+	delete[] faces;
+}
+
+void MeshBuildBuffers::Grow(u32 numQuads) {
+	auto nvertices = new u32[maxQuads*2*4];
+	auto nfaces = new u32[maxQuads*2];
+	memcpy(nvertices, vertices, numQuads*4*sizeof(u32));
+	memcpy(nfaces, faces, numQuads*sizeof(u32));
+
+	delete[] vertices;
+	delete[] faces;
+
+	vertices = nvertices;
+	faces = nfaces;
+	maxQuads *= 2;
+}
+
+MeshBufferPool::MeshBufferPool() {
+	numBuffers = 0;
+	numBytes = 0;
+}
+
+MeshBufferPool::~MeshBufferPool() {
+	for(auto b: available) delete b;
+}
+
+MeshBuildBuffers* MeshBufferPool::Acquire() {
+	std::lock_guard<std::mutex> lock{mutex};
+
+	if(available.empty()) {
+		auto buffers = new MeshBuildBuffers{initialQuads};
+		numBuffers++;
+		numBytes += buffers->Size();
+		return buffers;
+	}
+
+	auto buffers = available.back();
+	available.pop_back();
+	return buffers;
+}
+
+void MeshBufferPool::Release(MeshBuildBuffers* buffers) {
+	std::lock_guard<std::mutex> lock{mutex};
+	available.push_back(buffers);
+}
+
+void MeshBufferPool::NotifyGrown(u32 oldSize, u32 newSize) {
+	std::lock_guard<std::mutex> lock{mutex};
+	numBytes += newSize - oldSize;
+}
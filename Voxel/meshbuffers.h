@@ -0,0 +1,43 @@
+#ifndef MESHBUFFERS_H
+#define MESHBUFFERS_H
+
+#include "common.h"
+
+#include <mutex>
+
+// Scratch space for building a mesh in stbvox mode 21 layout
+struct MeshBuildBuffers {
+	u32* vertices; // 4 per quad
+	u32* faces; // 1 per quad
+	u32 maxQuads;
+
+	MeshBuildBuffers(u32 maxQuads);
+	~MeshBuildBuffers();
+
+	// Doubles capacity, keeping the first numQuads quads
+	void Grow(u32 numQuads);
+	u32 Size() const { return maxQuads*5*sizeof(u32); }
+};
+
+// Build buffers are only needed while a mesh is being built, so they are 
+//	shared between chunks. One set of buffers exists per concurrent meshing
+//	job, and buffers that had to grow stay grown.
+struct MeshBufferPool {
+	static constexpr u32 initialQuads = 1<<16; // 1.25MB
+
+	std::mutex mutex;
+	std::vector<MeshBuildBuffers*> available;
+	u32 numBuffers;
+	u64 numBytes;
+
+	MeshBufferPool();
+	~MeshBufferPool();
+
+	MeshBuildBuffers* Acquire();
+	void Release(MeshBuildBuffers*);
+
+	// Call after growing a buffer so numBytes stays correct
+	void NotifyGrown(u32 oldSize, u32 newSize);
+};
+
+#endif
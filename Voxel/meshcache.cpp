@@ -0,0 +1,274 @@
+#include "meshcache.h"
+#include "voxelchunk.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static Log logger{"MeshCache"};
+
+static const char cacheMagic[4] {'V', 'X', 'M', 'C'};
+
+struct CacheHeader {
+	char magic[4];
+	u32 version;
+	u64 key;
+	u32 numQuads;
+	u32 numTransparentQuads;
+	u32 numSlabs;
+};
+
+// Multiply and rotate a word at a time, which is plenty for telling 
+//	chunks apart and quick enough next to meshing them
+static u64 HashBytes(const void* data, u32 size, u64 hash) {
+	const u64 prime = 0x9e3779b97f4a7c15ull;
+	auto bytes = (const u8*)data;
+
+	u32 i = 0;
+	for(; i+8 <= size; i += 8) {
+		u64 word;
+		memcpy(&word, bytes+i, 8);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+
+	for(; i < size; i++) 
+		hash = (hash ^ bytes[i]) * prime;
+
+	return hash ^ (hash >> 32);
+}
+
+MeshCache::MeshCache(const std::string& dir, u64 max) : directory{dir}, maxBytes{max} {
+	numHits = 0;
+	numMisses = 0;
+	numTempFiles = 0;
+	numBytes = 0;
+	numEvicted = 0;
+
+	mkdir(directory.c_str(), 0755);
+	Trim();
+}
+
+u64 MeshCache::Key(const VoxelChunk& chunk, const u8* blocks, const stbvox_rgb* colors, const u8* lighting) {
+	const u32 params[6] {version, chunk.width, chunk.height, chunk.depth, (u32)chunk.meshMethod, lighting != nullptr};
+
+	u64 hash = HashBytes(params, sizeof(params), 0xcbf29ce484222325ull);
+	hash = HashBytes(blocks, chunk.PaddedSize(), hash);
+	hash = HashBytes(colors, chunk.PaddedSize()*sizeof(stbvox_rgb), hash);
+	if(lighting) hash = HashBytes(lighting, chunk.PaddedSize(), hash);
+
+	return hash;
+}
+
+std::string MeshCache::Path(u64 key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.mesh", (unsigned long long)key);
+	return directory + name;
+}
+
+bool MeshCache::Load(u64 key, VoxelChunk* chunk) {
+	auto file = fopen(Path(key).c_str(), "rb");
+	if(!file) {
+		numMisses++;
+		return false;
+	}
+
+	CacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& !memcmp(header.magic, cacheMagic, 4)
+		&& header.version == version 
+		&& header.key == key
+		&& header.numSlabs == chunk->NumSlabs();
+
+	// Every count is checked against what's left of the file before 
+	//	anything is allocated for it, so a damaged file can't ask for more
+	struct stat st;
+	u64 fileSize = (ok && fstat(fileno(file), &st) == 0)? st.st_size : 0;
+	u64 offset = sizeof(header);
+
+	std::vector<u32> slabQuads(ok? header.numSlabs : 0);
+	std::vector<u32> slabTransparentQuads(slabQuads.size());
+	std::vector<AABB> slabBounds(slabQuads.size());
+	std::vector<std::vector<AABB>> slabOccluders(slabQuads.size());
+	u64 totalQuads = 0, totalTransparentQuads = 0;
+
+	for(u32 sl = 0; ok && sl < header.numSlabs; sl++) {
+		u32 numOccluders = 0;
+		ok = fread(&slabQuads[sl], sizeof(u32), 1, file) == 1
+			&& fread(&slabTransparentQuads[sl], sizeof(u32), 1, file) == 1
+			&& fread(&slabBounds[sl], sizeof(AABB), 1, file) == 1
+			&& fread(&numOccluders, sizeof(u32), 1, file) == 1;
+
+		offset += sizeof(u32)*3 + sizeof(AABB);
+		totalQuads += slabQuads[sl];
+		totalTransparentQuads += slabTransparentQuads[sl];
+		if(!ok || !numOccluders) continue;
+
+		u64 occluderBytes = (u64)numOccluders*sizeof(AABB);
+		if(offset > fileSize || occluderBytes > fileSize - offset) {
+			ok = false;
+			break;
+		}
+
+		slabOccluders[sl].resize(numOccluders);
+		ok = fread(slabOccluders[sl].data(), sizeof(AABB), numOccluders, file) == numOccluders;
+		offset += occluderBytes;
+	}
+
+	// The slabs have to add up to the header, and the meshes fill the rest
+	//	of the file exactly, 5 words a quad
+	const u64 quadBytes = sizeof(u32)*5;
+	ok = ok && totalQuads == header.numQuads
+		&& totalTransparentQuads == header.numTransparentQuads
+		&& offset + ((u64)header.numQuads + header.numTransparentQuads)*quadBytes == fileSize;
+
+	u32* vertices = nullptr;
+	u32* faces = nullptr;
+	std::vector<u32> transparentVertices, transparentFaces;
+
+	if(ok) {
+		u32 numTransparent = header.numTransparentQuads;
+		vertices = new u32[(size_t)header.numQuads*4];
+		faces = new u32[header.numQuads];
+		transparentVertices.resize((size_t)numTransparent*4);
+		transparentFaces.resize(numTransparent);
+
+		ok = fread(vertices, sizeof(u32)*4, header.numQuads, file) == header.numQuads
+			&& fread(faces, sizeof(u32), header.numQuads, file) == header.numQuads
+			&& fread(transparentVertices.data(), sizeof(u32)*4, numTransparent, file) == numTransparent
+			&& fread(transparentFaces.data(), sizeof(u32), numTransparent, file) == numTransparent;
+	}
+
+	// Marks it recently used for Trim
+	if(ok) futimens(fileno(file), nullptr);
+	fclose(file);
+
+	if(!ok) {
+		logger << "Ignoring bad cache file " << Path(key);
+		delete[] vertices;
+		delete[] faces;
+		numMisses++;
+		return false;
+	}
+
+	delete[] chunk->vertexData;
+	delete[] chunk->faceData;
+	chunk->vertexData = vertices;
+	chunk->faceData = faces;
+	chunk->numBuiltQuads = header.numQuads;
+	chunk->builtSlabQuads = std::move(slabQuads);
+	chunk->builtSlabBounds = std::move(slabBounds);
+	chunk->builtSlabOccluders = std::move(slabOccluders);
+	chunk->builtSlabTransparentQuads = std::move(slabTransparentQuads);
+	chunk->builtTransparentVertices = std::move(transparentVertices);
+	chunk->builtTransparentFaces = std::move(transparentFaces);
+
+	numHits++;
+	return true;
+}
+
+void MeshCache::Store(u64 key, const VoxelChunk& chunk) {
+	CacheHeader header;
+	memcpy(header.magic, cacheMagic, 4);
+	header.version = version;
+	header.key = key;
+	header.numQuads = chunk.numBuiltQuads;
+	header.numTransparentQuads = chunk.builtTransparentFaces.size();
+	header.numSlabs = chunk.builtSlabQuads.size();
+
+	// Written aside then renamed into place, so a reader never sees half a file
+	std::string path = Path(key);
+	std::string tempPath = path + ".tmp" + std::to_string(numTempFiles++);
+
+	auto file = fopen(tempPath.c_str(), "wb");
+	if(!file) {
+		logger << "Couldn't write " << tempPath;
+		return;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	for(u32 sl = 0; ok && sl < header.numSlabs; sl++) {
+		auto& occluders = chunk.builtSlabOccluders[sl];
+		u32 numOccluders = occluders.size();
+
+		ok = fwrite(&chunk.builtSlabQuads[sl], sizeof(u32), 1, file) == 1
+			&& fwrite(&chunk.builtSlabTransparentQuads[sl], sizeof(u32), 1, file) == 1
+			&& fwrite(&chunk.builtSlabBounds[sl], sizeof(AABB), 1, file) == 1
+			&& fwrite(&numOccluders, sizeof(u32), 1, file) == 1
+			&& fwrite(occluders.data(), sizeof(AABB), numOccluders, file) == numOccluders;
+	}
+
+	ok = ok && fwrite(chunk.vertexData, sizeof(u32)*4, header.numQuads, file) == header.numQuads
+		&& fwrite(chunk.faceData, sizeof(u32), header.numQuads, file) == header.numQuads
+		&& fwrite(chunk.builtTransparentVertices.data(), sizeof(u32)*4, header.numTransparentQuads, file) == header.numTransparentQuads
+		&& fwrite(chunk.builtTransparentFaces.data(), sizeof(u32), header.numTransparentQuads, file) == header.numTransparentQuads;
+
+	long fileSize = ftell(file);
+	ok = (fclose(file) == 0) && ok;
+
+	if(!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+		logger << "Couldn't write " << path;
+		remove(tempPath.c_str());
+		return;
+	}
+
+	if(maxBytes && (numBytes += fileSize) > maxBytes) Trim();
+}
+
+void MeshCache::Trim() {
+	if(!maxBytes) return;
+
+	std::unique_lock<std::mutex> lock{trimMutex, std::try_to_lock};
+	if(!lock.owns_lock()) return;
+
+	auto dir = opendir(directory.c_str());
+	if(!dir) return;
+
+	// Temp files are left alone, they're still being written
+	struct CacheFile {
+		std::string path;
+		timespec used;
+		u64 size;
+	};
+
+	std::vector<CacheFile> files;
+	u64 total = 0;
+
+	while(auto entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if(name.size() < 5 || name.compare(name.size()-5, 5, ".mesh")) continue;
+
+		std::string path = directory + "/" + name;
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+		files.push_back(CacheFile{path, st.st_mtim, (u64)st.st_size});
+		total += st.st_size;
+	}
+
+	closedir(dir);
+
+	if(total > maxBytes) {
+		std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+			if(a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+			return a.used.tv_nsec < b.used.tv_nsec;
+		});
+
+		u64 target = maxBytes/4*3;
+		u32 numRemoved = 0;
+		for(auto& file: files) {
+			if(total <= target) break;
+			if(unlink(file.path.c_str()) != 0) continue;
+
+			total -= file.size;
+			numRemoved++;
+		}
+
+		numEvicted += numRemoved;
+		logger << "Evicted " << numRemoved << " files, " << (total>>10) << "KB left";
+	}
+
+	numBytes = total;
+}
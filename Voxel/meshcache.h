@@ -0,0 +1,60 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "common.h"
+#include "stb_voxel_render.h"
+
+#include <atomic>
+#include <mutex>
+
+struct VoxelChunk;
+
+// Built meshes saved to disk, one file per mesh, named by a hash of 
+//	everything that goes into meshing a chunk: its blocks and colors 
+//	including the borders copied from its neighbours, its lighting, its
+//	dimensions and the mesh method.
+// Only full rebuilds are cached since partial ones depend on the slabs 
+//	already uploaded. Safe to use from mesh worker threads
+struct MeshCache {
+	// Part of every key, so bumping it misses every file already written.
+	//	The rest of the key is the inputs listed above, so anything else that
+	//	changes what BuildMesh produces from the same inputs has to bump it:
+	//	- stbvox, greedy or binary greedy output, vertex or face encoding
+	//	- the block tables: blockGeometry, blockLight, and blockMesh, which 
+	//	  splits quads into the opaque and transparent meshes
+	//	- slabWidth, and how quads are grouped into slabs
+	//	- occluder finding, or how slab bounds are measured
+	//	- the file layout Store writes
+	// CopyLighting's curve doesn't need it since its output is what's hashed,
+	//	and instance records are made from the vertices after the cache
+	static constexpr u32 version = 2;
+
+	std::string directory;
+	std::atomic<u64> numHits;
+	std::atomic<u64> numMisses;
+	std::atomic<u32> numTempFiles;
+
+	// Once the files add up to more than maxBytes, the least recently used
+	//	are deleted until they're under 3/4 of it. A hit touches its file, 
+	//	so that's the oldest modified. Trimmed when the cache is created and
+	//	whenever Store takes it over the cap. 0 for no limit
+	u64 maxBytes;
+	std::atomic<u64> numBytes; // Counted by the last trim, plus stored since
+	std::atomic<u64> numEvicted;
+	std::mutex trimMutex;
+
+	MeshCache(const std::string& directory, u64 maxBytes = 256ull<<20);
+
+	static u64 Key(const VoxelChunk&, const u8* blocks, const stbvox_rgb* colors, const u8* lighting);
+
+	// Fills the chunk's built mesh, as BuildMesh would have, on a hit
+	bool Load(u64 key, VoxelChunk*);
+	void Store(u64 key, const VoxelChunk&);
+
+	// Skipped if another thread is already trimming
+	void Trim();
+
+	std::string Path(u64 key) const;
+};
+
+#endif
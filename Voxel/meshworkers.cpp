@@ -0,0 +1,135 @@
+#include "meshworkers.h"
+#include "voxelchunk.h"
+#include "uploadscheduler.h"
+
+MeshWorkerPool::MeshWorkerPool(u32 numThreads) {
+	quit = false;
+	numInFlight = 0;
+	numCompleted = 0;
+
+	if(!numThreads) {
+		numThreads = std::thread::hardware_concurrency();
+		numThreads = std::max(numThreads, 2u) - 1;
+	}
+
+	for(u32 i = 0; i < numThreads; i++)
+		threads.emplace_back(&MeshWorkerPool::WorkerLoop, this);
+}
+
+MeshWorkerPool::~MeshWorkerPool() {
+	{	std::lock_guard<std::mutex> lock{mutex};
+		quit = true;
+	}
+
+	jobAvailable.notify_all();
+	for(auto& t: threads) t.join();
+
+	// These never got uploaded so they need building again
+	for(auto& job: pending) {
+		job.chunk->meshing = false;
+		job.chunk->Invalidate();
+		delete[] job.blockData;
+		delete[] job.colorData;
+		delete[] job.lighting;
+	}
+
+	for(auto& job: completed) {
+		job.chunk->meshing = false;
+		job.chunk->Invalidate();
+		delete[] job.blockData;
+		delete[] job.colorData;
+		delete[] job.lighting;
+	}
+}
+
+bool MeshWorkerPool::Submit(VoxelChunk* chunk) {
+	if(chunk->meshing) return false;
+
+	chunk->BeginBuild();
+
+	Job job;
+	job.chunk = chunk;
+	job.version = chunk->Snapshot();
+	job.blockData = nullptr;
+	job.colorData = nullptr;
+
+	for(u32 face = 0; face < 6; face++)
+		if(chunk->BorderUsable(face)) job.neighbours[face] = chunk->neighbours[face]->Snapshot();
+
+	job.lighting = nullptr;
+	if(chunk->lightData) {
+		job.lighting = new u8[chunk->PaddedSize()];
+		chunk->CopyLighting(job.lighting);
+	}
+
+	chunk->meshing = true;
+	numInFlight++;
+
+	{	std::lock_guard<std::mutex> lock{mutex};
+		pending.push_back(job);
+	}
+
+	jobAvailable.notify_one();
+	return true;
+}
+
+void MeshWorkerPool::Update(UploadScheduler* uploads) {
+	std::deque<Job> finished;
+
+	{	std::lock_guard<std::mutex> lock{mutex};
+		std::swap(finished, completed);
+	}
+
+	for(auto& job: finished) {
+		if(uploads) {
+			uploads->Add(job.chunk);
+		}else{
+			job.chunk->UploadMesh();
+			job.chunk->meshing = false;
+		}
+
+		numInFlight--;
+
+		delete[] job.blockData;
+		delete[] job.colorData;
+		delete[] job.lighting;
+	}
+}
+
+void MeshWorkerPool::Finish(UploadScheduler* uploads) {
+	{	std::unique_lock<std::mutex> lock{mutex};
+		jobFinished.wait(lock, [this] {
+			return completed.size() == numInFlight;
+		});
+	}
+
+	Update(uploads);
+}
+
+void MeshWorkerPool::WorkerLoop() {
+	while(true) {
+		Job job;
+
+		{	std::unique_lock<std::mutex> lock{mutex};
+			jobAvailable.wait(lock, [this] { return quit || !pending.empty(); });
+			if(quit) return;
+
+			job = pending.front();
+			pending.pop_front();
+		}
+
+		job.blockData = new u8[job.chunk->PaddedSize()];
+		job.colorData = new stbvox_rgb[job.chunk->PaddedSize()];
+		job.version->Unpack(job.blockData, job.colorData);
+		job.version->CopyBorders(job.blockData, job.neighbours);
+
+		job.chunk->BuildMesh(job.blockData, job.colorData, job.lighting, &job.version->occupancy);
+		numCompleted++;
+
+		{	std::lock_guard<std::mutex> lock{mutex};
+			completed.push_back(job);
+		}
+
+		jobFinished.notify_all();
+	}
+}
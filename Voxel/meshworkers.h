@@ -0,0 +1,64 @@
+#ifndef MESHWORKERS_H
+#define MESHWORKERS_H
+
+#include "common.h"
+#include "stb_voxel_render.h"
+#include "chunkversion.h"
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+struct VoxelChunk;
+struct UploadScheduler;
+
+// Runs VoxelChunk::BuildMesh on worker threads. Jobs mesh a ChunkVersion 
+//	of the chunk and its neighbours, so the chunk can still be edited while 
+//	they run and submitting only copies the bricks edited since the last 
+//	job. The GL upload happens on the render thread in Update.
+// A chunk keeps drawing its previous mesh until its job has been uploaded
+struct MeshWorkerPool {
+	struct Job {
+		VoxelChunk* chunk;
+		std::shared_ptr<const ChunkVersion> version;
+		std::shared_ptr<const ChunkVersion> neighbours[6]; // Null where the border is left empty
+
+		// Unpacked from the versions by the worker
+		u8* blockData;
+		stbvox_rgb* colorData;
+		u8* lighting; // Null if the chunk is unlit
+	};
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+
+	std::deque<Job> pending;
+	std::deque<Job> completed;
+	bool quit;
+
+	std::atomic<u32> numInFlight; // Submitted but not yet uploaded or queued
+	std::atomic<u64> numCompleted;
+
+	// Defaults to one less than the number of hardware threads
+	MeshWorkerPool(u32 numThreads = 0);
+	~MeshWorkerPool();
+
+	// Takes the chunk's dirty region with BeginBuild.
+	// Returns false if the chunk already has a job in flight
+	bool Submit(VoxelChunk*);
+
+	// Uploads finished meshes, or queues them on uploads if set. Must be
+	//	called from the thread owning the GL context
+	void Update(UploadScheduler* uploads = nullptr);
+
+	// Blocks until every submitted job has finished, then uploads them
+	void Finish(UploadScheduler* uploads = nullptr);
+
+	void WorkerLoop();
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include "noise.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_AVX2
+#include <immintrin.h>
+#endif
+
+GradientNoise::GradientNoise(u32 seed) {
+	for(u32 i = 0; i < 256; i++) perm[i] = i;
+
+	// Fisher-Yates with a fixed generator, since std::shuffle can differ between libraries
+	u32 state = seed*2654435761u + 1;
+	for(u32 i = 255; i > 0; i--) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		std::swap(perm[i], perm[state % (i+1)]);
+	}
+
+	for(u32 i = 0; i < 256; i++) perm[i+256] = perm[i];
+
+	useAVX2 = HasAVX2();
+}
+
+bool GradientNoise::HasAVX2() {
+#ifdef NOISE_AVX2
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+static f32 Fade(f32 t) {
+	return t*t*t*(t*(t*6.f - 15.f) + 10.f);
+}
+
+static f32 Lerp(f32 t, f32 a, f32 b) {
+	return a + t*(b - a);
+}
+
+static f32 Grad(s32 hash, f32 x, f32 y, f32 z) {
+	s32 h = hash & 15;
+	f32 u = (h < 8)? x : y;
+	f32 v = (h < 4)? y : ((h == 12 || h == 14)? x : z);
+	return ((h & 1)? -u : u) + ((h & 2)? -v : v);
+}
+
+f32 GradientNoise::Sample(const vec3& pos) const {
+	f32 fx = std::floor(pos.x);
+	f32 fy = std::floor(pos.y);
+	f32 fz = std::floor(pos.z);
+
+	s32 X = (s32)fx & 255;
+	s32 Y = (s32)fy & 255;
+	s32 Z = (s32)fz & 255;
+
+	f32 x = pos.x - fx;
+	f32 y = pos.y - fy;
+	f32 z = pos.z - fz;
+
+	f32 u = Fade(x);
+	f32 v = Fade(y);
+	f32 w = Fade(z);
+
+	s32 A = perm[X] + Y;
+	s32 AA = perm[A] + Z;
+	s32 AB = perm[A+1] + Z;
+	s32 B = perm[X+1] + Y;
+	s32 BA = perm[B] + Z;
+	s32 BB = perm[B+1] + Z;
+
+	f32 x1 = x - 1.f, y1 = y - 1.f, z1 = z - 1.f;
+
+	return Lerp(w, 
+		Lerp(v, Lerp(u, Grad(perm[AA], x, y, z), Grad(perm[BA], x1, y, z)), 
+			Lerp(u, Grad(perm[AB], x, y1, z), Grad(perm[BB], x1, y1, z))),
+		Lerp(v, Lerp(u, Grad(perm[AA+1], x, y, z1), Grad(perm[BA+1], x1, y, z1)), 
+			Lerp(u, Grad(perm[AB+1], x, y1, z1), Grad(perm[BB+1], x1, y1, z1))));
+}
+
+#ifdef NOISE_AVX2
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256 Fade8(__m256 t) {
+	__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, 
+		_mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.f)), _mm256_set1_ps(15.f))), _mm256_set1_ps(10.f));
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+AVX2 static inline __m256 Lerp8(__m256 t, __m256 a, __m256 b) {
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// Negating by flipping the sign bit matches scalar negation exactly
+AVX2 static inline __m256 Grad8(__m256i hash, __m256 x, __m256 y, __m256 z) {
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+
+	__m256 below8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+	__m256 below4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+	__m256 is12or14 = _mm256_castsi256_ps(_mm256_or_si256(
+		_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+
+	__m256 u = _mm256_blendv_ps(y, x, below8);
+	__m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, is12or14), y, below4);
+
+	__m256 signU = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+	__m256 signV = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+
+	return _mm256_add_ps(_mm256_xor_ps(u, signU), _mm256_xor_ps(v, signV));
+}
+
+AVX2 static inline __m256i Perm8(const s32* perm, __m256i i) {
+	return _mm256_i32gather_epi32(perm, i, 4);
+}
+
+// Returns how many samples it did, always a multiple of 8
+AVX2 static u32 SampleRowAVX2(const s32* perm, const vec3& start, const vec3& step, u32 n, f32* out) {
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i mask = _mm256_set1_epi32(255);
+	const __m256 onef = _mm256_set1_ps(1.f);
+
+	u32 i = 0;
+	for(; i+8 <= n; i += 8) {
+		__m256 fi = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes));
+		__m256 px = _mm256_add_ps(_mm256_set1_ps(start.x), _mm256_mul_ps(_mm256_set1_ps(step.x), fi));
+		__m256 py = _mm256_add_ps(_mm256_set1_ps(start.y), _mm256_mul_ps(_mm256_set1_ps(step.y), fi));
+		__m256 pz = _mm256_add_ps(_mm256_set1_ps(start.z), _mm256_mul_ps(_mm256_set1_ps(step.z), fi));
+
+		__m256 fx = _mm256_floor_ps(px);
+		__m256 fy = _mm256_floor_ps(py);
+		__m256 fz = _mm256_floor_ps(pz);
+
+		__m256i X = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+		__m256i Y = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+		__m256i Z = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+		__m256 x = _mm256_sub_ps(px, fx);
+		__m256 y = _mm256_sub_ps(py, fy);
+		__m256 z = _mm256_sub_ps(pz, fz);
+
+		__m256 u = Fade8(x);
+		__m256 v = Fade8(y);
+		__m256 w = Fade8(z);
+
+		__m256i A = _mm256_add_epi32(Perm8(perm, X), Y);
+		__m256i AA = _mm256_add_epi32(Perm8(perm, A), Z);
+		__m256i AB = _mm256_add_epi32(Perm8(perm, _mm256_add_epi32(A, one)), Z);
+		__m256i B = _mm256_add_epi32(Perm8(perm, _mm256_add_epi32(X, one)), Y);
+		__m256i BA = _mm256_add_epi32(Perm8(perm, B), Z);
+		__m256i BB = _mm256_add_epi32(Perm8(perm, _mm256_add_epi32(B, one)), Z);
+
+		__m256 x1 = _mm256_sub_ps(x, onef);
+		__m256 y1 = _mm256_sub_ps(y, onef);
+		__m256 z1 = _mm256_sub_ps(z, onef);
+
+		__m256 result = Lerp8(w, 
+			Lerp8(v, Lerp8(u, Grad8(Perm8(perm, AA), x, y, z), Grad8(Perm8(perm, BA), x1, y, z)), 
+				Lerp8(u, Grad8(Perm8(perm, AB), x, y1, z), Grad8(Perm8(perm, BB), x1, y1, z))),
+			Lerp8(v, Lerp8(u, Grad8(Perm8(perm, _mm256_add_epi32(AA, one)), x, y, z1), 
+					Grad8(Perm8(perm, _mm256_add_epi32(BA, one)), x1, y, z1)), 
+				Lerp8(u, Grad8(Perm8(perm, _mm256_add_epi32(AB, one)), x, y1, z1), 
+					Grad8(Perm8(perm, _mm256_add_epi32(BB, one)), x1, y1, z1))));
+
+		_mm256_storeu_ps(out + i, result);
+	}
+
+	return i;
+}
+#endif
+
+void GradientNoise::SampleRow(const vec3& start, const vec3& step, u32 n, f32* out) const {
+	u32 i = 0;
+
+#ifdef NOISE_AVX2
+	if(useAVX2) i = SampleRowAVX2(perm, start, step, n, out);
+#endif
+
+	for(; i < n; i++) {
+		f32 fi = (f32)i;
+		out[i] = Sample(vec3{start.x + step.x*fi, start.y + step.y*fi, start.z + step.z*fi});
+	}
+}
+
+void GradientNoise::FractalRow(const vec3& start, const vec3& step, u32 n, u32 octaves, f32* out) const {
+	std::vector<f32> octave(n);
+	std::fill_n(out, n, 0.f);
+
+	f32 frequency = 1.f;
+	f32 amplitude = 1.f;
+	f32 total = 0.f;
+
+	for(u32 o = 0; o < octaves; o++) {
+		// Offset each octave so they don't all line up at the origin
+		vec3 offset {o*31.7f, o*17.3f, o*7.1f};
+		SampleRow(start*frequency + offset, step*frequency, n, octave.data());
+
+		for(u32 i = 0; i < n; i++) out[i] += octave[i]*amplitude;
+
+		total += amplitude;
+		frequency *= 2.f;
+		amplitude *= 0.5f;
+	}
+
+	for(u32 i = 0; i < n; i++) out[i] /= total;
+}
@@ -0,0 +1,29 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include "common.h"
+
+// Seeded 3D gradient noise, Perlin's improved noise with its own permutation.
+//	Output is roughly -1 to 1.
+// Rows of samples are evaluated 8 at a time with AVX2 when the cpu has it.
+//	Both paths do the same float operations in the same order so results
+//	are identical either way, and the same everywhere for a given seed
+struct GradientNoise {
+	s32 perm[512]; // Twice over so lookups don't need wrapping
+	bool useAVX2;
+
+	GradientNoise(u32 seed);
+
+	static bool HasAVX2();
+
+	f32 Sample(const vec3&) const;
+
+	// n samples at start + step*i
+	void SampleRow(const vec3& start, const vec3& step, u32 n, f32* out) const;
+
+	// Octaves of SampleRow at doubling frequency and halving amplitude, 
+	//	normalised back to roughly -1 to 1
+	void FractalRow(const vec3& start, const vec3& step, u32 n, u32 octaves, f32* out) const;
+};
+
+#endif
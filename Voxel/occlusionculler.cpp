@@ -0,0 +1,281 @@
+#include "occlusionculler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Corners are indexed by bits, x is 1, y is 2, z is 4
+static const u8 boxTriangles[12][3] {
+	{0,2,3}, {0,3,1}, // -z
+	{4,5,7}, {4,7,6}, // +z
+	{0,1,5}, {0,5,4}, // -y
+	{2,6,7}, {2,7,3}, // +y
+	{0,4,6}, {0,6,2}, // -x
+	{1,3,7}, {1,7,5}, // +x
+};
+
+OcclusionCuller::OcclusionCuller(u32 w, u32 h, u32 numThreads) {
+	width = (w+3) & ~3u;
+	height = h;
+
+	for(u32 lw = width, lh = height; ; lw = (lw+1)/2, lh = (lh+1)/2) {
+		levels.emplace_back(lw*lh, 0.f);
+		if(lw == 1 && lh == 1) break;
+	}
+
+	viewProjection = mat4(1.f);
+	numOccluders = 0;
+	numTrianglesDrawn = 0;
+
+	generation = 0;
+	numBusy = 0;
+	quit = false;
+
+	if(!numThreads)
+		numThreads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 4u);
+
+	for(u32 i = 1; i < numThreads; i++)
+		threads.emplace_back(&OcclusionCuller::WorkerLoop, this, i);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+	{	std::lock_guard<std::mutex> lock{mutex};
+		quit = true;
+	}
+
+	workAvailable.notify_all();
+	for(auto& t: threads) t.join();
+}
+
+void OcclusionCuller::Begin(const mat4& vp) {
+	viewProjection = vp;
+	vertices.clear();
+	numOccluders = 0;
+	numTrianglesDrawn = 0;
+}
+
+OcclusionCuller::Vertex OcclusionCuller::Project(const vec3& p) const {
+	vec4 clip = viewProjection * vec4{p, 1.f};
+
+	Vertex v;
+	v.clipped = clip.w < 1e-5f;
+	if(v.clipped) return v;
+
+	v.invW = 1.f / clip.w;
+	v.x = (clip.x * v.invW * 0.5f + 0.5f) * width;
+	v.y = (clip.y * v.invW * 0.5f + 0.5f) * height;
+	return v;
+}
+
+void OcclusionCuller::AddOccluder(const AABB& b) {
+	if(b.Empty()) return;
+
+	for(u32 i = 0; i < 8; i++) {
+		vertices.push_back(Project(vec3{
+			(i&1)? b.max.x : b.min.x,
+			(i&2)? b.max.y : b.min.y,
+			(i&4)? b.max.z : b.min.z,
+		}));
+	}
+
+	numOccluders++;
+}
+
+void OcclusionCuller::Rasterise() {
+	{	std::lock_guard<std::mutex> lock{mutex};
+		generation++;
+		numBusy = threads.size();
+	}
+
+	workAvailable.notify_all();
+	RasteriseBand(0, height / NumBands());
+
+	{	std::unique_lock<std::mutex> lock{mutex};
+		workFinished.wait(lock, [this] { return numBusy == 0; });
+	}
+
+	// Each texel keeps the furthest depth of the four below it. Odd 
+	//	sizes clamp, which only ever makes the result further
+	for(u32 l = 1; l < levels.size(); l++) {
+		u32 pw = (width + (1u<<(l-1)) - 1) >> (l-1);
+		u32 ph = (height + (1u<<(l-1)) - 1) >> (l-1);
+		u32 lw = (pw+1)/2;
+		u32 lh = (ph+1)/2;
+
+		auto& prev = levels[l-1];
+		auto& level = levels[l];
+
+		for(u32 y = 0; y < lh; y++)
+		for(u32 x = 0; x < lw; x++) {
+			u32 x0 = x*2, x1 = std::min(x*2+1, pw-1);
+			u32 y0 = y*2, y1 = std::min(y*2+1, ph-1);
+
+			level[x + y*lw] = std::min(
+				std::min(prev[x0 + y0*pw], prev[x1 + y0*pw]),
+				std::min(prev[x0 + y1*pw], prev[x1 + y1*pw]));
+		}
+	}
+}
+
+void OcclusionCuller::WorkerLoop(u32 band) {
+	u32 lastGeneration = 0;
+
+	while(true) {
+		{	std::unique_lock<std::mutex> lock{mutex};
+			workAvailable.wait(lock, [&] { return quit || generation != lastGeneration; });
+			if(quit) return;
+			lastGeneration = generation;
+		}
+
+		u32 y0 = height * band / NumBands();
+		u32 y1 = height * (band+1) / NumBands();
+		RasteriseBand(y0, y1);
+
+		{	std::lock_guard<std::mutex> lock{mutex};
+			numBusy--;
+		}
+
+		workFinished.notify_one();
+	}
+}
+
+void OcclusionCuller::RasteriseBand(u32 y0, u32 y1) {
+	auto& depth = levels[0];
+	std::fill(depth.begin() + y0*width, depth.begin() + y1*width, 0.f);
+
+	u32 numTriangles = 0;
+
+	for(u32 o = 0; o < vertices.size(); o += 8) {
+		auto corners = &vertices[o];
+
+		for(auto& tri: boxTriangles) {
+			auto& a = corners[tri[0]];
+			auto& b = corners[tri[1]];
+			auto& c = corners[tri[2]];
+
+			// Dropping an occluder is always safe, so there's no clipping
+			if(a.clipped || b.clipped || c.clipped) continue;
+
+			RasteriseTriangle(a, b, c, y0, y1);
+			numTriangles++;
+		}
+	}
+
+	if(y0 == 0) numTrianglesDrawn = numTriangles;
+}
+
+void OcclusionCuller::RasteriseTriangle(const Vertex& a, const Vertex& b, const Vertex& c, u32 by0, u32 by1) {
+	f32 area = (b.x-a.x)*(c.y-a.y) - (b.y-a.y)*(c.x-a.x);
+
+	// Back faces are always behind the front faces of the same box
+	if(area <= 0.f) return;
+
+	f32 fx0 = std::min(std::min(a.x, b.x), c.x);
+	f32 fx1 = std::max(std::max(a.x, b.x), c.x);
+	f32 fy0 = std::min(std::min(a.y, b.y), c.y);
+	f32 fy1 = std::max(std::max(a.y, b.y), c.y);
+
+	s32 x0 = std::max((s32)std::floor(fx0), 0) & ~3;
+	s32 x1 = std::min((s32)std::ceil(fx1), (s32)width);
+	s32 y0 = std::max((s32)std::floor(fy0), (s32)by0);
+	s32 y1 = std::min((s32)std::ceil(fy1), (s32)by1);
+	if(x0 >= x1 || y0 >= y1) return;
+
+	// Edge functions, positive inside. e(x,y) = ex*x + ey*y + e0
+	f32 ex[3] { a.y-b.y, b.y-c.y, c.y-a.y };
+	f32 ey[3] { b.x-a.x, c.x-b.x, a.x-c.x };
+	f32 e0[3] {
+		a.x*b.y - a.y*b.x,
+		b.x*c.y - b.y*c.x,
+		c.x*a.y - c.y*a.x,
+	};
+
+	// 1/w as a plane over the screen, from the barycentrics of each vertex
+	f32 zx = (ex[1]*a.invW + ex[2]*b.invW + ex[0]*c.invW) / area;
+	f32 zy = (ey[1]*a.invW + ey[2]*b.invW + ey[0]*c.invW) / area;
+	f32 z0 = (e0[1]*a.invW + e0[2]*b.invW + e0[0]*c.invW) / area;
+
+	auto& depth = levels[0];
+
+	for(s32 y = y0; y < y1; y++) {
+		f32 py = y + 0.5f;
+		f32* row = &depth[y*width];
+
+#ifdef __SSE2__
+		__m128 step = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 zero = _mm_setzero_ps();
+
+		for(s32 x = x0; x < x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((f32)x), step);
+
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(ex[0])), _mm_set1_ps(ey[0]*py + e0[0])), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(ex[1])), _mm_set1_ps(ey[1]*py + e0[1])), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(ex[2])), _mm_set1_ps(ey[2]*py + e0[2])), zero));
+			if(!_mm_movemask_ps(inside)) continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(zx)), _mm_set1_ps(zy*py + z0));
+			__m128 old = _mm_loadu_ps(row + x);
+			__m128 nearest = _mm_max_ps(old, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+		}
+#else
+		for(s32 x = x0; x < x1; x++) {
+			f32 px = x + 0.5f;
+			if(ex[0]*px + ey[0]*py + e0[0] < 0.f) continue;
+			if(ex[1]*px + ey[1]*py + e0[1] < 0.f) continue;
+			if(ex[2]*px + ey[2]*py + e0[2] < 0.f) continue;
+
+			row[x] = std::max(row[x], zx*px + zy*py + z0);
+		}
+#endif
+	}
+}
+
+bool OcclusionCuller::IsOccluded(const AABB& b) const {
+	if(b.Empty()) return true;
+
+	f32 fx0 = 1e30f, fx1 = -1e30f;
+	f32 fy0 = 1e30f, fy1 = -1e30f;
+	f32 nearest = 0.f;
+
+	for(u32 i = 0; i < 8; i++) {
+		auto v = Project(vec3{
+			(i&1)? b.max.x : b.min.x,
+			(i&2)? b.max.y : b.min.y,
+			(i&4)? b.max.z : b.min.z,
+		});
+
+		// Crossing the near plane means it's right in front of the camera
+		if(v.clipped) return false;
+
+		fx0 = std::min(fx0, v.x);
+		fx1 = std::max(fx1, v.x);
+		fy0 = std::min(fy0, v.y);
+		fy1 = std::max(fy1, v.y);
+		nearest = std::max(nearest, v.invW);
+	}
+
+	s32 x0 = std::max((s32)std::floor(fx0), 0);
+	s32 x1 = std::min((s32)std::ceil(fx1), (s32)width) - 1;
+	s32 y0 = std::max((s32)std::floor(fy0), 0);
+	s32 y1 = std::min((s32)std::ceil(fy1), (s32)height) - 1;
+
+	// Off screen, which is the frustum's problem
+	if(x0 > x1 || y0 > y1) return false;
+
+	// The level where the rect spans at most two texels each way
+	u32 l = 0;
+	while(l+1 < levels.size() && ((x1>>l) - (x0>>l) > 1 || (y1>>l) - (y0>>l) > 1))
+		l++;
+
+	auto& level = levels[l];
+	u32 lw = (width + (1u<<l) - 1) >> l;
+
+	for(s32 y = y0>>l; y <= y1>>l; y++)
+	for(s32 x = x0>>l; x <= x1>>l; x++) {
+		if(nearest >= level[x + y*lw])
+			return false;
+	}
+
+	return true;
+}
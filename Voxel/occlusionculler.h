@@ -0,0 +1,60 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "common.h"
+#include "frustum.h"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Software occlusion culling against a low resolution depth buffer.
+//	Occluder boxes are rasterised in horizontal bands, one per thread, 
+//	then reduced into a pyramid of the furthest depth in each texel so
+//	that bounds can be tested against a handful of texels.
+// Depth is stored as 1/w, which is linear in screen space and keeps its
+//	precision far away. Larger is nearer, 0 is nothing drawn.
+// Coverage is sampled at texel centres, so things peeking through gaps 
+//	narrower than a texel can be culled
+struct OcclusionCuller {
+	struct Vertex {
+		f32 x, y; // Depth buffer texels
+		f32 invW;
+		bool clipped; // Behind the near plane
+	};
+
+	u32 width, height; // Rounded up to a multiple of 4 wide
+	std::vector<std::vector<f32>> levels; // levels[0] is the depth buffer
+
+	mat4 viewProjection;
+	std::vector<Vertex> vertices; // 8 per occluder
+	u32 numOccluders;
+	u32 numTrianglesDrawn;
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workFinished;
+	u32 generation;
+	u32 numBusy;
+	bool quit;
+
+	// numThreads includes the calling thread, 0 picks from hardware threads
+	OcclusionCuller(u32 width, u32 height, u32 numThreads = 0);
+	~OcclusionCuller();
+
+	void Begin(const mat4& viewProjection);
+	void AddOccluder(const AABB&); // Should be fully solid
+	void Rasterise(); // Draws occluders and builds the pyramid
+
+	bool IsOccluded(const AABB&) const;
+	f32 DepthAt(u32 x, u32 y) const { return levels[0][x + y*width]; }
+
+	Vertex Project(const vec3&) const;
+	void RasteriseBand(u32 y0, u32 y1);
+	void RasteriseTriangle(const Vertex&, const Vertex&, const Vertex&, u32 y0, u32 y1);
+	void WorkerLoop(u32 band);
+	u32 NumBands() const { return threads.size()+1; }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "occupancy.h"
+#include "voxelchunk.h"
+
+constexpr u32 Occupancy::maxColumnWords;
+
+Occupancy::Occupancy() {
+	width = height = depth = 0;
+	columnWords = 0;
+	numOccupied = numSolid = 0;
+}
+
+void Occupancy::Resize(u32 w, u32 h, u32 d) {
+	width = w;
+	height = h;
+	depth = d;
+	columnWords = (d + 63)/64;
+	occupied.assign(w*h*columnWords, 0);
+	solid.assign(w*h*columnWords, 0);
+	numOccupied = numSolid = 0;
+}
+
+void Occupancy::Update(const u8* blocks, u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) {
+	x1 = std::min(x1, width);
+	y1 = std::min(y1, height);
+	z1 = std::min(z1, depth);
+	if(x0 >= x1 || y0 >= y1 || z0 >= z1) return;
+
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	for(u32 x = x0; x < x1; x++)
+	for(u32 y = y0; y < y1; y++) {
+		auto column = &blocks[1 + (y+1)*yStride + (x+1)*xStride];
+		u32 ci = ColumnIndex(x,y);
+
+		for(u32 w = z0/64; w*64 < z1; w++) {
+			u64 range = RangeBits(w, z0, z1);
+			u64 occ = 0, sol = 0;
+
+			for(u32 z = std::max(z0, w*64); z < std::min(z1, w*64 + 64); z++) {
+				u8 block = column[z];
+				occ |= (u64)(block != 0) << (z&63);
+				sol |= (u64)VoxelChunk::IsSolidCube(block) << (z&63);
+			}
+
+			numOccupied -= __builtin_popcountll(occupied[ci+w] & range);
+			numSolid -= __builtin_popcountll(solid[ci+w] & range);
+			occupied[ci+w] = (occupied[ci+w] & ~range) | occ;
+			solid[ci+w] = (solid[ci+w] & ~range) | sol;
+			numOccupied += __builtin_popcountll(occ);
+			numSolid += __builtin_popcountll(sol);
+		}
+	}
+}
+
+bool Occupancy::AnyOccupied(u32 x0, u32 x1) const {
+	x1 = std::min(x1, width);
+	if(x0 >= x1) return false;
+
+	for(u32 i = ColumnIndex(x0, 0); i < ColumnIndex(x1, 0); i++)
+		if(occupied[i]) return true;
+
+	return false;
+}
+
+bool Occupancy::AnyNonCube(u32 x0, u32 x1) const {
+	x1 = std::min(x1, width);
+	if(x0 >= x1) return false;
+
+	for(u32 i = ColumnIndex(x0, 0); i < ColumnIndex(x1, 0); i++)
+		if(occupied[i] & ~solid[i]) return true;
+
+	return false;
+}
+
+bool Occupancy::BoxSolid(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) const {
+	for(u32 x = x0; x < x1; x++)
+	for(u32 y = y0; y < y1; y++) {
+		auto column = Solid(x,y);
+		for(u32 w = z0/64; w*64 < z1; w++) {
+			u64 range = RangeBits(w, z0, z1);
+			if((column[w] & range) != range) return false;
+		}
+	}
+
+	return true;
+}
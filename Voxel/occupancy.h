@@ -0,0 +1,53 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include "common.h"
+
+// One bit per voxel of a chunk's interior, as a column of z bits for each
+//	x,y. Faces along z come from shifting a column and faces along x and y
+//	from ANDing it with the next column over, so exposed faces can be 
+//	found and counted without touching the blocks themselves.
+// occupied has every voxel that isn't air, solid only the solid cubes, 
+//	which are what hide faces and what the greedy meshers merge
+struct Occupancy {
+	static constexpr u32 maxColumnWords = 4; // stbvox can't mesh deeper than 255
+
+	u32 width, height, depth;
+	u32 columnWords;
+	std::vector<u64> occupied;
+	std::vector<u64> solid;
+	u32 numOccupied, numSolid;
+
+	Occupancy();
+
+	void Resize(u32 width, u32 height, u32 depth); // And clears
+
+	// Rebuilds the bits of a box, min inclusive and max exclusive, from blocks 
+	//	in the padded blockData layout
+	void Update(const u8* blocks, u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1);
+
+	u32 ColumnIndex(u32 x, u32 y) const { return (x*height + y)*columnWords; }
+	const u64* Occupied(u32 x, u32 y) const { return &occupied[ColumnIndex(x,y)]; }
+	const u64* Solid(u32 x, u32 y) const { return &solid[ColumnIndex(x,y)]; }
+
+	bool IsEmpty() const { return !numOccupied; }
+	bool IsSolid() const { return numSolid == width*height*depth; }
+
+	// Over the columns with x0 <= x < x1
+	bool AnyOccupied(u32 x0, u32 x1) const;
+	bool AnyNonCube(u32 x0, u32 x1) const; // Anything stbvox has to mesh
+
+	bool BoxSolid(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) const;
+
+	// The bits of word that fall in [b0, b1)
+	static u64 RangeBits(u32 word, u32 b0, u32 b1) {
+		u32 lo = std::max(b0, word*64);
+		u32 hi = std::min(b1, word*64 + 64);
+		if(lo >= hi) return 0;
+
+		u64 bits = (hi-lo == 64)? ~0ull : ((1ull << (hi-lo)) - 1);
+		return bits << (lo - word*64);
+	}
+};
+
+#endif
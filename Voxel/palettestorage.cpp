@@ -0,0 +1,160 @@
+#include "palettestorage.h"
+
+#include <unordered_map>
+
+PaletteStorage::PaletteStorage() {
+	width = height = depth = 0;
+	words = nullptr;
+	numWords = 0;
+	bitsPerVoxel = 0;
+}
+
+PaletteStorage::~PaletteStorage() {
+	delete[] words;
+}
+
+void PaletteStorage::Pack(const u8* blocks, const stbvox_rgb* colors, u32 w, u32 h, u32 d) {
+	width = w; height = h; depth = d;
+
+	u32 numVoxels = width*height*depth;
+	u32 paddedDepth = depth+2;
+	u32 paddedArea = (height+2)*paddedDepth;
+
+	// First pass builds the palette and stores unpacked indices
+	std::unordered_map<u32, u32> lookup;
+	std::vector<u32> indices(numVoxels);
+	palette.clear();
+
+	u32 lastEntry = 0;
+	u32 lastIndex = 0;
+	u32 i = 0;
+
+	for(u32 x = 0; x < width; x++)
+	for(u32 y = 0; y < height; y++) {
+		u32 idx = 1 + (y+1)*paddedDepth + (x+1)*paddedArea;
+		for(u32 z = 0; z < depth; z++, idx++) {
+			u32 entry = MakeEntry(blocks[idx], colors[idx]);
+
+			// Runs of the same voxel are common, skip the map for them
+			if(entry != lastEntry || palette.empty()) {
+				auto it = lookup.find(entry);
+				if(it == lookup.end()) {
+					it = lookup.emplace(entry, (u32)palette.size()).first;
+					palette.push_back(entry);
+				}
+
+				lastEntry = entry;
+				lastIndex = it->second;
+			}
+
+			indices[i++] = lastIndex;
+		}
+	}
+
+	// Per voxel colors easily go past 256 entries, and a 64^3 chunk can 
+	//	go past 65536. At 32 bits it's no smaller than raw, so Compress 
+	//	keeps such a chunk unpacked, but the pack is still correct
+	u32 size = palette.size();
+	if(size <= 1) bitsPerVoxel = 0;
+	else if(size <= 2) bitsPerVoxel = 1;
+	else if(size <= 4) bitsPerVoxel = 2;
+	else if(size <= 16) bitsPerVoxel = 4;
+	else if(size <= 256) bitsPerVoxel = 8;
+	else if(size <= 65536) bitsPerVoxel = 16;
+	else bitsPerVoxel = 32;
+
+	delete[] words;
+	words = nullptr;
+	numWords = 0;
+
+	if(!bitsPerVoxel) return;
+
+	// Bit widths divide 64, so indices never straddle words
+	u32 perWord = 64/bitsPerVoxel;
+	numWords = (numVoxels + perWord-1)/perWord;
+	words = new u64[numWords];
+	memset(words, 0, numWords*sizeof(u64));
+
+	for(u32 v = 0; v < numVoxels; v++)
+		words[v/perWord] |= (u64)indices[v] << ((v%perWord)*bitsPerVoxel);
+}
+
+void PaletteStorage::Unpack(u8* blocks, stbvox_rgb* colors) const {
+	Unpack(palette.data(), palette.size(), words, bitsPerVoxel, width, height, depth, blocks, colors);
+}
+
+bool PaletteStorage::Unpack(const u32* palette, u32 size, const u64* words, u32 bitsPerVoxel, 
+	u32 width, u32 height, u32 depth, u8* blocks, stbvox_rgb* colors) {
+	u32 paddedDepth = depth+2;
+	u32 paddedArea = (height+2)*paddedDepth;
+	u32 paddedSize = (width+2)*paddedArea;
+
+	memset(blocks, 0, paddedSize);
+	memset(colors, 255, paddedSize*sizeof(stbvox_rgb));
+
+	if(!size) return true;
+
+	// Split the palette into the two arrays stbvox reads
+	std::vector<u8> paletteBlocks(size);
+	std::vector<stbvox_rgb> paletteColors(size);
+	for(u32 p = 0; p < size; p++) {
+		u32 e = palette[p];
+		paletteBlocks[p] = e>>24;
+		paletteColors[p] = stbvox_rgb{(u8)(e>>16), (u8)(e>>8), (u8)e};
+	}
+
+	if(!bitsPerVoxel) {
+		for(u32 x = 0; x < width; x++)
+		for(u32 y = 0; y < height; y++) {
+			u32 idx = 1 + (y+1)*paddedDepth + (x+1)*paddedArea;
+			memset(&blocks[idx], paletteBlocks[0], depth);
+			std::fill_n(&colors[idx], depth, paletteColors[0]);
+		}
+
+		return true;
+	}
+
+	u64 mask = (1ull<<bitsPerVoxel) - 1;
+	const u64* word = words;
+	u64 bits = *word;
+	u32 bitsLeft = 64;
+	bool valid = true;
+
+	for(u32 x = 0; x < width; x++)
+	for(u32 y = 0; y < height; y++) {
+		u32 idx = 1 + (y+1)*paddedDepth + (x+1)*paddedArea;
+		for(u32 z = 0; z < depth; z++) {
+			if(!bitsLeft) {
+				bits = *++word;
+				bitsLeft = 64;
+			}
+
+			u32 p = bits & mask;
+			if(p >= size) {
+				valid = false;
+				p = 0;
+			}
+
+			bits >>= bitsPerVoxel;
+			bitsLeft -= bitsPerVoxel;
+
+			blocks[idx+z] = paletteBlocks[p];
+			colors[idx+z] = paletteColors[p];
+		}
+	}
+
+	return valid;
+}
+
+u32 PaletteStorage::Get(u32 x, u32 y, u32 z) const {
+	if(!bitsPerVoxel) return palette.empty()? 0 : palette[0];
+
+	u32 v = z + y*depth + x*depth*height;
+	u32 perWord = 64/bitsPerVoxel;
+	u64 mask = (1ull<<bitsPerVoxel) - 1;
+	return palette[(words[v/perWord] >> ((v%perWord)*bitsPerVoxel)) & mask];
+}
+
+u32 PaletteStorage::MemoryUsage() const {
+	return sizeof(PaletteStorage) + palette.capacity()*sizeof(u32) + numWords*sizeof(u64);
+}
@@ -0,0 +1,40 @@
+#ifndef PALETTESTORAGE_H
+#define PALETTESTORAGE_H
+
+#include "common.h"
+#include "stb_voxel_render.h"
+
+// Compressed copy of a chunk's voxels. Each distinct block type and color 
+//	pair gets a palette entry and voxels store bit packed palette indices,
+//	1, 2, 4, 8, 16 or 32 bits wide depending on palette size. A chunk with a 
+//	single entry stores no indices at all.
+// Only the chunk interior is stored, in the same x, y, z order as blockData
+struct PaletteStorage {
+	u32 width, height, depth;
+
+	std::vector<u32> palette; // block<<24 | r<<16 | g<<8 | b
+	u64* words;
+	u32 numWords;
+	u32 bitsPerVoxel; // 0 if uniform, always divides 64
+
+	PaletteStorage();
+	~PaletteStorage();
+
+	// Reads from and writes to the padded layout VoxelChunk uses
+	void Pack(const u8* blocks, const stbvox_rgb* colors, u32 width, u32 height, u32 depth);
+	void Unpack(u8* blocks, stbvox_rgb* colors) const;
+
+	// Same again from packed data stored anywhere, like a mapped file. Returns 
+	//	false if any index was past the end of the palette, those voxels get entry 0
+	static bool Unpack(const u32* palette, u32 paletteSize, const u64* words, u32 bitsPerVoxel, 
+		u32 width, u32 height, u32 depth, u8* blocks, stbvox_rgb* colors);
+
+	u32 Get(u32 x, u32 y, u32 z) const;
+	u32 MemoryUsage() const;
+
+	static u32 MakeEntry(u8 block, stbvox_rgb color) {
+		return ((u32)block<<24) | ((u32)color.r<<16) | ((u32)color.g<<8) | color.b;
+	}
+};
+
+#endif
@@ -0,0 +1,29 @@
+#include "radixsort.h"
+
+void RadixSort(std::vector<SortKey>& keys, std::vector<SortKey>& scratch) {
+	u32 count = keys.size();
+	scratch.resize(count);
+	if(count < 2) return;
+
+	// Every histogram in one pass over the keys
+	u32 histograms[4][256] {};
+	for(auto& k: keys)
+		for(u32 b = 0; b < 4; b++)
+			histograms[b][(k.key >> (b*8)) & 255]++;
+
+	for(u32 b = 0; b < 4; b++) {
+		auto& histogram = histograms[b];
+		if(histogram[(keys[0].key >> (b*8)) & 255] == count) continue;
+
+		u32 offsets[256];
+		for(u32 i = 0, total = 0; i < 256; i++) {
+			offsets[i] = total;
+			total += histogram[i];
+		}
+
+		for(auto& k: keys)
+			scratch[offsets[(k.key >> (b*8)) & 255]++] = k;
+
+		std::swap(keys, scratch);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include "common.h"
+
+#include <cstring>
+
+struct SortKey {
+	u32 key;
+	u32 index; // Of whatever is being sorted
+};
+
+// Stable least significant byte first radix sort, smallest key first.
+//	Passes over a byte that's the same in every key are skipped, so keys 
+//	that only differ in their low bits only pay for those. scratch ends up
+//	the same size as keys
+void RadixSort(std::vector<SortKey>& keys, std::vector<SortKey>& scratch);
+
+// Orders non-negative floats the same way as their bits do
+inline u32 FloatKey(f32 value) {
+	u32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "raycast.h"
+#include "voxelworld.h"
+
+#include <thread>
+
+bool Raycast(const VoxelWorld& world, const Ray& ray, RaycastHit* result) {
+	RaycastHit hit {};
+	hit.hit = false;
+
+	f32 length = glm::length(ray.direction);
+	if(length <= 0.f) {
+		*result = hit;
+		return false;
+	}
+
+	const f32 origin[3] {ray.origin.x, ray.origin.y, ray.origin.z};
+	const f32 dir[3] {ray.direction.x/length, ray.direction.y/length, ray.direction.z/length};
+	const s32 dims[3] {(s32)world.chunkWidth, (s32)world.chunkHeight, (s32)world.chunkDepth};
+
+	s32 voxel[3], step[3], normal[3] {0, 0, 0};
+	f32 tMax[3], tDelta[3];
+
+	// tMax is the distance to the next voxel boundary on each axis, 
+	//	tDelta is the distance between boundaries
+	for(u32 a = 0; a < 3; a++) {
+		voxel[a] = (s32)std::floor(origin[a]);
+
+		if(dir[a] > 0.f) {
+			step[a] = 1;
+			tMax[a] = (voxel[a] + 1 - origin[a]) / dir[a];
+			tDelta[a] = 1.f / dir[a];
+		}else if(dir[a] < 0.f) {
+			step[a] = -1;
+			tMax[a] = (origin[a] - voxel[a]) / -dir[a];
+			tDelta[a] = 1.f / -dir[a];
+		}else{
+			step[a] = 0;
+			tMax[a] = tDelta[a] = 1e30f;
+		}
+	}
+
+	// Chunk lookups only happen when the ray crosses into another chunk
+	auto cc = world.ChunkCoordAt(voxel[0], voxel[1], voxel[2]);
+	s32 chunkCoord[3] {cc.x, cc.y, cc.z};
+	s32 local[3];
+	for(u32 a = 0; a < 3; a++) local[a] = voxel[a] - chunkCoord[a]*dims[a];
+
+	auto chunk = world.GetChunk(cc);
+	f32 t = 0.f;
+
+	while(true) {
+		if(chunk && chunk->GetBlock(local[0], local[1], local[2])) {
+			hit.x = voxel[0]; hit.y = voxel[1]; hit.z = voxel[2];
+			hit.nx = normal[0]; hit.ny = normal[1]; hit.nz = normal[2];
+			hit.distance = t;
+			hit.hit = true;
+			break;
+		}
+
+		u32 a = (tMax[0] < tMax[1])? 0 : 1;
+		if(tMax[2] < tMax[a]) a = 2;
+
+		t = tMax[a];
+		if(t > ray.maxDistance) break;
+
+		tMax[a] += tDelta[a];
+		voxel[a] += step[a];
+		local[a] += step[a];
+
+		normal[0] = normal[1] = normal[2] = 0;
+		normal[a] = -step[a];
+
+		if(local[a] < 0 || local[a] >= dims[a]) {
+			chunkCoord[a] += step[a];
+			local[a] = (step[a] > 0)? 0 : dims[a]-1;
+			chunk = world.GetChunk(ChunkCoord{chunkCoord[0], chunkCoord[1], chunkCoord[2]});
+		}
+	}
+
+	*result = hit;
+	return hit.hit;
+}
+
+void RaycastMany(const VoxelWorld& world, const Ray* rays, RaycastHit* hits, u32 count, u32 numThreads) {
+	// Not worth starting a thread for less than this
+	const u32 minRaysPerThread = 256;
+
+	if(!numThreads) numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	numThreads = std::max(std::min(numThreads, count / minRaysPerThread), 1u);
+
+	auto castRange = [&](u32 begin, u32 end) {
+		for(u32 i = begin; i < end; i++)
+			Raycast(world, rays[i], &hits[i]);
+	};
+
+	std::vector<std::thread> threads;
+	for(u32 i = 1; i < numThreads; i++)
+		threads.emplace_back(castRange, count*i/numThreads, count*(i+1)/numThreads);
+
+	castRange(0, count/numThreads);
+	for(auto& t: threads) t.join();
+}
@@ -0,0 +1,31 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include "common.h"
+
+struct VoxelWorld;
+
+// In world voxel space, z up, where voxel v spans v to v+1
+struct Ray {
+	vec3 origin;
+	vec3 direction; // Doesn't need to be normalised
+	f32 maxDistance;
+};
+
+struct RaycastHit {
+	s32 x, y, z; // The solid voxel hit
+	s32 nx, ny, nz; // Normal of the face the ray came in through, zero if it started inside
+	f32 distance;
+	bool hit;
+};
+
+// Amanatides & Woo grid traversal, visiting every voxel along the ray
+//	in order and stopping at the first solid one. Crosses chunk
+//	boundaries, and empty space where there are no chunks
+bool Raycast(const VoxelWorld&, const Ray&, RaycastHit*);
+
+// Splits the rays between threads, numThreads 0 picks from hardware threads.
+//	The world mustn't be edited until it returns
+void RaycastMany(const VoxelWorld&, const Ray*, RaycastHit*, u32 count, u32 numThreads = 0);
+
+#endif
@@ -0,0 +1,462 @@
+#include "regionfile.h"
+#include "voxelworld.h"
+#include "voxelchunk.h"
+#include "lighting.h"
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static Log logger{"RegionFile"};
+
+static const char regionMagic[4] {'V', 'X', 'R', 'G'};
+
+// Rounds towards negative infinity, unlike /
+static s32 FloorDiv(s32 a, s32 b) {
+	return (a >= 0)? a/b : -((-a + b - 1)/b);
+}
+
+static u32 Align8(u32 x) {
+	return (x + 7) & ~7u;
+}
+
+// Of the words in a record, from its start
+static u32 WordsOffset(u32 paletteSize) {
+	return Align8(sizeof(RegionFile::Record) + paletteSize*sizeof(u32));
+}
+
+// RegionFile
+
+constexpr u32 RegionFile::version;
+
+RegionFile::RegionFile() {
+	fd = -1;
+	mapping = nullptr;
+	mappedSize = 0;
+}
+
+RegionFile::~RegionFile() {
+	Close();
+}
+
+bool RegionFile::Open(const std::string& p, u32 w, u32 h, u32 d) {
+	Close();
+	path = p;
+
+	fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0) {
+		logger << "Couldn't open " << path;
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		Close();
+		return false;
+	}
+
+	if(st.st_size == 0) {
+		// New file, just a header and an empty table
+		std::vector<u8> blank(dataStart, 0);
+
+		Header header;
+		memcpy(header.magic, regionMagic, 4);
+		header.version = version;
+		header.chunkWidth = w;
+		header.chunkHeight = h;
+		header.chunkDepth = d;
+		header.dataEnd = dataStart;
+		header.garbage = 0;
+		header.numChunks = 0;
+		memcpy(blank.data(), &header, sizeof(Header));
+
+		if(!Write(0, blank.data(), dataStart)) {
+			Close();
+			return false;
+		}
+
+	}else if(st.st_size < dataStart) {
+		logger << path << " is truncated";
+		Close();
+		return false;
+	}
+
+	if(!Remap()) {
+		Close();
+		return false;
+	}
+
+	auto& header = GetHeader();
+	if(memcmp(header.magic, regionMagic, 4) != 0 || header.version != version) {
+		logger << path << " isn't a version " << version << " region file";
+		Close();
+		return false;
+	}
+
+	if(header.chunkWidth != w || header.chunkHeight != h || header.chunkDepth != d) {
+		logger << path << " has " << header.chunkWidth << "x" << header.chunkHeight << "x" 
+			<< header.chunkDepth << " chunks, not " << w << "x" << h << "x" << d;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void RegionFile::Close() {
+	if(mapping) munmap(mapping, mappedSize);
+	if(fd >= 0) close(fd);
+
+	fd = -1;
+	mapping = nullptr;
+	mappedSize = 0;
+}
+
+bool RegionFile::Remap() {
+	struct stat st;
+	if(fstat(fd, &st) != 0) return false;
+
+	if(mapping) munmap(mapping, mappedSize);
+	mappedSize = st.st_size;
+
+	// Shared, so writes through fd show up in the header and table straight away
+	mapping = (u8*)mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+	if(mapping == MAP_FAILED) {
+		logger << "Couldn't map " << path;
+		mapping = nullptr;
+		mappedSize = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool RegionFile::Load(u32 index, VoxelChunk& chunk) {
+	auto entry = GetEntry(index);
+	if(!entry.offset) return false;
+
+	auto corrupt = [&](const char* reason) {
+		logger << path << ": chunk " << index << " " << reason;
+		return false;
+	};
+
+	// Nothing read from the file is trusted until it's been checked 
+	//	against the mapping, so a truncated or corrupt file just fails
+	u64 end = (u64)entry.offset + entry.size;
+	if(end > mappedSize) Remap();
+	if(entry.offset < dataStart || entry.offset % 8 || end > mappedSize || entry.size < sizeof(Record))
+		return corrupt("is outside the file");
+
+	Record record;
+	memcpy(&record, mapping + entry.offset, sizeof(Record));
+
+	if(record.width != chunk.width || record.height != chunk.height || record.depth != chunk.depth)
+		return corrupt("was saved from a chunk of another size");
+
+	u32 bits = record.bitsPerVoxel;
+	if(bits > 32 || (bits & (bits-1)))
+		return corrupt("has a bad index width");
+
+	u64 numVoxels = (u64)record.width*record.height*record.depth;
+	u64 numWords = bits? (numVoxels + 64/bits-1)/(64/bits) : 0;
+	u64 paletteEnd = sizeof(Record) + (u64)record.paletteSize*sizeof(u32);
+
+	if(record.numWords != numWords || paletteEnd > entry.size 
+		|| WordsOffset(record.paletteSize) + numWords*sizeof(u64) > entry.size)
+		return corrupt("is the wrong size");
+
+	auto palette = reinterpret_cast<const u32*>(mapping + entry.offset + sizeof(Record));
+	auto words = reinterpret_cast<const u64*>(mapping + entry.offset + WordsOffset(record.paletteSize));
+
+	chunk.Decompress();
+	bool valid = PaletteStorage::Unpack(palette, record.paletteSize, words, bits, 
+		chunk.width, chunk.height, chunk.depth, chunk.blockData, chunk.colorData);
+
+	// Empty rather than half loaded
+	if(!valid) PaletteStorage::Unpack(nullptr, 0, nullptr, 0, 
+		chunk.width, chunk.height, chunk.depth, chunk.blockData, chunk.colorData);
+
+	// Unlit chunks mesh at full brightness until something lights them again
+	delete[] chunk.lightData;
+	chunk.lightData = nullptr;
+
+	chunk.occupancy.Update(chunk.blockData, 0,0,0, chunk.width, chunk.height, chunk.depth);
+	chunk.MarkDirty(0,0,0, chunk.width, chunk.height, chunk.depth);
+	return valid || corrupt("has palette indices past its palette");
+}
+
+bool RegionFile::Save(u32 index, const VoxelChunk& chunk) {
+	PaletteStorage unpacked;
+	const PaletteStorage* packed = chunk.packedData;
+	if(!packed) {
+		unpacked.Pack(chunk.blockData, chunk.colorData, chunk.width, chunk.height, chunk.depth);
+		packed = &unpacked;
+	}
+
+	Record record;
+	record.width = chunk.width;
+	record.height = chunk.height;
+	record.depth = chunk.depth;
+	record.paletteSize = packed->palette.size();
+	record.bitsPerVoxel = packed->bitsPerVoxel;
+	record.numWords = packed->numWords;
+
+	u32 wordsOffset = WordsOffset(record.paletteSize);
+	u32 size = wordsOffset + record.numWords*sizeof(u64);
+
+	std::vector<u8> data(size, 0);
+	memcpy(data.data(), &record, sizeof(Record));
+	memcpy(data.data() + sizeof(Record), packed->palette.data(), record.paletteSize*sizeof(u32));
+	if(record.numWords) memcpy(data.data() + wordsOffset, packed->words, record.numWords*sizeof(u64));
+
+	// The record goes in before the table points at it
+	Header header = GetHeader();
+	Entry entry {header.dataEnd, size};
+	if(!Write(entry.offset, data.data(), size)) return false;
+
+	auto old = GetEntry(index);
+	if(old.offset) header.garbage += Align8(old.size);
+	else header.numChunks++;
+
+	header.dataEnd = entry.offset + Align8(size);
+	return SetEntry(index, entry) && SetHeader(header);
+}
+
+void RegionFile::Erase(u32 index) {
+	auto old = GetEntry(index);
+	if(!old.offset) return;
+
+	Header header = GetHeader();
+	header.garbage += Align8(old.size);
+	header.numChunks--;
+
+	SetEntry(index, Entry{0, 0});
+	SetHeader(header);
+}
+
+f32 RegionFile::Fragmentation() const {
+	auto& header = GetHeader();
+	u32 used = header.dataEnd - dataStart;
+	return used? (f32)header.garbage / used : 0.f;
+}
+
+bool RegionFile::Compact() {
+	if(!Remap()) return false;
+
+	Header header = GetHeader();
+	std::vector<u8> file(dataStart, 0);
+	std::vector<Entry> entries(numEntries);
+
+	for(u32 i = 0; i < numEntries; i++) {
+		auto& entry = GetEntry(i);
+		entries[i] = Entry{0, 0};
+		if(!entry.offset) continue;
+
+		entries[i] = Entry{(u32)file.size(), entry.size};
+		file.insert(file.end(), mapping + entry.offset, mapping + entry.offset + entry.size);
+		file.resize(Align8(file.size()), 0);
+	}
+
+	header.dataEnd = file.size();
+	header.garbage = 0;
+	memcpy(file.data(), &header, sizeof(Header));
+	memcpy(file.data() + sizeof(Header), entries.data(), numEntries*sizeof(Entry));
+
+	std::string tempPath = path + ".tmp";
+	s32 out = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out < 0) {
+		logger << "Couldn't open " << tempPath;
+		return false;
+	}
+
+	u32 written = 0;
+	while(written < file.size()) {
+		auto n = write(out, file.data() + written, file.size() - written);
+		if(n <= 0) break;
+		written += n;
+	}
+
+	close(out);
+
+	if(written != file.size() || rename(tempPath.c_str(), path.c_str()) != 0) {
+		logger << "Couldn't compact " << path;
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	// The old file is still what fd points at
+	std::string p = path;
+	return Open(p, header.chunkWidth, header.chunkHeight, header.chunkDepth);
+}
+
+bool RegionFile::Write(u32 offset, const void* data, u32 size) {
+	auto bytes = (const u8*)data;
+	u32 written = 0;
+
+	while(written < size) {
+		auto n = pwrite(fd, bytes + written, size - written, offset + written);
+		if(n <= 0) {
+			logger << "Couldn't write to " << path;
+			return false;
+		}
+
+		written += n;
+	}
+
+	return true;
+}
+
+bool RegionFile::SetEntry(u32 index, const Entry& entry) {
+	return Write(sizeof(Header) + index*sizeof(Entry), &entry, sizeof(Entry));
+}
+
+bool RegionFile::SetHeader(const Header& header) {
+	return Write(0, &header, sizeof(Header));
+}
+
+u32 RegionFile::EntryIndex(s32 cx, s32 cy, s32 cz) {
+	const s32 n = regionSize;
+	u32 x = cx - FloorDiv(cx, n)*n;
+	u32 y = cy - FloorDiv(cy, n)*n;
+	u32 z = cz - FloorDiv(cz, n)*n;
+	return x + y*n + z*n*n;
+}
+
+// RegionStore
+
+RegionStore::RegionStore(const std::string& dir, u32 w, u32 h, u32 d)
+	: directory{dir}, chunkWidth{w}, chunkHeight{h}, chunkDepth{d} {}
+
+RegionStore::~RegionStore() {
+	for(auto& r: regions) delete r.second;
+}
+
+u32 RegionStore::Open() {
+	mkdir(directory.c_str(), 0755);
+
+	auto dir = opendir(directory.c_str());
+	if(!dir) {
+		logger << "Couldn't open " << directory;
+		return 0;
+	}
+
+	u32 numChunks = 0;
+	while(auto file = readdir(dir)) {
+		s32 x, y, z;
+		char end;
+		if(sscanf(file->d_name, "r.%d.%d.%d.vx%c", &x, &y, &z, &end) != 4 || end != 'r') continue;
+
+		RegionCoord rc {x, y, z};
+		if(regions.count(rc)) continue;
+
+		auto region = new RegionFile;
+		if(!region->Open(RegionPath(rc), chunkWidth, chunkHeight, chunkDepth)) {
+			delete region;
+			continue;
+		}
+
+		regions[rc] = region;
+		numChunks += region->GetHeader().numChunks;
+	}
+
+	closedir(dir);
+	return numChunks;
+}
+
+RegionFile* RegionStore::GetRegion(const ChunkCoord& c, bool create) {
+	const s32 n = RegionFile::regionSize;
+	RegionCoord rc {FloorDiv(c.x, n), FloorDiv(c.y, n), FloorDiv(c.z, n)};
+
+	auto it = regions.find(rc);
+	if(it != regions.end()) return it->second;
+	if(!create) return nullptr;
+
+	auto region = new RegionFile;
+	if(!region->Open(RegionPath(rc), chunkWidth, chunkHeight, chunkDepth)) {
+		delete region;
+		return nullptr;
+	}
+
+	regions[rc] = region;
+	return region;
+}
+
+std::string RegionStore::RegionPath(const RegionCoord& rc) const {
+	return directory + "/r." + std::to_string(std::get<0>(rc)) + "." 
+		+ std::to_string(std::get<1>(rc)) + "." + std::to_string(std::get<2>(rc)) + ".vxr";
+}
+
+bool RegionStore::HasChunk(const ChunkCoord& c) {
+	auto region = GetRegion(c, false);
+	return region && region->Has(RegionFile::EntryIndex(c.x, c.y, c.z));
+}
+
+bool RegionStore::LoadChunk(VoxelWorld& world, const ChunkCoord& c) {
+	auto region = GetRegion(c, false);
+	u32 index = RegionFile::EntryIndex(c.x, c.y, c.z);
+	if(!region || !region->Has(index)) return false;
+
+	// A chunk made just for a bad record goes again, or SaveAll would 
+	//	write it back empty over the record
+	bool existed = world.GetChunk(c) != nullptr;
+	auto chunk = world.GetOrCreateChunk(c);
+	if(!region->Load(index, *chunk)) {
+		if(!existed) world.DestroyChunk(c);
+		return false;
+	}
+
+	// Load drops its light, like a new chunk it needs lighting from scratch
+	if(world.lighting) world.lighting->OnChunkCreated(chunk);
+	return true;
+}
+
+bool RegionStore::SaveChunk(VoxelWorld& world, const ChunkCoord& c) {
+	auto chunk = world.GetChunk(c);
+	auto region = GetRegion(c, chunk != nullptr);
+	if(!region) return false;
+
+	u32 index = RegionFile::EntryIndex(c.x, c.y, c.z);
+	if(!chunk) {
+		region->Erase(index);
+		return true;
+	}
+
+	return region->Save(index, *chunk);
+}
+
+u32 RegionStore::LoadAll(VoxelWorld& world) {
+	const s32 n = RegionFile::regionSize;
+	u32 numLoaded = 0;
+
+	for(auto& r: regions) {
+		auto region = r.second;
+		if(!region->GetHeader().numChunks) continue;
+
+		for(s32 z = 0; z < n; z++)
+		for(s32 y = 0; y < n; y++)
+		for(s32 x = 0; x < n; x++) {
+			ChunkCoord c {std::get<0>(r.first)*n + x, std::get<1>(r.first)*n + y, std::get<2>(r.first)*n + z};
+			numLoaded += LoadChunk(world, c);
+		}
+	}
+
+	return numLoaded;
+}
+
+u32 RegionStore::SaveAll(VoxelWorld& world) {
+	u32 numSaved = 0;
+	world.chunks.ForEach([&](ChunkCoord c, VoxelChunk*) {
+		numSaved += SaveChunk(world, c);
+	});
+
+	CompactIfNeeded();
+	return numSaved;
+}
+
+void RegionStore::CompactIfNeeded(f32 maxFragmentation) {
+	for(auto& r: regions)
+		if(r.second->Fragmentation() > maxFragmentation)
+			r.second->Compact();
+}
@@ -0,0 +1,120 @@
+#ifndef REGIONFILE_H
+#define REGIONFILE_H
+
+#include "common.h"
+
+#include <tuple>
+
+struct VoxelChunk;
+struct VoxelWorld;
+struct ChunkCoord;
+
+// A cube of regionSize^3 chunks saved in one file. A fixed header and 
+//	offset table come first, then palette packed chunk records appended
+//	one after another. The whole file is mapped, so loading a chunk is a
+//	table lookup and an unpack straight out of the mapping.
+// Saving appends a new record and repoints the table, leaving the old one 
+//	as garbage until Compact rewrites the file with only live records
+struct RegionFile {
+	static constexpr u32 regionSize = 8;
+	static constexpr u32 numEntries = regionSize*regionSize*regionSize;
+	static constexpr u32 version = 2;
+
+	struct Header {
+		char magic[4]; // VXRG
+		u32 version;
+		u32 chunkWidth, chunkHeight, chunkDepth;
+		u32 dataEnd; // Where the next record goes
+		u32 garbage; // Bytes of records nothing points at
+		u32 numChunks;
+	};
+
+	struct Entry {
+		u32 offset; // 0 if the chunk isn't saved
+		u32 size;
+	};
+
+	// Followed by the palette, then the words at the next multiple of 8
+	struct Record {
+		u32 width, height, depth; // Of the chunk it was saved from
+		u32 paletteSize;
+		u32 bitsPerVoxel;
+		u32 numWords;
+	};
+
+	static constexpr u32 dataStart = sizeof(Header) + numEntries*sizeof(Entry);
+
+	std::string path;
+	s32 fd;
+	u8* mapping;
+	u32 mappedSize;
+
+	RegionFile();
+	~RegionFile();
+
+	// Creates the file if it doesn't exist. Fails if it was saved with 
+	//	different chunk dimensions
+	bool Open(const std::string& path, u32 chunkWidth, u32 chunkHeight, u32 chunkDepth);
+	void Close();
+
+	const Header& GetHeader() const { return *reinterpret_cast<const Header*>(mapping); }
+	const Entry& GetEntry(u32 index) const { return reinterpret_cast<const Entry*>(mapping + sizeof(Header))[index]; }
+
+	bool Has(u32 index) const { return GetEntry(index).offset != 0; }
+
+	// Unpacks into the chunk's blockData and colorData, decompressing it first, and marks it dirty.
+	//	Its lightData is dropped since it no longer matches. Fails without touching the chunk 
+	//	if the record doesn't fit in the file or was saved from a chunk of another size, and
+	//	leaves it empty if the record has palette indices past the end of its palette
+	bool Load(u32 index, VoxelChunk&);
+	bool Save(u32 index, const VoxelChunk&);
+	void Erase(u32 index);
+
+	// Fraction of the records that are garbage
+	f32 Fragmentation() const;
+
+	// Rewrites the file with live records only, through a temporary file so
+	//	a failure leaves the old one intact
+	bool Compact();
+
+	// Maps everything written so far
+	bool Remap();
+
+	bool Write(u32 offset, const void* data, u32 size);
+	bool SetEntry(u32 index, const Entry&);
+	bool SetHeader(const Header&);
+
+	// Of a chunk within its region
+	static u32 EntryIndex(s32 cx, s32 cy, s32 cz);
+};
+
+// The region files of one world, in one directory named by region coordinate
+struct RegionStore {
+	using RegionCoord = std::tuple<s32, s32, s32>;
+
+	std::string directory;
+	u32 chunkWidth, chunkHeight, chunkDepth;
+	std::map<RegionCoord, RegionFile*> regions;
+
+	RegionStore(const std::string& directory, u32 chunkWidth, u32 chunkHeight, u32 chunkDepth);
+	~RegionStore();
+
+	// Maps every region file already in the directory, creating the 
+	//	directory if needed. Returns the number of chunks saved in them
+	u32 Open();
+
+	bool HasChunk(const ChunkCoord&);
+	bool LoadChunk(VoxelWorld&, const ChunkCoord&);
+	bool SaveChunk(VoxelWorld&, const ChunkCoord&);
+
+	u32 LoadAll(VoxelWorld&);
+	u32 SaveAll(VoxelWorld&);
+
+	// Compacts regions with more than this fraction of garbage
+	void CompactIfNeeded(f32 maxFragmentation = 0.5f);
+
+	RegionFile* GetRegion(const ChunkCoord&, bool create);
+	std::string RegionPath(const RegionCoord&) const;
+};
+
+#endif
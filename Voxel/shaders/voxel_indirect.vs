@@ -0,0 +1,32 @@
+#version 430
+
+// voxel.vs for IndirectDrawer, with the model matrix per draw
+layout(location = 0) in uint attr_vertex;
+layout(location = 1) in uint attr_draw;
+
+layout(std430, binding = 0) readonly buffer ChunkTransforms {
+	mat4 models[];
+};
+
+uniform usamplerBuffer facearray;
+uniform vec4 camera_pos;
+uniform vec3 normal_table[32];
+uniform mat4 view_projection;
+
+flat out uvec4  facedata;
+	 out  vec3  vnormal;
+	 out float  amb_occ;
+
+void main() {
+	int faceID = gl_VertexID >> 2;
+	facedata = texelFetch(facearray, faceID);
+
+	vec3 offset;
+	offset.x = float( (attr_vertex       ) & 127u );
+	offset.y = float( (attr_vertex >>  7u) & 127u );
+	offset.z = float( (attr_vertex >> 14u) & 511u ) * 0.5f;
+	amb_occ  = float( (attr_vertex >> 23u) &  63u ) / 63.0;
+
+	vnormal = normal_table[(facedata.w>>2u) & 31u];
+	gl_Position = view_projection * models[attr_draw] * vec4(offset,1.0);
+}
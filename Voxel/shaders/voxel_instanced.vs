@@ -0,0 +1,46 @@
+#version 330
+
+// voxel.vs with one instance per quad instead of four vertices, see 
+//	EncodeInstances. Corners come from gl_VertexID, in the same two 
+//	triangles elementBO makes of a quad
+layout(location = 2) in uvec2 attr_instance;
+
+uniform usamplerBuffer facearray;
+uniform int face_offset; // Of the chunk's first quad, gl_InstanceID starts at 0
+uniform vec4 camera_pos;
+uniform vec3 normal_table[32];
+uniform mat4 model;
+uniform mat4 view_projection;
+
+flat out uvec4  facedata;
+	 out  vec3  vnormal;
+	 out float  amb_occ;
+
+// faceVertices from greedymesher.cpp, with x, y and z in bits 0, 1 and 2
+const uint faceCorners[24] = uint[24](
+	5u, 7u, 3u, 1u, // East
+	7u, 6u, 2u, 3u, // North
+	6u, 4u, 0u, 2u, // West
+	4u, 5u, 1u, 0u, // South
+	6u, 7u, 5u, 4u, // Up
+	0u, 1u, 3u, 2u  // Down
+);
+
+const uint triangleCorners[6] = uint[6](0u, 2u, 1u, 0u, 3u, 2u);
+
+void main() {
+	facedata = texelFetch(facearray, face_offset + gl_InstanceID);
+
+	uint face = attr_instance.x >> 29u;
+	uint corner = faceCorners[face*4u + triangleCorners[gl_VertexID]];
+
+	uvec3 origin = uvec3(attr_instance.x & 127u, (attr_instance.x >> 7u) & 127u, (attr_instance.x >> 14u) & 511u);
+	uvec3 extent = uvec3(attr_instance.y & 255u, (attr_instance.y >> 8u) & 255u, (attr_instance.y >> 16u) & 255u);
+	uvec3 select = uvec3(corner & 1u, (corner >> 1u) & 1u, (corner >> 2u) & 1u);
+
+	vec3 offset = vec3(origin + select*extent);
+	amb_occ = float( (attr_instance.x >> 23u) & 63u ) / 63.0;
+
+	vnormal = normal_table[(facedata.w>>2u) & 31u];
+	gl_Position = view_projection * model * vec4(offset,1.0);
+}
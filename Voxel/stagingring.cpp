@@ -0,0 +1,159 @@
+#include "stagingring.h"
+
+#include <cstring>
+
+static Log logger{"StagingRing"};
+
+StagingRing::StagingRing(u32 s, bool allow) : size{s}, allowPersistent{allow} {
+	buffer = 0;
+	head = used = pending = 0;
+	mapped = nullptr;
+	persistent = false;
+	numWaits = 0;
+	numDirect = 0;
+	bytesStaged = 0;
+}
+
+StagingRing::~StagingRing() {
+	if(!buffer) return;
+
+	for(auto& fence: fences) glDeleteSync(fence.sync);
+
+	if(mapped) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	glDeleteBuffers(1, &buffer);
+}
+
+bool StagingRing::SupportsPersistentMapping() {
+	s32 major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if(major > 4 || (major == 4 && minor >= 4)) return true;
+
+	s32 numExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+	for(s32 i = 0; i < numExtensions; i++)
+		if(!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage")) return true;
+
+	return false;
+}
+
+void StagingRing::InitBuffer() {
+	persistent = allowPersistent && SupportsPersistentMapping();
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+	if(persistent) {
+		// Coherent, so writes are seen by the copies without flushing
+		u32 flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, size, nullptr, flags);
+		mapped = (u8*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+
+		// Still writable through glMapBufferRange, which is all the fallback needs
+		if(!mapped) {
+			logger << "Persistent mapping failed";
+			persistent = false;
+		}
+	}else{
+		glBufferData(GL_COPY_READ_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	logger << (size >> 10) << "KB, " << (persistent? "persistently mapped" : "mapped for each write");
+}
+
+void StagingRing::Upload(u32 dest, u32 destOffset, u32 numBytes, const void* data) {
+	if(!numBytes) return;
+	if(!buffer) InitBuffer();
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, dest);
+
+	if(numBytes > size) {
+		glBufferSubData(GL_COPY_WRITE_BUFFER, destOffset, numBytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		numDirect++;
+		return;
+	}
+
+	u32 offset = Allocate(numBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+	if(persistent) {
+		memcpy(mapped + offset, data, numBytes);
+	}else{
+		// Nothing the GPU is still reading can be in the range, the fences
+		//	make sure of that, so there's nothing for the driver to wait on
+		auto ptr = glMapBufferRange(GL_COPY_READ_BUFFER, offset, numBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if(ptr) memcpy(ptr, data, numBytes);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, destOffset, numBytes);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	bytesStaged += numBytes;
+}
+
+void StagingRing::EndFrame() {
+	if(!pending) return;
+
+	fences.push_back(Fence{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), pending});
+	pending = 0;
+}
+
+u32 StagingRing::Allocate(u32 numBytes) {
+	// Whatever the GPU is already done with, without waiting
+	while(ReleaseOldest(false));
+
+	// Writes don't wrap, whatever is left at the end is skipped instead
+	bool wrap = head + numBytes > size;
+	u32 skip = wrap? size - head : 0;
+
+	while(used + skip + numBytes > size) {
+		if(!used) {
+			wrap = false;
+			skip = 0;
+			head = 0;
+			break;
+		}
+
+		if(fences.empty()) EndFrame();
+		ReleaseOldest(true);
+		numWaits++;
+	}
+
+	if(wrap) head = 0;
+
+	u32 offset = head;
+	head += numBytes;
+	used += skip + numBytes;
+	pending += skip + numBytes;
+	return offset;
+}
+
+bool StagingRing::ReleaseOldest(bool wait) {
+	if(fences.empty()) return false;
+
+	auto& fence = fences.front();
+
+	if(wait) {
+		// Flushing once so the fence is sure to be reached
+		u32 flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while(glClientWaitSync(fence.sync, flags, 1000000000ull) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+	}else if(glClientWaitSync(fence.sync, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+
+	glDeleteSync(fence.sync);
+	used -= fence.size;
+	fences.pop_front();
+	return true;
+}
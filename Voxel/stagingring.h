@@ -0,0 +1,52 @@
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#include "common.h"
+
+#include <deque>
+
+// Streams uploads through one buffer used as a ring. Data is written into
+//	it where the GPU can read it, then copied into place with
+//	glCopyBufferSubData, so the driver never has to keep its own copy.
+//	With ARB_buffer_storage the ring stays mapped for its whole life,
+//	otherwise each write maps its range with GL_MAP_UNSYNCHRONIZED_BIT.
+// Writes are fenced by EndFrame, and space is only reused once the fence
+//	after it has passed. If the ring fills up within a frame it fences
+//	early and waits for the oldest writes
+struct StagingRing {
+	struct Fence {
+		GLsync sync;
+		u32 size; // Bytes it releases, including any skipped at the end of the ring
+	};
+
+	std::deque<Fence> fences;
+	u32 buffer;
+	u32 size;
+	u32 head; // Where the next write goes
+	u32 used; // Written and not yet released
+	u32 pending; // Of used, not fenced yet
+	u8* mapped; // Whole ring if persistent, otherwise null
+	bool allowPersistent;
+	bool persistent;
+
+	u32 numWaits; // Times a write had to wait on the GPU
+	u32 numDirect; // Writes too big for the ring, done with glBufferSubData
+	u64 bytesStaged;
+
+	StagingRing(u32 size = 8u<<20, bool allowPersistent = true);
+	~StagingRing();
+
+	static bool SupportsPersistentMapping(); // Needs a current context
+
+	// Copies numBytes of data to destOffset in the buffer dest
+	void Upload(u32 dest, u32 destOffset, u32 numBytes, const void* data);
+
+	// Fences everything written since the last call, once per frame
+	void EndFrame();
+
+	void InitBuffer();
+	u32 Allocate(u32 numBytes); // Returns the ring offset to write at
+	bool ReleaseOldest(bool wait); // Returns false if nothing was released
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "terrain.h"
+#include "voxelchunk.h"
+#include "voxelworld.h"
+
+#include <random>
+#include <atomic>
+#include <thread>
+
+void GenerateTestTerrain(VoxelChunk& chunk) {
+	for(u32 x = 0; x < chunk.width; x++)
+	for(u32 y = 0; y < chunk.height; y++) {
+		chunk.SetBlock(x,y,0, rand()%2 + 1);
+		chunk.SetColor(x,y,0, 100,200,100);
+	}
+
+	for(u32 x = 0; x < chunk.width; x++)
+	for(u32 y = 0; y < chunk.height; y++) {
+		chunk.SetBlock(x,y,1, (chunk.GetBlock(x,y,0)==1 && rand()%5==0)?7:0);
+		chunk.SetColor(x,y,1, 127,255,127);
+	}
+	
+	chunk.FillBox(0,0,4, chunk.width,1,5, 1, {255,0,0});
+	chunk.FillBox(0,0,5, 1,chunk.height,6, 1, {255,0,0});
+}
+
+void GenerateRandomTerrain(VoxelChunk& chunk, u32 seed, f32 density) {
+	std::mt19937 rng{seed};
+	std::uniform_real_distribution<f32> dist{0.f, 1.f};
+
+	for(u32 x = 0; x < chunk.width; x++)
+	for(u32 y = 0; y < chunk.height; y++)
+	for(u32 z = 0; z < chunk.depth; z++) {
+		if(dist(rng) >= density) continue;
+
+		// A handful of colors so some faces can merge
+		u8 shade = 100 + (rng()%4)*40;
+		chunk.SetBlock(x,y,z, 1);
+		chunk.SetColor(x,y,z, shade, shade, 100);
+	}
+}
+
+TerrainGenerator::TerrainGenerator(u32 seed) : noise{seed} {
+	baseHeight = 18.f;
+	hillHeight = 18.f;
+	snowHeight = 30.f;
+}
+
+// Small per voxel color variation so flat ground doesn't look painted
+static u8 Jitter(s32 x, s32 y, s32 z) {
+	u32 h = (u32)x*73856093u ^ (u32)y*19349663u ^ (u32)z*83492791u;
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	return (h >> 24) & 15;
+}
+
+void TerrainGenerator::Generate(VoxelChunk& chunk, s32 ox, s32 oy, s32 oz) const {
+	const f32 hillScale = 1.f/96.f;
+	const f32 biomeScale = 1.f/256.f;
+	const f32 densityScale = 1.f/24.f;
+	const f32 caveScale = 1.f/20.f;
+	const f32 overhang = 6.f;
+	const f32 caveWidth = 0.06f;
+
+	// Enough above the chunk to know how deep the top voxels are
+	const u32 dirtDepth = 3;
+
+	if(chunk.packedData) chunk.Decompress();
+
+	u32 numSamples = chunk.depth + dirtDepth + 1;
+	std::vector<f32> heights(chunk.height), biomes(chunk.height);
+	std::vector<f32> density(numSamples), caves(numSamples);
+
+	for(u32 x = 0; x < chunk.width; x++) {
+		f32 wx = (f32)(ox + (s32)x);
+
+		noise.FractalRow(vec3{wx*hillScale, oy*hillScale, 0.f}, vec3{0.f, hillScale, 0.f}, 
+			chunk.height, 4, heights.data());
+		noise.FractalRow(vec3{wx*biomeScale, oy*biomeScale, 100.f}, vec3{0.f, biomeScale, 0.f}, 
+			chunk.height, 2, biomes.data());
+
+		for(u32 y = 0; y < chunk.height; y++) {
+			f32 wy = (f32)(oy + (s32)y);
+			f32 surface = baseHeight + heights[y]*hillHeight;
+			bool desert = biomes[y] > 0.15f;
+
+			noise.FractalRow(vec3{wx, wy, (f32)oz}*densityScale, vec3{0.f, 0.f, densityScale}, 
+				numSamples, 2, density.data());
+			noise.SampleRow(vec3{wx, wy, (f32)oz}*caveScale + vec3{50.f}, vec3{0.f, 0.f, caveScale}, 
+				numSamples, caves.data());
+
+			// From the top down, counting solid voxels since the last open one
+			u32 depthBelowAir = ~0u;
+			auto blocks = &chunk.blockData[chunk.Index(x,y,0)];
+			auto colors = &chunk.colorData[chunk.Index(x,y,0)];
+
+			for(u32 z = numSamples; z-- > 0;) {
+				f32 wz = (f32)(oz + (s32)z);
+				bool cave = std::abs(caves[z]) < caveWidth && wz < surface - 4.f;
+				bool solid = !cave && (surface - wz + density[z]*overhang > 0.f);
+
+				if(!solid) depthBelowAir = 0;
+				else if(depthBelowAir != ~0u) depthBelowAir++;
+
+				if(z >= chunk.depth) continue;
+
+				if(!solid) {
+					blocks[z] = 0;
+					colors[z] = stbvox_rgb{255, 255, 255};
+					continue;
+				}
+
+				stbvox_rgb color;
+				if(depthBelowAir == 1) {
+					if(wz >= snowHeight) color = stbvox_rgb{240, 240, 245};
+					else if(desert) color = stbvox_rgb{220, 200, 130};
+					else color = stbvox_rgb{90, 160, 70};
+
+				}else if(depthBelowAir <= dirtDepth+1) {
+					color = desert? stbvox_rgb{200, 175, 110} : stbvox_rgb{120, 90, 60};
+
+				}else{
+					color = stbvox_rgb{120, 120, 125};
+				}
+
+				u8 jitter = Jitter(ox + (s32)x, oy + (s32)y, oz + (s32)z);
+				color.r -= jitter;
+				color.g -= jitter;
+				color.b -= jitter;
+
+				blocks[z] = 1;
+				colors[z] = color;
+			}
+		}
+	}
+
+	chunk.occupancy.Update(chunk.blockData, 0,0,0, chunk.width, chunk.height, chunk.depth);
+}
+
+void TerrainGenerator::Generate(VoxelWorld& world, const ChunkCoord& min, const ChunkCoord& max, u32 numThreads) const {
+	// Chunks are created up front since the world isn't thread safe
+	std::vector<std::pair<ChunkCoord, VoxelChunk*>> chunks;
+	for(s32 cx = min.x; cx <= max.x; cx++)
+	for(s32 cy = min.y; cy <= max.y; cy++)
+	for(s32 cz = min.z; cz <= max.z; cz++) {
+		ChunkCoord c {cx, cy, cz};
+		auto chunk = world.GetOrCreateChunk(c);
+		chunk->Decompress();
+		chunks.emplace_back(c, chunk);
+	}
+
+	std::atomic<u32> nextChunk {0};
+
+	auto generateChunks = [&] {
+		for(u32 i = nextChunk++; i < chunks.size(); i = nextChunk++) {
+			auto c = chunks[i].first;
+			Generate(*chunks[i].second, c.x*(s32)world.chunkWidth, c.y*(s32)world.chunkHeight, c.z*(s32)world.chunkDepth);
+		}
+	};
+
+	if(!numThreads) numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<std::thread> threads;
+	for(u32 i = 1; i < numThreads; i++)
+		threads.emplace_back(generateChunks);
+
+	generateChunks();
+	for(auto& t: threads) t.join();
+
+	for(auto& c: chunks) {
+		auto chunk = c.second;
+		chunk->MarkDirty(0,0,0, chunk->width, chunk->height, chunk->depth);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "common.h"
+#include "noise.h"
+
+struct VoxelChunk;
+struct VoxelWorld;
+struct ChunkCoord;
+
+// The grass floor and red marker lines the demo has always started with
+void GenerateTestTerrain(VoxelChunk&);
+
+// Solid blocks scattered with the given density, for stress testing
+void GenerateRandomTerrain(VoxelChunk&, u32 seed, f32 density);
+
+// Rolling hills from a fractal heightmap, reshaped by 3D density noise 
+//	into overhangs and carved with caves. Colored grass, sand or snow on 
+//	top by biome, then dirt, then stone.
+// Voxels only depend on the seed and their world position, so chunks can
+//	be generated in any order on any thread
+struct TerrainGenerator {
+	GradientNoise noise;
+
+	f32 baseHeight;
+	f32 hillHeight;
+	f32 snowHeight;
+
+	TerrainGenerator(u32 seed);
+
+	// Writes straight into the chunk's blockData and colorData, decompressing
+	//	it first, and marks nothing dirty. origin is the world voxel 
+	//	coordinate of the chunk's first voxel
+	void Generate(VoxelChunk&, s32 ox, s32 oy, s32 oz) const;
+
+	// Creates every chunk from min to max inclusive and generates them spread 
+	//	across threads, then marks them dirty. Lighting needs baking afterwards
+	void Generate(VoxelWorld&, const ChunkCoord& min, const ChunkCoord& max, u32 numThreads = 0) const;
+};
+
+#endif
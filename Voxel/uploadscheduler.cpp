@@ -0,0 +1,110 @@
+#include "uploadscheduler.h"
+#include "voxelchunk.h"
+#include "radixsort.h"
+
+#include <chrono>
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::high_resolution_clock;
+
+UploadScheduler::UploadScheduler(u32 byteBudget, f32 timeBudgetMs)
+	: byteBudget{byteBudget}, timeBudgetMs{timeBudgetMs} {
+	numUploaded = 0;
+	bytesUploaded = 0;
+	uploadMs = 0.f;
+}
+
+UploadScheduler::~UploadScheduler() {
+	Clear();
+}
+
+void UploadScheduler::Add(VoxelChunk* chunk) {
+	queue.push_back(chunk);
+}
+
+void UploadScheduler::Remove(VoxelChunk* chunk) {
+	auto owned = [chunk](VoxelChunk* c) {
+		if(c == chunk) return true;
+		for(auto lod: chunk->lods)
+			if(c == lod) return true;
+
+		return false;
+	};
+
+	queue.erase(std::remove_if(queue.begin(), queue.end(), owned), queue.end());
+}
+
+void UploadScheduler::Clear() {
+	for(auto chunk: queue) {
+		chunk->meshing = false;
+		chunk->Invalidate();
+	}
+
+	queue.clear();
+}
+
+void UploadScheduler::Update(const Frustum& frustum, const vec3& cameraPos) {
+	numUploaded = 0;
+	bytesUploaded = 0;
+	uploadMs = 0.f;
+	if(queue.empty()) return;
+
+	// Distances are squared, which FloatKey keeps below the top bit,
+	//	so setting it puts everything outside the frustum last
+	std::vector<SortKey> keys, scratch;
+	for(u32 i = 0; i < queue.size(); i++) {
+		// The whole chunk, the new mesh can be anywhere in it
+		AABB box = queue[i]->ChunkBounds();
+		vec3 outside = glm::max(glm::max(box.min - cameraPos, cameraPos - box.max), vec3{0.f});
+
+		u32 key = FloatKey(glm::dot(outside, outside));
+		if(!frustum.Intersects(box)) key |= 1u<<31;
+		keys.push_back(SortKey{key, i});
+	}
+
+	RadixSort(keys, scratch);
+
+	// Stops at the first chunk that doesn't fit rather than looking for a 
+	//	smaller one further down, which would jump the queue
+	auto start = high_resolution_clock::now();
+
+	for(auto& key: keys) {
+		auto chunk = queue[key.index];
+		u32 size = UploadSize(chunk);
+
+		bool overBudget = (byteBudget && bytesUploaded + size > byteBudget)
+			|| (timeBudgetMs > 0.f && uploadMs >= timeBudgetMs);
+		if(numUploaded && overBudget) break;
+
+		chunk->UploadMesh();
+		chunk->meshing = false;
+
+		numUploaded++;
+		bytesUploaded += size;
+		uploadMs = duration_cast<duration<f32, std::milli>>(high_resolution_clock::now() - start).count();
+	}
+
+	std::vector<VoxelChunk*> remaining;
+	for(u32 i = numUploaded; i < keys.size(); i++)
+		remaining.push_back(queue[keys[i].index]);
+
+	std::swap(queue, remaining);
+}
+
+void UploadScheduler::Flush() {
+	for(auto chunk: queue) {
+		chunk->UploadMesh();
+		chunk->meshing = false;
+	}
+
+	queue.clear();
+}
+
+u32 UploadScheduler::UploadSize(const VoxelChunk* chunk) {
+	u32 wordsPerQuad = chunk->buildInstanced? VoxelChunk::instanceArena.wordsPerQuad : VoxelChunk::meshArena.wordsPerQuad;
+	u32 words = chunk->numBuiltQuads*(wordsPerQuad + 1)
+		+ chunk->builtTransparentVertices.size() + chunk->builtTransparentFaces.size();
+
+	return words*sizeof(u32);
+}
@@ -0,0 +1,48 @@
+#ifndef UPLOADSCHEDULER_H
+#define UPLOADSCHEDULER_H
+
+#include "common.h"
+
+struct VoxelChunk;
+struct Frustum;
+
+// Holds chunks whose meshes have been built but not uploaded, and uploads
+//	as many each frame as fit in a byte and a time budget. Chunks in the
+//	frustum go first, then the rest, nearest first in each.
+// A queued chunk keeps meshing set, so it isn't rebuilt and keeps drawing
+//	its previous mesh until Update gets to it
+struct UploadScheduler {
+	std::vector<VoxelChunk*> queue;
+
+	// Per frame, 0 for no limit. The first chunk of a frame is always
+	//	uploaded however big, so nothing can be held back forever
+	u32 byteBudget;
+	f32 timeBudgetMs;
+
+	// Of the last Update
+	u32 numUploaded;
+	u32 bytesUploaded;
+	f32 uploadMs;
+
+	UploadScheduler(u32 byteBudget = 1u<<20, f32 timeBudgetMs = 2.f);
+	~UploadScheduler();
+
+	// Takes a chunk that has been through BuildMesh, with meshing set
+	void Add(VoxelChunk*);
+
+	// Drops the chunk and its lods without uploading, for chunks being destroyed
+	void Remove(VoxelChunk*);
+
+	// Drops everything, the chunks are rebuilt next time they're drawn
+	void Clear();
+
+	// frustum and cameraPos are in world space, like the chunks' WorldBounds.
+	//	Must be called from the thread owning the GL context, as must Flush
+	void Update(const Frustum&, const vec3& cameraPos);
+	void Flush(); // Uploads everything, ignoring the budgets
+
+	// Bytes UploadMesh will copy out of the built mesh
+	static u32 UploadSize(const VoxelChunk*);
+};
+
+#endif
@@ -1,46 +1,114 @@
 #include "voxelchunk.h"
+#include "greedymesher.h"
+#include "meshcache.h"
+#include "radixsort.h"
 #include "shader.h"
 
+static Log logger{"VoxelChunk"};
+
+constexpr u32 VoxelChunk::maxWidth;
+constexpr u32 VoxelChunk::maxDepth;
+
 u32 VoxelChunk::elementBO = 0;
 u32 VoxelChunk::elementBufferSize = 0;
-constexpr u32 bufferSize = 2<<20; // 4MB
+const mat4 VoxelChunk::coordinateCorrection = glm::rotate<f32>(-PI/2.f, vec3{1,0,0});
+MeshBufferPool VoxelChunk::buildBufferPool;
+MeshArena VoxelChunk::meshArena;
+MeshArena VoxelChunk::instanceArena {2};
+MeshCache* VoxelChunk::meshCache = nullptr;
 
-static Log logger{"VoxelChunk"};
+u8 VoxelChunk::blockGeometry[256] { // TODO: A better way
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_empty, 0, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_solid, 0, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_slab_lower, 0, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 0, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 1, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 2, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 3, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_crossed_pair, 3, 0),
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_solid, 0, 0), // Lamp
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_transp, 0, 0), // Glass
+	STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_transp, 0, 0), // Water
+};
+
+u8 VoxelChunk::blockLight[256] {
+	0, 0, 0, 0, 0, 0, 0, 0,
+	14, // Lamp
+};
+
+u8 VoxelChunk::blockMesh[256] {
+	0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, // Glass
+	1, // Water
+};
+
+// Light level to stbvox lighting, with a little left over in the dark
+static const u8 lightCurve[16] {
+	16, 32, 48, 64, 80, 96, 112, 128, 143, 159, 175, 191, 207, 223, 239, 255
+};
+
+// blockGeometry with solid cubes removed, for the stbvox half of greedy meshing
+static u8* NonCubeGeometry() {
+	static u8 geometry[256];
+	static bool initialised = [] {
+		for(u32 i = 0; i < 256; i++)
+			geometry[i] = VoxelChunk::IsSolidCube(i)? STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_empty, 0, 0) : VoxelChunk::blockGeometry[i];
+		return true;
+	}();
+
+	(void) initialised;
+	return geometry;
+}
+
+static vec3 VertexPosition(u32 vert) {
+	return vec3{(f32)(vert & 127u), (f32)((vert>>7) & 127u), ((vert>>14) & 511u) * 0.5f};
+}
 
 VoxelChunk::VoxelChunk(u32 w, u32 h, u32 d) 
-	: width{w}, height{h}, depth{d} {
-	// TODO: Use a heuristic here and resize buffers dynamically
-	vertexBuildBuffer = new u8[4*bufferSize];
-	faceBuildBuffer = new u8[bufferSize];
+	: width{std::min(w, maxWidth)}, height{std::min(h, maxWidth)}, depth{std::min(d, maxDepth)} {
+	if(width != w || height != h || depth != d)
+		logger << "Chunks can't be " << w << "x" << h << "x" << d << ", clamped to " 
+			<< width << "x" << height << "x" << depth;
 
-	blockData = new u8[(width+2)*(height+2)*(depth+2)];
-	colorData = new stbvox_rgb[(width+2)*(height+2)*(depth+2)];
+	vertexData = nullptr;
+	faceData = nullptr;
 
-	memset(blockData, 0, (width+2)*(height+2)*(depth+2));
-	memset(colorData, 255, (width+2)*(height+2)*(depth+2) * sizeof(stbvox_rgb));
+	blockData = new u8[PaddedSize()];
+	colorData = new stbvox_rgb[PaddedSize()];
+	packedData = nullptr;
+	lightData = nullptr;
+	hasStaleBricks = true;
 
-	vertexBO = faceBO = faceTex = 0;
-	numQuads = 0;
-	dirty = true;
+	memset(blockData, 0, PaddedSize());
+	memset(colorData, 255, PaddedSize() * sizeof(stbvox_rgb));
+	occupancy.Resize(w, h, d);
+
+	meshAllocation.offset = meshAllocation.size = 0;
+	transparentAllocation.offset = transparentAllocation.size = 0;
+	numQuads = drawQuads = numBuiltQuads = 0;
+	numTransparentQuads = 0;
+	instancing = instanced = buildInstanced = false;
+	for(auto& c: sortCell) c = 0;
+	transparentSorted = false;
+	transparentUploaded = false;
+	buildSlabMask = 0;
+	meshing = false;
+
+	for(auto& n: neighbours) n = nullptr;
+	lodLevel = 0;
+
+	for(auto& lod: lods) lod = nullptr;
+	staleLodMask = ~0u;
+	Invalidate();
+	meshMethod = MeshMethod::Stbvox;
 
 	stbvox_init_mesh_maker(&mm);
 	auto vinput = stbvox_get_input_description(&mm);
 	memset(vinput, 0, sizeof(stbvox_input_description));
 
-	static u8 voxelTypes[] { // TODO: A better way
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_empty, 0, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_solid, 0, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_slab_lower, 0, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 0, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 1, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 2, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_floor_slope_north_is_top, 3, 0),
-		STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_crossed_pair, 3, 0),
-	};
-
 	vinput->rgb = colorData;
 	vinput->blocktype = blockData;
-	vinput->block_geometry = voxelTypes;
+	vinput->block_geometry = blockGeometry;
 
 	stbvox_set_input_stride(&mm, (depth+2)*(height+2), (depth+2));
 	stbvox_set_input_range(&mm, 1, 1, 1, width+1, height+1, depth+1);
@@ -50,10 +118,28 @@ VoxelChunk::VoxelChunk(u32 w, u32 h, u32 d)
 }
 
 VoxelChunk::~VoxelChunk() {
-	delete[] vertexBuildBuffer;
-	delete[] faceBuildBuffer;
+	delete[] vertexData;
+	delete[] faceData;
 	delete[] blockData;
 	delete[] colorData;
+	delete packedData;
+	delete[] lightData;
+
+	for(auto lod: lods) delete lod;
+
+	Arena().Free(&meshAllocation);
+	meshArena.Free(&transparentAllocation);
+}
+
+bool VoxelChunk::IsSolidCube(u8 blockType) {
+	return blockType && blockGeometry[blockType] == STBVOX_MAKE_GEOMETRY(STBVOX_GEOM_solid, 0, 0);
+}
+
+bool VoxelChunk::SupportsInstancing() {
+	s32 major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major > 3 || (major == 3 && minor >= 3);
 }
 
 void VoxelChunk::LengthenElementBuffer(u32 minNumQuads) {
@@ -82,78 +168,1068 @@ void VoxelChunk::LengthenElementBuffer(u32 minNumQuads) {
 	delete[] elements;
 }
 
-void VoxelChunk::GenerateMesh() {
-	stbvox_reset_buffers(&mm);
-	stbvox_set_buffer(&mm, 0, 0, vertexBuildBuffer, bufferSize*4);
-	stbvox_set_buffer(&mm, 0, 1, faceBuildBuffer, bufferSize);
-	if(!stbvox_make_mesh(&mm)) {
-		// TODO: resize and try again/continue
-		logger << "Mesh generator ran out of room";
+void VoxelChunk::BeginBuild() {
+	buildSlabMask = 0;
+	if(!dirty) return;
+
+	for(u32 sl = 0; sl < NumSlabs(); sl++) {
+		u32 x0 = sl*slabWidth;
+		u32 x1 = std::min(x0 + slabWidth, width);
+		if(x0 < dirtyMax[0] && dirtyMin[0] < x1)
+			buildSlabMask |= 1u<<sl;
 	}
 
-	numQuads = stbvox_get_quad_count(&mm, 0);
+	dirty = false;
+	dirtyMin[0] = width; dirtyMin[1] = height; dirtyMin[2] = depth;
+	dirtyMax[0] = dirtyMax[1] = dirtyMax[2] = 0;
 
-	if(!vertexBO) glGenBuffers(1, &vertexBO);
-	if(!faceBO) glGenBuffers(1, &faceBO);
-	if(!faceTex) glGenTextures(1, &faceTex);
+	// Instances only fit the greedy meshers' quads, and anything that isn't
+	//	a cube goes through stbvox
+	buildInstanced = instancing && meshMethod != MeshMethod::Stbvox && !occupancy.AnyNonCube(0, width);
+	if(buildInstanced != instanced) buildSlabMask = (1u << NumSlabs()) - 1;
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
-	glBufferData(GL_ARRAY_BUFFER, numQuads*4*sizeof(u32), vertexBuildBuffer, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+void VoxelChunk::BuildMesh() {
+	BeginBuild();
 
-	glBindBuffer(GL_TEXTURE_BUFFER, faceBO);
-	glBufferData(GL_TEXTURE_BUFFER, numQuads*sizeof(u32), faceBuildBuffer, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	u8* lighting = nullptr;
+	if(lightData) {
+		lighting = new u8[PaddedSize()];
+		CopyLighting(lighting);
+	}
 
-	glBindTexture(GL_TEXTURE_BUFFER, faceTex);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8UI, faceBO);
-	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	if(!packedData) {
+		CopyBorders(blockData);
+		BuildMesh(blockData, colorData, lighting);
+		delete[] lighting;
+		return;
+	}
+
+	auto blocks = new u8[PaddedSize()];
+	auto colors = new stbvox_rgb[PaddedSize()];
+	packedData->Unpack(blocks, colors);
+	CopyBorders(blocks);
+
+	BuildMesh(blocks, colors, lighting);
+
+	delete[] blocks;
+	delete[] colors;
+	delete[] lighting;
+}
+
+void VoxelChunk::BuildMesh(u8* blocks, stbvox_rgb* colors, u8* lighting, const Occupancy* masks) {
+	if(!masks) masks = &occupancy;
+
+	auto vinput = stbvox_get_input_description(&mm);
+	vinput->blocktype = blocks;
+	vinput->rgb = colors;
+	vinput->lighting = lighting;
+	vinput->selector = nullptr;
+
+	u32 allSlabs = (1u << NumSlabs()) - 1;
+	bool cacheable = meshCache && buildSlabMask == allSlabs;
+	u64 cacheKey = 0;
+
+	if(cacheable) {
+		cacheKey = MeshCache::Key(*this, blocks, colors, lighting);
+		if(meshCache->Load(cacheKey, this)) return;
+	}
+
+	auto buffers = buildBufferPool.Acquire();
+
+	// Transparent blocks go to stbvox's second mesh, picked per voxel. 
+	//	They're never cubes, so there are none unless something isn't
+	u8* selector = nullptr;
+	MeshBuildBuffers* transparent = nullptr;
+	if(masks->AnyNonCube(0, width)) {
+		selector = new u8[PaddedSize()];
+		u8 anyTransparent = 0;
+		for(u32 i = 0; i < PaddedSize(); i++)
+			anyTransparent |= selector[i] = blockMesh[blocks[i]];
+
+		if(anyTransparent) {
+			vinput->selector = selector;
+			transparent = buildBufferPool.Acquire();
+		}
+	}
+
+	numBuiltQuads = 0;
+	builtSlabQuads.clear();
+	builtSlabBounds.clear();
+	builtSlabOccluders.clear();
+	builtSlabTransparentQuads.clear();
+	builtTransparentVertices.clear();
+	builtTransparentFaces.clear();
+
+	for(u32 sl = 0; sl < NumSlabs(); sl++) {
+		if(!(buildSlabMask & (1u<<sl))) continue;
+
+		u32 start = numBuiltQuads;
+		u32 transparentStart = builtTransparentFaces.size();
+		u32 x0 = sl*slabWidth;
+		u32 x1 = std::min(x0 + slabWidth, width);
+
+		// Empty slabs, and slabs of solid cubes buried by their neighbours, 
+		//	have nothing to mesh
+		bool hasFaces = masks->AnyNonCube(x0, x1) 
+			|| (masks->AnyOccupied(x0, x1) && CountExposedFaces(*this, *masks, blocks, x0, x1));
+		if(hasFaces) MeshRange(blocks, colors, lighting, *masks, x0, x1, buffers, transparent);
+		builtSlabQuads.push_back(numBuiltQuads - start);
+		builtSlabTransparentQuads.push_back(builtTransparentFaces.size() - transparentStart);
+
+		AABB bounds;
+		for(u32 v = start*4; v < numBuiltQuads*4; v++)
+			bounds.Add(VertexPosition(buffers->vertices[v]));
+		for(u32 v = transparentStart*4; v < builtTransparentVertices.size(); v++)
+			bounds.Add(VertexPosition(builtTransparentVertices[v]));
+		builtSlabBounds.push_back(bounds);
+
+		builtSlabOccluders.emplace_back();
+		FindOccluders(*masks, x0, x1, builtSlabOccluders.back());
+	}
+
+	delete[] vertexData;
+	delete[] faceData;
+	vertexData = new u32[numBuiltQuads*4];
+	faceData = new u32[numBuiltQuads];
+	memcpy(vertexData, buffers->vertices, numBuiltQuads*4*sizeof(u32));
+	memcpy(faceData, buffers->faces, numBuiltQuads*sizeof(u32));
+
+	buildBufferPool.Release(buffers);
+	if(transparent) buildBufferPool.Release(transparent);
+	delete[] selector;
+
+	if(cacheable) meshCache->Store(cacheKey, *this);
+}
+
+// Appends the mesh for voxels with x0 <= x < x1 to buffers
+void VoxelChunk::MeshRange(u8* blocks, stbvox_rgb* colors, u8* lighting, const Occupancy& masks, 
+	u32 x0, u32 x1, MeshBuildBuffers* buffers, MeshBuildBuffers* transparent) {
+	auto vinput = stbvox_get_input_description(&mm);
+	bool greedy = (meshMethod != MeshMethod::Stbvox);
+	bool runStbvox = true;
+
+	if(greedy) {
+		// stbvox only needs to run if there's something the greedy mesher can't handle
+		runStbvox = masks.AnyNonCube(x0, x1);
+		vinput->block_geometry = NonCubeGeometry();
+	}
+
+	auto growBuffers = [&](MeshBuildBuffers* grown, u32 numKept) {
+		u32 oldSize = grown->Size();
+		grown->Grow(numKept);
+		buildBufferPool.NotifyGrown(oldSize, grown->Size());
+	};
+
+	if(runStbvox) {
+		stbvox_set_input_range(&mm, x0+1, 1, 1, x1+1, height+1, depth+1);
+		u32 numTransparent = 0;
+
+		// If stbvox runs out of room it stops where it was, so it can
+		//	carry on into the remainder of a larger buffer
+		while(true) {
+			u32 room = buffers->maxQuads - numBuiltQuads;
+			stbvox_reset_buffers(&mm);
+			stbvox_set_buffer(&mm, 0, 0, buffers->vertices + numBuiltQuads*4, room*4*sizeof(u32));
+			stbvox_set_buffer(&mm, 0, 1, buffers->faces + numBuiltQuads, room*sizeof(u32));
+
+			if(transparent) {
+				u32 transparentRoom = transparent->maxQuads - numTransparent;
+				stbvox_set_buffer(&mm, 1, 0, transparent->vertices + numTransparent*4, transparentRoom*4*sizeof(u32));
+				stbvox_set_buffer(&mm, 1, 1, transparent->faces + numTransparent, transparentRoom*sizeof(u32));
+			}
+
+			bool finished = stbvox_make_mesh(&mm);
+			numBuiltQuads += stbvox_get_quad_count(&mm, 0);
+			numTransparent += stbvox_get_quad_count(&mm, 1);
+			if(finished) break;
+
+			// stbvox stops when the mesh a block goes to has room for less than 6 quads
+			if(buffers->maxQuads - numBuiltQuads < 6) growBuffers(buffers, numBuiltQuads);
+			if(transparent && transparent->maxQuads - numTransparent < 6) growBuffers(transparent, numTransparent);
+		}
+
+		if(numTransparent) {
+			builtTransparentVertices.insert(builtTransparentVertices.end(), 
+				transparent->vertices, transparent->vertices + numTransparent*4);
+			builtTransparentFaces.insert(builtTransparentFaces.end(), 
+				transparent->faces, transparent->faces + numTransparent);
+		}
+	}
+
+	if(greedy) {
+		vinput->block_geometry = blockGeometry;
+
+		while(true) {
+			bool full = false;
+			u32* vertices = buffers->vertices + numBuiltQuads*4;
+			u32* faces = buffers->faces + numBuiltQuads;
+			u32 room = buffers->maxQuads - numBuiltQuads;
+
+			u32 greedyQuads = (meshMethod == MeshMethod::BinaryGreedy)
+				? BinaryGreedyMesh(*this, masks, blocks, colors, lighting, x0, x1, vertices, faces, room, &full)
+				: GreedyMesh(*this, blocks, colors, lighting, x0, x1, vertices, faces, room, &full);
+
+			if(!full) {
+				numBuiltQuads += greedyQuads;
+				break;
+			}
+
+			growBuffers(buffers, numBuiltQuads);
+		}
+	}
+}
+
+// Boxes of solid cubes spanning the whole x range, found in cells 
+//	occluderCell voxels on a side then merged along z and y. They only 
+//	need to be conservative, not complete
+void VoxelChunk::FindOccluders(const Occupancy& masks, u32 x0, u32 x1, std::vector<AABB>& boxes) const {
+	const u32 occluderCell = 4;
+
+	auto cellSolid = [&](u32 y0, u32 z0) {
+		return masks.BoxSolid(x0, y0, z0, x1, std::min(y0 + occluderCell, height), std::min(z0 + occluderCell, depth));
+	};
+
+	// Runs from the last row of cells, z0, z1 and the box they're part of
+	struct Run { u32 z0, z1, box; };
+	std::vector<Run> prevRuns, runs;
+
+	for(u32 y = 0; y < height; y += occluderCell) {
+		u32 y1 = std::min(y + occluderCell, height);
+		runs.clear();
+
+		for(u32 z = 0; z < depth; ) {
+			if(!cellSolid(y, z)) {
+				z += occluderCell;
+				continue;
+			}
+
+			u32 z0 = z;
+			do z += occluderCell; while(z < depth && cellSolid(y, z));
+			u32 z1 = std::min(z, depth);
+
+			auto prev = std::find_if(prevRuns.begin(), prevRuns.end(), 
+				[&](const Run& r) { return r.z0 == z0 && r.z1 == z1; });
+
+			if(prev != prevRuns.end()) {
+				boxes[prev->box].max.y = y1 + 1.f;
+				runs.push_back(*prev);
+				continue;
+			}
+
+			// Mesh space is offset by the padding
+			AABB box;
+			box.min = vec3{x0 + 1.f, y + 1.f, z0 + 1.f};
+			box.max = vec3{x1 + 1.f, y1 + 1.f, z1 + 1.f};
+			runs.push_back(Run{z0, z1, (u32)boxes.size()});
+			boxes.push_back(box);
+		}
+
+		std::swap(runs, prevRuns);
+	}
+}
+
+// Zeroed vertices collapse to a point, so they're used to pad out slabs
+static const u32* Zeroes(u32 count) {
+	static std::vector<u32> zeroes;
+	if(zeroes.size() < count) zeroes.resize(count, 0);
+	return zeroes.data();
+}
+
+void VoxelChunk::UploadMesh() {
+	// Converted here so BuildMesh and the mesh cache only deal in vertices
+	if(buildInstanced) {
+		auto instances = new u32[numBuiltQuads*2];
+		EncodeInstances(vertexData, faceData, numBuiltQuads, instances);
+		delete[] vertexData;
+		vertexData = instances;
+	}
+
+	u32 numSlabs = NumSlabs();
+	bool relayout = !meshAllocation.size || slabs.size() != numSlabs || buildInstanced != instanced;
+
+	for(u32 sl = 0, b = 0; sl < numSlabs && !relayout; sl++) {
+		if(!(buildSlabMask & (1u<<sl))) continue;
+		relayout = builtSlabQuads[b++] > slabs[sl].capacity;
+	}
+
+	if(relayout) {
+		RelayoutMesh();
+
+	}else{
+		auto& arena = Arena();
+		u32 words = arena.wordsPerQuad;
+		u32 src = 0;
+
+		for(u32 sl = 0, b = 0; sl < numSlabs; sl++) {
+			if(!(buildSlabMask & (1u<<sl))) continue;
+
+			auto& slab = slabs[sl];
+			u32 n = builtSlabQuads[b++];
+			u32 stale = std::max(slab.numQuads, n) - n;
+
+			arena.UploadVertices(meshAllocation, slab.offset, n, vertexData + src*words);
+			if(stale) arena.UploadVertices(meshAllocation, slab.offset+n, stale, Zeroes(stale*words));
+			arena.UploadFaces(meshAllocation, slab.offset, n, faceData + src);
+
+			slab.numQuads = n;
+			slab.bounds = builtSlabBounds[b-1];
+			slab.occluders = std::move(builtSlabOccluders[b-1]);
+			src += n;
+		}
+	}
+
+	numQuads = 0;
+	meshBounds = AABB{};
+	for(auto& slab: slabs) {
+		numQuads += slab.numQuads;
+		meshBounds.Add(slab.bounds);
+	}
+	drawQuads = slabs.empty()? 0 : (slabs.back().offset + slabs.back().numQuads);
+
+	// Transparent quads are spliced together on the CPU, keeping the old 
+	//	ones of slabs that weren't rebuilt. They're uploaded once sorted
+	if(numTransparentQuads || !builtTransparentFaces.empty()) {
+		std::vector<u32> vertices, faces, slabQuads(numSlabs, 0);
+		u32 from = 0, builtFrom = 0;
+
+		for(u32 sl = 0, b = 0; sl < numSlabs; sl++) {
+			u32 oldQuads = (sl < transparentSlabQuads.size())? transparentSlabQuads[sl] : 0;
+
+			if(buildSlabMask & (1u<<sl)) {
+				u32 n = builtSlabTransparentQuads[b++];
+				vertices.insert(vertices.end(), builtTransparentVertices.begin() + builtFrom*4, 
+					builtTransparentVertices.begin() + (builtFrom+n)*4);
+				faces.insert(faces.end(), builtTransparentFaces.begin() + builtFrom, 
+					builtTransparentFaces.begin() + builtFrom+n);
+				slabQuads[sl] = n;
+				builtFrom += n;
+
+			}else{
+				vertices.insert(vertices.end(), transparentVertices.begin() + from*4, 
+					transparentVertices.begin() + (from+oldQuads)*4);
+				faces.insert(faces.end(), transparentFaces.begin() + from, 
+					transparentFaces.begin() + from+oldQuads);
+				slabQuads[sl] = oldQuads;
+			}
+
+			from += oldQuads;
+		}
+
+		transparentVertices = std::move(vertices);
+		transparentFaces = std::move(faces);
+		transparentSlabQuads = std::move(slabQuads);
+		numTransparentQuads = transparentFaces.size();
+		transparentSorted = false;
+		transparentUploaded = false;
+
+		if(!numTransparentQuads) meshArena.Free(&transparentAllocation);
+	}
+
+	builtTransparentVertices.clear();
+	builtTransparentFaces.clear();
+
+	delete[] vertexData;
+	delete[] faceData;
+	vertexData = nullptr;
+	faceData = nullptr;
+}
+
+// Gives every slab some headroom so small edits don't move things around.
+//	Slabs that weren't rebuilt are copied across on the GPU, which is never
+//	needed when switching arenas since BeginBuild rebuilds them all
+void VoxelChunk::RelayoutMesh() {
+	auto& arena = buildInstanced? instanceArena : meshArena;
+	u32 words = arena.wordsPerQuad;
+
+	u32 numSlabs = NumSlabs();
+	std::vector<MeshSlab> newSlabs(numSlabs);
+	std::vector<u32> srcOffsets(numSlabs, 0);
+
+	u32 total = 0;
+	u32 src = 0;
+	for(u32 sl = 0, b = 0; sl < numSlabs; sl++) {
+		u32 n = 0;
+		if(buildSlabMask & (1u<<sl)) {
+			newSlabs[sl].bounds = builtSlabBounds[b];
+			newSlabs[sl].occluders = std::move(builtSlabOccluders[b]);
+			n = builtSlabQuads[b++];
+			srcOffsets[sl] = src;
+			src += n;
+		}else if(sl < slabs.size()) {
+			newSlabs[sl].bounds = slabs[sl].bounds;
+			newSlabs[sl].occluders = std::move(slabs[sl].occluders);
+			n = slabs[sl].numQuads;
+		}
+
+		newSlabs[sl].offset = total;
+		newSlabs[sl].capacity = n + n/4 + 16;
+		newSlabs[sl].numQuads = n;
+		total += newSlabs[sl].capacity;
+	}
+
+	// The old allocation stays live until everything has been copied out of it
+	MeshAllocation newAllocation;
+	arena.Allocate(&newAllocation, total);
+	arena.UploadVertices(newAllocation, 0, total, Zeroes(total*words));
+
+	for(u32 sl = 0; sl < numSlabs; sl++) {
+		auto& slab = newSlabs[sl];
+
+		if(buildSlabMask & (1u<<sl)) {
+			u32 from = srcOffsets[sl];
+			arena.UploadVertices(newAllocation, slab.offset, slab.numQuads, vertexData + from*words);
+			arena.UploadFaces(newAllocation, slab.offset, slab.numQuads, faceData + from);
+
+		}else if(slab.numQuads) {
+			arena.Copy(meshAllocation, slabs[sl].offset, newAllocation, slab.offset, slab.numQuads);
+		}
+	}
+
+	Arena().Free(&meshAllocation);
+	arena.Move(&newAllocation, &meshAllocation);
+	instanced = buildInstanced;
+	slabs = std::move(newSlabs);
+}
+
+AABB VoxelChunk::WorldBounds() const {
+	return meshBounds.Transformed(modelMatrix * coordinateCorrection);
+}
+
+AABB VoxelChunk::ChunkBounds() const {
+	// Past the padding, like the mesh
+	AABB box;
+	box.min = vec3{1.f};
+	box.max = vec3{width+1.f, height+1.f, depth+1.f};
+	return box.Transformed(modelMatrix * coordinateCorrection);
+}
+
+void VoxelChunk::GenerateMesh() {
+	BuildMesh();
+	UploadMesh();
 }
 
 void VoxelChunk::Render(ShaderProgram& program) {
-	if(dirty) {
+	if(dirty && !meshing)
 		GenerateMesh();
-		dirty = false;
+
+	if(!numQuads) return;
+
+	if(instanced) DrawInstances(program);
+	else Draw(program, meshAllocation, drawQuads);
+}
+
+bool VoxelChunk::SortTransparent(const vec3& cameraPos) {
+	vec3 eye = vec3(glm::inverse(modelMatrix * coordinateCorrection) * vec4{cameraPos, 1.f});
+	s32 cell[3] {(s32)std::floor(eye.x), (s32)std::floor(eye.y), (s32)std::floor(eye.z)};
+
+	if(transparentSorted && !memcmp(cell, sortCell, sizeof(cell)))
+		return false;
+
+	memcpy(sortCell, cell, sizeof(cell));
+	transparentSorted = true;
+	transparentUploaded = false;
+
+	// Sorted from the middle of the cell, so every position in it gets the 
+	//	same order. Inverted distances put the furthest first
+	vec3 center = vec3{(f32)cell[0], (f32)cell[1], (f32)cell[2]} + 0.5f;
+
+	std::vector<SortKey> keys(numTransparentQuads), scratch;
+	for(u32 q = 0; q < numTransparentQuads; q++) {
+		const u32* verts = &transparentVertices[q*4];
+		vec3 quadCenter = (VertexPosition(verts[0]) + VertexPosition(verts[1]) 
+			+ VertexPosition(verts[2]) + VertexPosition(verts[3])) * 0.25f;
+
+		vec3 diff = quadCenter - center;
+		keys[q] = SortKey{~FloatKey(glm::dot(diff, diff)), q};
+	}
+
+	RadixSort(keys, scratch);
+
+	transparentOrder.resize(numTransparentQuads);
+	for(u32 q = 0; q < numTransparentQuads; q++)
+		transparentOrder[q] = keys[q].index;
+
+	return true;
+}
+
+bool VoxelChunk::PrepareTransparent(const vec3& cameraPos) {
+	if(!numTransparentQuads) return false;
+
+	bool sorted = SortTransparent(cameraPos);
+	if(transparentUploaded) return sorted;
+
+	// Some slack either way so edits don't reallocate every time
+	u32 n = numTransparentQuads;
+	if(transparentAllocation.size < n || transparentAllocation.size > n*2) {
+		meshArena.Free(&transparentAllocation);
+		meshArena.Allocate(&transparentAllocation, n + n/4 + 16);
+	}
+
+	std::vector<u32> vertices(n*4), faces(n);
+	for(u32 i = 0; i < n; i++) {
+		u32 q = transparentOrder[i];
+		memcpy(&vertices[i*4], &transparentVertices[q*4], 4*sizeof(u32));
+		faces[i] = transparentFaces[q];
 	}
 
-	if(numQuads >= elementBufferSize) 
-		LengthenElementBuffer(numQuads);
+	meshArena.UploadVertices(transparentAllocation, 0, n, vertices.data());
+	meshArena.UploadFaces(transparentAllocation, 0, n, faces.data());
+	transparentUploaded = true;
+	return sorted;
+}
+
+void VoxelChunk::RenderTransparent(ShaderProgram& program) {
+	if(!numTransparentQuads) return;
+	Draw(program, transparentAllocation, numTransparentQuads);
+}
+
+void VoxelChunk::Draw(ShaderProgram& program, const MeshAllocation& allocation, u32 count) {
+	if(count >= elementBufferSize) 
+		LengthenElementBuffer(count);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBO);
+	glBindBuffer(GL_ARRAY_BUFFER, meshArena.vertexBO);
 	glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 4, nullptr);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_BUFFER, faceTex);
+	glBindTexture(GL_TEXTURE_BUFFER, meshArena.faceTex);
 	glUniform1i(program.GetUniform("facearray"), 0);
 
-	static mat4 coordinateCorrection = glm::rotate<f32>(-PI/2.f, vec3{1,0,0});
 	glUniformMatrix4fv(program.GetUniform("model"), 1, false, 
 		glm::value_ptr(modelMatrix * coordinateCorrection));
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBO);
-	glDrawElements(GL_TRIANGLES, numQuads*6, GL_UNSIGNED_INT, nullptr);
+	// The base vertex also offsets gl_VertexID, so faces are found too
+	glDrawElementsBaseVertex(GL_TRIANGLES, count*6, GL_UNSIGNED_INT, nullptr, allocation.offset*4);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindTexture(GL_TEXTURE_BUFFER, 0);
 }
 
+// Attribute location of the instance record in voxel_instanced.vs
+static const u32 instanceAttribute = 2;
+
+void VoxelChunk::DrawInstances(ShaderProgram& program) {
+	// Nothing is read per vertex, so the vertex attribute is left off
+	glDisableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceArena.vertexBO);
+	glVertexAttribIPointer(instanceAttribute, 2, GL_UNSIGNED_INT, 2*sizeof(u32), 
+		(void*)(uintptr_t)(meshAllocation.offset*2*sizeof(u32)));
+	glVertexAttribDivisor(instanceAttribute, 1);
+	glEnableVertexAttribArray(instanceAttribute);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceArena.faceTex);
+	glUniform1i(program.GetUniform("facearray"), 0);
+	glUniform1i(program.GetUniform("face_offset"), meshAllocation.offset);
+
+	glUniformMatrix4fv(program.GetUniform("model"), 1, false, 
+		glm::value_ptr(modelMatrix * coordinateCorrection));
+
+	// Two triangles of corners from gl_VertexID per instance
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, drawQuads);
+
+	glDisableVertexAttribArray(instanceAttribute);
+	glVertexAttribDivisor(instanceAttribute, 0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
 void VoxelChunk::SetBlock(u32 x, u32 y, u32 z, u8 nval) {
 	if(x >= width || y >= height || z >= depth) return;
-	auto idx = 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
-	blockData[idx] = nval;
-	dirty = true;
+	if(packedData) Decompress();
+	blockData[Index(x,y,z)] = nval;
+	occupancy.Update(blockData, x,y,z, x+1,y+1,z+1);
+	MarkDirty(x,y,z);
 }
 
 void VoxelChunk::SetColor(u32 x, u32 y, u32 z, u8 r, u8 g, u8 b) {
 	if(x >= width || y >= height || z >= depth) return;
-	auto idx = 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
-	colorData[idx] = {r,g,b};
-	dirty = true;
+	if(packedData) Decompress();
+	colorData[Index(x,y,z)] = {r,g,b};
+	MarkDirty(x,y,z);
 }
 
 u8 VoxelChunk::GetBlock(u32 x, u32 y, u32 z) {
 	if(x >= width || y >= height || z >= depth) return 0;
-	auto idx = 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
-	return blockData[idx];
-}
\ No newline at end of file
+	if(packedData) return packedData->Get(x,y,z) >> 24;
+	return blockData[Index(x,y,z)];
+}
+
+void VoxelChunk::FillBox(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1, u8 block, stbvox_rgb color) {
+	x1 = std::min(x1, width);
+	y1 = std::min(y1, height);
+	z1 = std::min(z1, depth);
+	if(x0 >= x1 || y0 >= y1 || z0 >= z1) return;
+	if(packedData) Decompress();
+
+	u32 rowLength = z1-z0;
+	for(u32 x = x0; x < x1; x++)
+	for(u32 y = y0; y < y1; y++) {
+		u32 idx = Index(x,y,z0);
+		memset(&blockData[idx], block, rowLength);
+		std::fill_n(&colorData[idx], rowLength, color);
+	}
+
+	occupancy.Update(blockData, x0,y0,z0, x1,y1,z1);
+	MarkDirty(x0,y0,z0, x1,y1,z1);
+}
+
+void VoxelChunk::FillColumn(u32 x, u32 y, u32 z0, u32 z1, u8 block, stbvox_rgb color) {
+	FillBox(x,y,z0, x+1,y+1,z1, block, color);
+}
+
+void VoxelChunk::CopyBox(u32 x0, u32 y0, u32 z0, u32 w, u32 h, u32 d, u8* blocks, stbvox_rgb* colors) {
+	if(packedData) Decompress();
+
+	// Anything outside the chunk reads as empty
+	memset(blocks, 0, w*h*d);
+	if(colors) memset(colors, 255, w*h*d*sizeof(stbvox_rgb));
+
+	u32 cw = std::min(x0+w, width) - std::min(x0, width);
+	u32 ch = std::min(y0+h, height) - std::min(y0, height);
+	u32 cd = std::min(z0+d, depth) - std::min(z0, depth);
+	if(!cw || !ch || !cd) return;
+
+	for(u32 x = 0; x < cw; x++)
+	for(u32 y = 0; y < ch; y++) {
+		u32 src = Index(x0+x, y0+y, z0);
+		u32 dst = (x*h + y)*d;
+		memcpy(&blocks[dst], &blockData[src], cd);
+		if(colors) memcpy(&colors[dst], &colorData[src], cd*sizeof(stbvox_rgb));
+	}
+}
+
+void VoxelChunk::PasteBox(u32 x0, u32 y0, u32 z0, u32 w, u32 h, u32 d, const u8* blocks, const stbvox_rgb* colors) {
+	u32 cw = std::min(x0+w, width) - std::min(x0, width);
+	u32 ch = std::min(y0+h, height) - std::min(y0, height);
+	u32 cd = std::min(z0+d, depth) - std::min(z0, depth);
+	if(!cw || !ch || !cd) return;
+	if(packedData) Decompress();
+
+	for(u32 x = 0; x < cw; x++)
+	for(u32 y = 0; y < ch; y++) {
+		u32 dst = Index(x0+x, y0+y, z0);
+		u32 src = (x*h + y)*d;
+		memcpy(&blockData[dst], &blocks[src], cd);
+		if(colors) memcpy(&colorData[dst], &colors[src], cd*sizeof(stbvox_rgb));
+	}
+
+	occupancy.Update(blockData, x0,y0,z0, x0+cw,y0+ch,z0+cd);
+	MarkDirty(x0,y0,z0, x0+cw,y0+ch,z0+cd);
+}
+
+void VoxelChunk::SetAll(const u8* blocks, const stbvox_rgb* colors) {
+	PasteBox(0,0,0, width,height,depth, blocks, colors);
+}
+
+void VoxelChunk::MarkDirty(u32 x, u32 y, u32 z) {
+	MarkDirty(x,y,z, x+1,y+1,z+1);
+}
+
+void VoxelChunk::MarkDirty(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1) {
+	const u32 mins[3] {x0, y0, z0};
+	const u32 maxs[3] {x1, y1, z1};
+
+	MarkMeshDirty(mins, maxs);
+	MarkBricksStale(mins, maxs);
+	staleLodMask = ~0u;
+}
+
+// Lods are unlit, so light changes only need the chunk itself remeshed
+void VoxelChunk::MarkLightDirty(u32 x, u32 y, u32 z) {
+	const u32 mins[3] {x, y, z};
+	const u32 maxs[3] {x+1, y+1, z+1};
+
+	MarkMeshDirty(mins, maxs);
+}
+
+void VoxelChunk::MarkMeshDirty(const u32 mins[3], const u32 maxs[3]) {
+	const u32 dims[3] {width, height, depth};
+
+	ExpandDirtyRegion(mins, maxs);
+
+	for(u32 a = 0; a < 3; a++) {
+		u32 borderMins[3] {mins[0], mins[1], mins[2]};
+		u32 borderMaxs[3] {maxs[0], maxs[1], maxs[2]};
+
+		if(mins[a] == 0 && neighbours[a*2]) {
+			borderMins[a] = dims[a]-1;
+			borderMaxs[a] = dims[a];
+			neighbours[a*2]->ExpandDirtyRegion(borderMins, borderMaxs);
+		}
+
+		if(maxs[a] >= dims[a] && neighbours[a*2+1]) {
+			borderMins[a] = 0;
+			borderMaxs[a] = 1;
+			neighbours[a*2+1]->ExpandDirtyRegion(borderMins, borderMaxs);
+		}
+	}
+}
+
+void VoxelChunk::MarkFaceDirty(u32 face) {
+	u32 mins[3] {0, 0, 0};
+	u32 maxs[3] {width, height, depth};
+
+	u32 a = face/2;
+	if(face & 1) mins[a] = maxs[a]-1;
+	else maxs[a] = 1;
+
+	ExpandDirtyRegion(mins, maxs);
+}
+
+void VoxelChunk::ExpandDirtyRegion(const u32 mins[3], const u32 maxs[3]) {
+	const u32 dims[3] {width, height, depth};
+
+	for(u32 a = 0; a < 3; a++) {
+		dirtyMin[a] = std::min(dirtyMin[a], mins[a]? mins[a]-1 : 0);
+		dirtyMax[a] = std::max(dirtyMax[a], std::min(maxs[a]+1, dims[a]));
+	}
+
+	dirty = true;
+}
+
+void VoxelChunk::Invalidate() {
+	dirtyMin[0] = dirtyMin[1] = dirtyMin[2] = 0;
+	dirtyMax[0] = width; dirtyMax[1] = height; dirtyMax[2] = depth;
+	dirty = true;
+}
+
+VoxelChunk* VoxelChunk::GetLod(u32 level) {
+	if(!level) return this;
+	level = std::min(level, numLods-1);
+
+	u32 factor = 1u << level;
+	auto& lod = lods[level-1];
+
+	if(!lod) {
+		lod = new VoxelChunk{(width+factor-1)/factor, (height+factor-1)/factor, (depth+factor-1)/factor};
+		staleLodMask |= 1u << level;
+	}
+
+	// A worker meshing the lod reads meshMethod, so a later call switches it
+	if(lod->meshMethod != meshMethod && !lod->meshing) {
+		lod->meshMethod = meshMethod;
+		lod->Invalidate();
+	}
+
+	if(staleLodMask & (1u << level)) {
+		u32 size = lod->width*lod->height*lod->depth;
+		auto blocks = new u8[size];
+		auto colors = new stbvox_rgb[size];
+
+		Downsample(factor, blocks, colors);
+		lod->SetAll(blocks, colors);
+
+		delete[] blocks;
+		delete[] colors;
+		staleLodMask &= ~(1u << level);
+	}
+
+	return lod;
+}
+
+// Mesh space voxel v sits at v+1 because of the padding, so a lod
+//	voxel V has to land on V*factor + 1
+mat4 VoxelChunk::LodMatrix(u32 level) const {
+	f32 factor = (f32)(1u << level);
+	mat4 lodTransform = glm::translate(vec3{1.f - factor}) * glm::scale(vec3{factor});
+
+	return modelMatrix * coordinateCorrection * lodTransform * glm::inverse(coordinateCorrection);
+}
+
+bool VoxelChunk::IsMeshing() const {
+	if(meshing) return true;
+	for(auto lod: lods)
+		if(lod && lod->meshing) return true;
+
+	return false;
+}
+
+void VoxelChunk::Downsample(u32 factor, u8* outBlocks, stbvox_rgb* outColors) const {
+	u8* blocks = blockData;
+	stbvox_rgb* colors = colorData;
+
+	if(packedData) {
+		blocks = new u8[PaddedSize()];
+		colors = new stbvox_rgb[PaddedSize()];
+		packedData->Unpack(blocks, colors);
+	}
+
+	u32 lw = (width+factor-1)/factor;
+	u32 lh = (height+factor-1)/factor;
+	u32 ld = (depth+factor-1)/factor;
+
+	// Block types seen in the current cell and how often
+	std::vector<std::pair<u8, u32>> counts;
+
+	for(u32 lx = 0; lx < lw; lx++)
+	for(u32 ly = 0; ly < lh; ly++)
+	for(u32 lz = 0; lz < ld; lz++) {
+		u32 x1 = std::min((lx+1)*factor, width);
+		u32 y1 = std::min((ly+1)*factor, height);
+		u32 z1 = std::min((lz+1)*factor, depth);
+
+		u32 numVoxels = 0;
+		u32 numSolid = 0;
+		u32 rgb[3] {0, 0, 0};
+		counts.clear();
+
+		for(u32 x = lx*factor; x < x1; x++)
+		for(u32 y = ly*factor; y < y1; y++)
+		for(u32 z = lz*factor; z < z1; z++) {
+			numVoxels++;
+
+			u32 i = Index(x,y,z);
+			if(!blocks[i]) continue;
+
+			numSolid++;
+			rgb[0] += colors[i].r;
+			rgb[1] += colors[i].g;
+			rgb[2] += colors[i].b;
+
+			auto it = std::find_if(counts.begin(), counts.end(), 
+				[&](const std::pair<u8, u32>& p) { return p.first == blocks[i]; });
+			if(it != counts.end()) it->second++;
+			else counts.emplace_back(blocks[i], 1);
+		}
+
+		u32 o = lz + ly*ld + lx*ld*lh;
+		outBlocks[o] = 0;
+		outColors[o] = stbvox_rgb{255, 255, 255};
+
+		if(numSolid*2 < numVoxels) continue;
+
+		auto common = std::max_element(counts.begin(), counts.end(), 
+			[](const std::pair<u8, u32>& a, const std::pair<u8, u32>& b) { return a.second < b.second; });
+
+		outBlocks[o] = common->first;
+		outColors[o] = stbvox_rgb{(u8)(rgb[0]/numSolid), (u8)(rgb[1]/numSolid), (u8)(rgb[2]/numSolid)};
+	}
+
+	if(packedData) {
+		delete[] blocks;
+		delete[] colors;
+	}
+}
+
+void VoxelChunk::Compress() {
+	if(packedData) return;
+
+	u32 rawSize = VoxelMemoryUsage();
+	packedData = new PaletteStorage;
+	packedData->Pack(blockData, colorData, width, height, depth);
+
+	// Noisy chunks can end up bigger than they started
+	if(packedData->MemoryUsage() >= rawSize) {
+		delete packedData;
+		packedData = nullptr;
+		return;
+	}
+
+	delete[] blockData;
+	delete[] colorData;
+	blockData = nullptr;
+	colorData = nullptr;
+}
+
+void VoxelChunk::Decompress() {
+	if(!packedData) return;
+
+	blockData = new u8[PaddedSize()];
+	colorData = new stbvox_rgb[PaddedSize()];
+	packedData->Unpack(blockData, colorData);
+
+	delete packedData;
+	packedData = nullptr;
+}
+
+void VoxelChunk::CopyBorders(u8* blocks) const {
+	const u32 dims[3] {width, height, depth};
+	const u32 yStride = depth+2;
+	const u32 xStride = (depth+2)*(height+2);
+
+	for(u32 face = 0; face < 6; face++) {
+		auto n = neighbours[face];
+		bool usable = BorderUsable(face);
+
+		// Padded coordinate of the border on the face axis, and of the 
+		//	neighbour's boundary layer that it mirrors
+		u32 a = face/2;
+		u32 dst = (face & 1)? dims[a]+1 : 0;
+		u32 src = (face & 1)? 1 : dims[a];
+
+		if(a == 2) {
+			for(u32 x = 1; x <= width; x++)
+			for(u32 y = 1; y <= height; y++) {
+				u8 block = 0;
+				if(usable && n->packedData) block = n->packedData->Get(x-1, y-1, src-1) >> 24;
+				else if(usable) block = n->blockData[src + y*yStride + x*xStride];
+
+				blocks[dst + y*yStride + x*xStride] = block;
+			}
+
+			continue;
+		}
+
+		// x and y borders are made of whole z rows
+		u32 numRows = (a == 0)? height : width;
+		for(u32 r = 1; r <= numRows; r++) {
+			u32 dstRow = (a == 0)? (r*yStride + dst*xStride) : (dst*yStride + r*xStride);
+			u32 srcRow = (a == 0)? (r*yStride + src*xStride) : (src*yStride + r*xStride);
+			u8* row = &blocks[dstRow + 1];
+
+			if(!usable) {
+				memset(row, 0, depth);
+
+			}else if(n->packedData) {
+				u32 x = (a == 0)? src-1 : r-1;
+				u32 y = (a == 0)? r-1 : src-1;
+				for(u32 z = 0; z < depth; z++)
+					row[z] = n->packedData->Get(x, y, z) >> 24;
+
+			}else{
+				memcpy(row, &n->blockData[srcRow + 1], depth);
+			}
+		}
+	}
+}
+
+bool VoxelChunk::CopyLighting(u8* lighting) const {
+	if(!lightData) return false;
+
+	auto level = [](u8 light) { return lightCurve[std::max(light >> 4, light & 15)]; };
+	auto clamp = [](u32 p, u32 dim) { return std::min(std::max(p, 1u), dim) - 1; };
+
+	// Everything first, padding clamped to the nearest voxel
+	for(u32 x = 0; x < width+2; x++)
+	for(u32 y = 0; y < height+2; y++) {
+		auto src = &lightData[Index(clamp(x, width), clamp(y, height), 0)];
+		auto dst = &lighting[Index(x-1, y-1, 0) - 1];
+
+		dst[0] = level(src[0]);
+		for(u32 z = 0; z < depth; z++) dst[z+1] = level(src[z]);
+		dst[depth+1] = level(src[depth-1]);
+	}
+
+	const u32 dims[3] {width, height, depth};
+
+	for(u32 face = 0; face < 6; face++) {
+		auto n = neighbours[face];
+		if(!n || !n->lightData || n->width != width || n->height != height || n->depth != depth) 
+			continue;
+
+		u32 a = face/2;
+		u32 u = (a+1)%3, v = (a+2)%3;
+		for(u32 i = 0; i < dims[u]; i++)
+		for(u32 j = 0; j < dims[v]; j++) {
+			u32 p[3], q[3];
+			p[u] = q[u] = i;
+			p[v] = q[v] = j;
+			p[a] = (face & 1)? dims[a] : ~0u;
+			q[a] = (face & 1)? 0 : dims[a]-1;
+
+			lighting[Index(p[0], p[1], p[2])] = level(n->lightData[Index(q[0], q[1], q[2])]);
+		}
+	}
+
+	return true;
+}
+
+bool VoxelChunk::BorderUsable(u32 face) const {
+	auto n = neighbours[face];
+	return n && n->lodLevel == lodLevel 
+		&& n->width == width && n->height == height && n->depth == depth;
+}
+
+std::shared_ptr<const ChunkVersion> VoxelChunk::Snapshot() {
+	if(version && !hasStaleBricks) return version;
+
+	const u32 n = VoxelBrick::brickSize;
+	auto next = std::make_shared<ChunkVersion>(width, height, depth);
+
+	for(u32 bx = 0; bx < next->bricksX; bx++)
+	for(u32 by = 0; by < next->bricksY; by++)
+	for(u32 bz = 0; bz < next->bricksZ; bz++) {
+		u32 i = next->BrickIndex(bx, by, bz);
+		if(version && !staleBricks[i]) {
+			next->bricks[i] = version->bricks[i];
+			continue;
+		}
+
+		auto brick = std::make_shared<VoxelBrick>();
+		memset(brick->blocks, 0, sizeof(brick->blocks));
+		memset(brick->colors, 255, sizeof(brick->colors));
+
+		u32 rowLength = std::min(n, depth - bz*n);
+		for(u32 x = 0; x < n && bx*n + x < width; x++)
+		for(u32 y = 0; y < n && by*n + y < height; y++) {
+			u32 dst = (y + x*n)*n;
+
+			if(packedData) {
+				for(u32 z = 0; z < rowLength; z++) {
+					u32 entry = packedData->Get(bx*n + x, by*n + y, bz*n + z);
+					brick->blocks[dst+z] = entry >> 24;
+					brick->colors[dst+z] = stbvox_rgb{(u8)(entry>>16), (u8)(entry>>8), (u8)entry};
+				}
+
+			}else{
+				u32 src = Index(bx*n + x, by*n + y, bz*n);
+				memcpy(&brick->blocks[dst], &blockData[src], rowLength);
+				memcpy(&brick->colors[dst], &colorData[src], rowLength*sizeof(stbvox_rgb));
+			}
+		}
+
+		// Untouched air is common enough to be worth sharing
+		auto empty = ChunkVersion::EmptyBrick();
+		bool isEmpty = !memcmp(brick->blocks, empty->blocks, sizeof(brick->blocks))
+			&& !memcmp(brick->colors, empty->colors, sizeof(brick->colors));
+
+		if(isEmpty) next->bricks[i] = empty;
+		else next->bricks[i] = brick;
+	}
+
+	next->occupancy = occupancy;
+	staleBricks.assign(next->NumBricks(), false);
+	hasStaleBricks = false;
+	version = next;
+	return version;
+}
+
+void VoxelChunk::MarkBricksStale(const u32 mins[3], const u32 maxs[3]) {
+	hasStaleBricks = true;
+	if(!version) return;
+
+	const u32 n = VoxelBrick::brickSize;
+	u32 bmin[3], bmax[3];
+	const u32 bricks[3] {version->bricksX, version->bricksY, version->bricksZ};
+
+	for(u32 a = 0; a < 3; a++) {
+		bmin[a] = std::min(mins[a]/n, bricks[a]);
+		bmax[a] = std::min((maxs[a] + n-1)/n, bricks[a]);
+	}
+
+	for(u32 bx = bmin[0]; bx < bmax[0]; bx++)
+	for(u32 by = bmin[1]; by < bmax[1]; by++)
+	for(u32 bz = bmin[2]; bz < bmax[2]; bz++)
+		staleBricks[version->BrickIndex(bx, by, bz)] = true;
+}
+
+void VoxelChunk::CopyVoxelData(u8* blocks, stbvox_rgb* colors) const {
+	if(packedData) {
+		packedData->Unpack(blocks, colors);
+		return;
+	}
+
+	memcpy(blocks, blockData, PaddedSize());
+	memcpy(colors, colorData, PaddedSize()*sizeof(stbvox_rgb));
+}
+
+u32 VoxelChunk::VoxelMemoryUsage() const {
+	if(packedData) return packedData->MemoryUsage();
+	return PaddedSize()*(1 + sizeof(stbvox_rgb));
+}
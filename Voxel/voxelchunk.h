@@ -2,24 +2,139 @@
 #define VOXELCHUNK_H
 
 #include "common.h"
+#include "chunkversion.h"
+#include "frustum.h"
+#include "mesharena.h"
+#include "occupancy.h"
+#include "meshbuffers.h"
+#include "palettestorage.h"
 #include "stb_voxel_render.h"
 
 struct ShaderProgram;
+struct MeshCache;
+
+enum class MeshMethod {
+	Stbvox, // One quad per exposed face
+	Greedy, // Coplanar solid faces merged, stbvox for everything else
+	BinaryGreedy, // As Greedy, finding exposed faces from the occupancy bits
+};
+
+// A range of a chunk's meshAllocation, in quads
+struct MeshSlab {
+	u32 offset;
+	u32 capacity;
+	u32 numQuads;
+	AABB bounds; // Of the slab's vertices, in mesh space
+	std::vector<AABB> occluders; // Solid boxes inside the slab, in mesh space
+};
 
 struct VoxelChunk {
+	// The mesh is built and uploaded in slabs this many x columns wide so
+	//	that an edit only has to rebuild the slabs it touches
+	static constexpr u32 slabWidth = 8;
+
+	// Mode 21 vertices have 7 bits for x and y and 9 for z in half steps,
+	//	and the padding puts a chunk's far corner at its size plus 1. Bigger
+	//	chunks are clamped with a log, which also keeps NumSlabs well within
+	//	the 32 bits of buildSlabMask
+	static constexpr u32 maxWidth = 126; // And height
+	static constexpr u32 maxDepth = 254;
+
+	// Level 0 is the chunk itself, level n is downsampled by 2^n
+	static constexpr u32 numLods = 4;
+
 	static u32 elementBO;
 	static u32 elementBufferSize;
+	static u8 blockGeometry[256];
+	static u8 blockLight[256]; // Block light each block type emits, 0 to 15
+	static u8 blockMesh[256]; // stbvox mesh each block type goes to, 1 for the transparent pass
+	static const mat4 coordinateCorrection; // stbvox is z up
+	static MeshBufferPool buildBufferPool;
+	static MeshArena meshArena;
+	static MeshArena instanceArena; // Instance records, see EncodeInstances
+	static MeshCache* meshCache; // If set, full rebuilds are looked up here before meshing
+
+	// Right sized copy of the last built mesh, freed once uploaded
+	u32* vertexData;
+	u32* faceData;
+	std::vector<u32> builtTransparentVertices;
+	std::vector<u32> builtTransparentFaces;
 
-	u8* vertexBuildBuffer;
-	u8* faceBuildBuffer;
+	// Null while the chunk is compressed into packedData
 	u8* blockData;
 	stbvox_rgb* colorData;
+	PaletteStorage* packedData;
+
+	// Kept up to date with blockData by every edit, compressed or not
+	Occupancy occupancy;
+
+	// Light levels in the blockData layout, see LightEngine. Null until
+	//	the chunk is lit, and unlit chunks mesh at full brightness
+	u8* lightData;
+
+	// Immutable copy of the voxels as of the last Snapshot, for readers on
+	//	other threads. Edits only touch blockData, which is never shared,
+	//	and mark the bricks they touch to be copied by the next Snapshot
+	std::shared_ptr<const ChunkVersion> version;
+	std::vector<bool> staleBricks;
+	bool hasStaleBricks;
 	
-	u32 vertexBO, faceBO, faceTex;
+	MeshAllocation meshAllocation; // In meshArena, or instanceArena if instanced
 	u32 width, height, depth;
-	u32 numQuads;
+
+	// Greedy meshed chunks of nothing but cubes can be uploaded as one 
+	//	instance per quad, which voxel_instanced.vs expands without any 
+	//	element buffer. The format is picked by BeginBuild, and changing it
+	//	rebuilds everything
+	bool instancing; // Whether to use instances when the mesh allows
+	bool instanced; // Uploaded
+	bool buildInstanced;
+
+	// Unused slab capacity is filled with degenerate quads so the whole 
+	//	mesh can still be drawn with one call
+	std::vector<MeshSlab> slabs;
+	u32 numQuads; // Uploaded
+	u32 drawQuads; // Uploaded, including gaps between slabs
+	AABB meshBounds; // Of everything uploaded, in mesh space
+
+	// Transparent quads are drawn after everything opaque without writing
+	//	depth, so they have to go back to front. They're kept here slab by 
+	//	slab and uploaded in transparentOrder, which is only re-sorted when 
+	//	the camera moves into another voxel cell
+	std::vector<u32> transparentVertices; // 4 per quad
+	std::vector<u32> transparentFaces;
+	std::vector<u32> transparentSlabQuads;
+	std::vector<u32> transparentOrder; // Quad indices, furthest first
+	MeshAllocation transparentAllocation; // In meshArena
+	u32 numTransparentQuads;
+	s32 sortCell[3]; // Camera cell in mesh space transparentOrder is for
+	bool transparentSorted;
+	bool transparentUploaded;
+
+	u32 buildSlabMask; // Slabs being rebuilt, set by BeginBuild
+	std::vector<u32> builtSlabQuads; // Quads per rebuilt slab in vertexData
+	std::vector<u32> builtSlabTransparentQuads; // And in builtTransparentVertices
+	std::vector<AABB> builtSlabBounds;
+	std::vector<std::vector<AABB>> builtSlabOccluders;
+	u32 numBuiltQuads; // In vertexData and faceData
+
+	// Dirty region, max exclusive. Edits widen it by a voxel since they 
+	//	can expose or hide their neighbours' faces
+	u32 dirtyMin[3], dirtyMax[3];
 	bool dirty;
+	bool meshing; // A background mesh job is building this chunk, or it's queued for upload
+
+	// Adjacent chunks in -x, +x, -y, +y, -z, +z order, kept by VoxelWorld.
+	//	Their boundary voxels are copied into the padding before meshing so
+	//	faces hidden by a neighbour aren't emitted. Lods have none
+	VoxelChunk* neighbours[6];
+	u32 lodLevel; // That VoxelWorld is drawing this at, neighbours at other levels count as empty
+
+	// Downsampled copies, made on demand by GetLod and remade when stale
+	VoxelChunk* lods[numLods-1];
+	u32 staleLodMask;
 
+	MeshMethod meshMethod;
 	mat4 modelMatrix;
 
 	stbvox_mesh_maker mm;
@@ -28,13 +143,108 @@ struct VoxelChunk {
 	~VoxelChunk();
 
 	static void LengthenElementBuffer(u32 least);
+	static bool IsSolidCube(u8 blockType);
+	static bool SupportsInstancing(); // Needs a current context
 
+	// BeginBuild picks the slabs to rebuild from the dirty region and
+	//	clears it. BuildMesh meshes them into vertexData and faceData
+	//	touching no GL state, and UploadMesh splices them into the GPU
+	//	buffers. GenerateMesh does all three
+	// BuildMesh can mesh from a snapshot of blockData and colorData
+	//	so that it is safe to run while the chunk is being edited, in
+	//	which case it needs the snapshot's occupancy too
+	void BeginBuild();
+	void BuildMesh(); // Calls BeginBuild
+	void BuildMesh(u8* blocks, stbvox_rgb* colors, u8* lighting = nullptr, const Occupancy* = nullptr);
+	void UploadMesh();
 	void GenerateMesh();
 	void Render(ShaderProgram&);
 
+	// Re-sorts transparentOrder if cameraPos, in world space, has moved into 
+	//	another cell since the last sort. Returns whether it did. Doesn't 
+	//	touch GL, PrepareTransparent sorts and uploads before drawing
+	bool SortTransparent(const vec3& cameraPos);
+	bool PrepareTransparent(const vec3& cameraPos);
+	void RenderTransparent(ShaderProgram&);
+	void Draw(ShaderProgram&, const MeshAllocation&, u32 count); // count in quads
+	void DrawInstances(ShaderProgram&); // With voxel_instanced.vs
+
 	void SetBlock(u32,u32,u32, u8);
 	void SetColor(u32,u32,u32, u8,u8,u8);
 	u8 GetBlock(u32,u32,u32);
+
+	// Bulk edits work on whole z rows and mark the chunk dirty once.
+	//	Boxes are min inclusive, max exclusive and clipped to the chunk
+	void FillBox(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1, u8 block, stbvox_rgb color);
+	void FillColumn(u32 x, u32 y, u32 z0, u32 z1, u8 block, stbvox_rgb color);
+
+	// Box contents are w*h*d arrays in x, y, z order with z changing fastest.
+	//	colors can be null to leave colors alone
+	void CopyBox(u32 x, u32 y, u32 z, u32 w, u32 h, u32 d, u8* blocks, stbvox_rgb* colors);
+	void PasteBox(u32 x, u32 y, u32 z, u32 w, u32 h, u32 d, const u8* blocks, const stbvox_rgb* colors);
+	void SetAll(const u8* blocks, const stbvox_rgb* colors); // Whole interior, width*height*depth
+
+	// Edits on a boundary also mark the border of the neighbour across it
+	void MarkDirty(u32,u32,u32);
+	void MarkDirty(u32 x0, u32 y0, u32 z0, u32 x1, u32 y1, u32 z1);
+	void MarkFaceDirty(u32 face); // For when the neighbour across face changes
+	void MarkLightDirty(u32,u32,u32); // Remeshes without touching the lods
+	void MarkMeshDirty(const u32 mins[3], const u32 maxs[3]);
+	void ExpandDirtyRegion(const u32 mins[3], const u32 maxs[3]);
+	void Invalidate(); // Forces a full rebuild
+
+	// Returns this for level 0. Downsampled chunks mesh like any other, 
+	//	their modelMatrix needs to come from LodMatrix
+	VoxelChunk* GetLod(u32 level);
+	mat4 LodMatrix(u32 level) const;
+	bool IsMeshing() const; // Including lods
+
+	// Each factor^3 cell becomes solid if at least half of it is, taking 
+	//	its most common block and average color. Output is the interior
+	//	layout SetAll takes, ceil(dim/factor) on each side
+	void Downsample(u32 factor, u8* blocks, stbvox_rgb* colors) const;
+
+	// Compress swaps blockData and colorData for palette storage, edits
+	//	decompress again automatically
+	void Compress();
+	void Decompress();
+
+	// Writes voxels in the blockData/colorData layout whether compressed or not
+	void CopyVoxelData(u8* blocks, stbvox_rgb* colors) const;
+
+	// Fills the padding of a blockData layout array from the neighbours'
+	//	boundary layers, one row of depth at a time where possible
+	void CopyBorders(u8* blocks) const;
+	bool BorderUsable(u32 face) const; // Whether the neighbour across face is meshed against
+
+	// Returns the current version, making a new one first if anything has 
+	//	been edited since the last. Only call from the editing thread
+	std::shared_ptr<const ChunkVersion> Snapshot();
+	void MarkBricksStale(const u32 mins[3], const u32 maxs[3]);
+
+	// Writes lightData as stbvox lighting input, brightest of sky and block 
+	//	light on a curve. The padding comes from the neighbours where they're
+	//	lit, otherwise the nearest voxel. Returns false if the chunk is unlit
+	bool CopyLighting(u8* lighting) const;
+	u32 PaddedSize() const { return (width+2)*(height+2)*(depth+2); }
+	MeshArena& Arena() const { return instanced? instanceArena : meshArena; }
+	u32 NumSlabs() const { return (width + slabWidth-1)/slabWidth; }
+	u32 VoxelMemoryUsage() const;
+
+	// Bounds of the uploaded mesh after modelMatrix, so only as tight as 
+	//	the occupied voxels. Empty until something has been uploaded
+	AABB WorldBounds() const;
+	AABB ChunkBounds() const; // Of the whole chunk, whatever is in it
+
+	// Transparent quads go into transparent, which can be null if there are none
+	void MeshRange(u8* blocks, stbvox_rgb* colors, u8* lighting, const Occupancy&, u32 x0, u32 x1, 
+		MeshBuildBuffers*, MeshBuildBuffers* transparent);
+	void FindOccluders(const Occupancy&, u32 x0, u32 x1, std::vector<AABB>&) const;
+	void RelayoutMesh();
+
+	u32 Index(u32 x, u32 y, u32 z) const {
+		return 1 + z + (y+1)*(depth+2) + (x+1)*(depth+2)*(height+2);
+	}
 };
 
-#endif
\ No newline at end of file
+#endif
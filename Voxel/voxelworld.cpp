@@ -0,0 +1,465 @@
+#include "voxelworld.h"
+#include "voxelchunk.h"
+#include "meshworkers.h"
+#include "occlusionculler.h"
+#include "lighting.h"
+#include "indirectdraw.h"
+#include "uploadscheduler.h"
+#include "radixsort.h"
+#include "shader.h"
+
+static Log logger{"VoxelWorld"};
+
+// Rounds towards negative infinity, unlike /
+static s32 FloorDiv(s32 a, s32 b) {
+	return (a >= 0)? a/b : -((-a + b - 1)/b);
+}
+
+// ChunkMap
+
+ChunkMap::ChunkMap() {
+	capacity = 64;
+	count = 0;
+	slots = new Slot[capacity];
+	memset(slots, 0, capacity*sizeof(Slot));
+}
+
+ChunkMap::~ChunkMap() {
+	delete[] slots;
+}
+
+u32 ChunkMap::Hash(ChunkCoord c) {
+	u32 h = (u32)c.x * 73856093u ^ (u32)c.y * 19349663u ^ (u32)c.z * 83492791u;
+	return h * 2654435769u;
+}
+
+VoxelChunk* ChunkMap::Find(ChunkCoord c) const {
+	u32 mask = capacity-1;
+	for(u32 i = Hash(c) & mask;; i = (i+1) & mask) {
+		auto& slot = slots[i];
+		if(!slot.chunk) return nullptr;
+		if(slot.coord == c) return slot.chunk;
+	}
+}
+
+void ChunkMap::Insert(ChunkCoord c, VoxelChunk* chunk) {
+	// Keep load factor under 0.7
+	if((count+1)*10 > capacity*7) Grow();
+
+	u32 mask = capacity-1;
+	for(u32 i = Hash(c) & mask;; i = (i+1) & mask) {
+		auto& slot = slots[i];
+		if(!slot.chunk) {
+			slot = {c, chunk};
+			count++;
+			return;
+		}
+
+		if(slot.coord == c) {
+			slot.chunk = chunk;
+			return;
+		}
+	}
+}
+
+VoxelChunk* ChunkMap::Remove(ChunkCoord c) {
+	u32 mask = capacity-1;
+	u32 i = Hash(c) & mask;
+	for(;; i = (i+1) & mask) {
+		if(!slots[i].chunk) return nullptr;
+		if(slots[i].coord == c) break;
+	}
+
+	auto chunk = slots[i].chunk;
+	count--;
+
+	// Shift back any following entries that would no longer be reachable
+	for(u32 j = (i+1) & mask; slots[j].chunk; j = (j+1) & mask) {
+		u32 home = Hash(slots[j].coord) & mask;
+		bool reachable = (i <= j)? (i < home && home <= j) : (i < home || home <= j);
+		if(reachable) continue;
+
+		slots[i] = slots[j];
+		i = j;
+	}
+
+	slots[i] = {ChunkCoord{0,0,0}, nullptr};
+	return chunk;
+}
+
+void ChunkMap::Grow() {
+	auto oldSlots = slots;
+	auto oldCapacity = capacity;
+
+	capacity <<= 1;
+	count = 0;
+	slots = new Slot[capacity];
+	memset(slots, 0, capacity*sizeof(Slot));
+
+	for(u32 i = 0; i < oldCapacity; i++)
+		if(oldSlots[i].chunk) Insert(oldSlots[i].coord, oldSlots[i].chunk);
+
+	delete[] oldSlots;
+}
+
+// VoxelWorld
+
+VoxelWorld::VoxelWorld(u32 w, u32 h, u32 d)
+	: chunkWidth{w}, chunkHeight{h}, chunkDepth{d} {
+	modelMatrix = mat4(1.f);
+	meshMethod = MeshMethod::Stbvox;
+	meshWorkers = nullptr;
+	uploadScheduler = nullptr;
+	occlusionCuller = nullptr;
+	lighting = nullptr;
+	lightStepsPerFrame = 20000;
+	indirectDrawer = nullptr;
+	instanceProgram = nullptr;
+	lodDistance = 96.f;
+	transparentAlpha = 0.5f;
+	for(auto& n: numChunksAtLod) n = 0;
+	numChunksTested = 0;
+	numChunksCulled = 0;
+	numChunksOccluded = 0;
+	numChunksDrawn = 0;
+	numQuadsDrawn = 0;
+	numChunksInstanced = 0;
+	numTransparentChunks = 0;
+	numTransparentSorts = 0;
+}
+
+VoxelWorld::~VoxelWorld() {
+	if(meshWorkers) meshWorkers->Finish(uploadScheduler);
+	if(uploadScheduler) uploadScheduler->Clear();
+
+	chunks.ForEach([](ChunkCoord, VoxelChunk* chunk) {
+		delete chunk;
+	});
+}
+
+VoxelChunk* VoxelWorld::GetChunk(ChunkCoord c) const {
+	return chunks.Find(c);
+}
+
+VoxelChunk* VoxelWorld::GetOrCreateChunk(ChunkCoord c) {
+	auto chunk = chunks.Find(c);
+	if(chunk) return chunk;
+
+	chunk = new VoxelChunk{chunkWidth, chunkHeight, chunkDepth};
+	chunk->meshMethod = meshMethod;
+	chunks.Insert(c, chunk);
+
+	for(u32 face = 0; face < 6; face++) {
+		auto n = chunks.Find(Neighbour(c, face));
+		if(!n) continue;
+
+		chunk->neighbours[face] = n;
+		n->neighbours[face^1] = chunk;
+		n->MarkFaceDirty(face^1);
+	}
+
+	if(lighting) lighting->OnChunkCreated(chunk);
+	return chunk;
+}
+
+void VoxelWorld::DestroyChunk(ChunkCoord c) {
+	auto chunk = chunks.Remove(c);
+	if(!chunk) return;
+	if(chunk->IsMeshing()) {
+		if(meshWorkers) meshWorkers->Finish(uploadScheduler);
+		if(uploadScheduler) uploadScheduler->Remove(chunk);
+	}
+
+	if(lighting) lighting->OnChunkDestroyed(chunk);
+
+	for(u32 face = 0; face < 6; face++) {
+		auto n = chunk->neighbours[face];
+		if(!n) continue;
+
+		n->neighbours[face^1] = nullptr;
+		n->MarkFaceDirty(face^1);
+	}
+
+	delete chunk;
+}
+
+void VoxelWorld::SetMeshMethod(MeshMethod method) {
+	meshMethod = method;
+
+	// Workers read meshMethod, so chunks being meshed are left for Render
+	//	to switch over once they're done
+	chunks.ForEach([=](ChunkCoord, VoxelChunk* chunk) {
+		if(chunk->meshing) return;
+		chunk->meshMethod = method;
+		chunk->Invalidate();
+	});
+}
+
+void VoxelWorld::CompressChunks() {
+	u64 before = 0, after = 0;
+
+	chunks.ForEach([&](ChunkCoord, VoxelChunk* chunk) {
+		before += chunk->VoxelMemoryUsage();
+		chunk->Compress();
+		after += chunk->VoxelMemoryUsage();
+	});
+
+	logger << "Compressed " << chunks.count << " chunks from " 
+		<< (before>>10) << "KB to " << (after>>10) << "KB";
+}
+
+ChunkCoord VoxelWorld::Neighbour(ChunkCoord c, u32 face) {
+	s32 dir = (face & 1)? 1 : -1;
+	switch(face/2) {
+	case 0: c.x += dir; break;
+	case 1: c.y += dir; break;
+	default: c.z += dir; break;
+	}
+
+	return c;
+}
+
+ChunkCoord VoxelWorld::ChunkCoordAt(s32 x, s32 y, s32 z) const {
+	return ChunkCoord{
+		FloorDiv(x, chunkWidth), 
+		FloorDiv(y, chunkHeight), 
+		FloorDiv(z, chunkDepth)
+	};
+}
+
+void VoxelWorld::SetBlock(s32 x, s32 y, s32 z, u8 nval) {
+	auto c = ChunkCoordAt(x,y,z);
+	auto chunk = nval? GetOrCreateChunk(c) : GetChunk(c);
+	if(!chunk) return;
+
+	u32 lx = x - c.x*chunkWidth, ly = y - c.y*chunkHeight, lz = z - c.z*chunkDepth;
+	u8 old = chunk->GetBlock(lx, ly, lz);
+	chunk->SetBlock(lx, ly, lz, nval);
+
+	if(lighting) lighting->OnBlockChanged(chunk, lx, ly, lz, old, nval);
+}
+
+void VoxelWorld::SetColor(s32 x, s32 y, s32 z, u8 r, u8 g, u8 b) {
+	auto c = ChunkCoordAt(x,y,z);
+	auto chunk = GetOrCreateChunk(c);
+	chunk->SetColor(x - c.x*chunkWidth, y - c.y*chunkHeight, z - c.z*chunkDepth, r,g,b);
+}
+
+u8 VoxelWorld::GetBlock(s32 x, s32 y, s32 z) const {
+	auto c = ChunkCoordAt(x,y,z);
+	auto chunk = GetChunk(c);
+	if(!chunk) return 0;
+
+	return chunk->GetBlock(x - c.x*chunkWidth, y - c.y*chunkHeight, z - c.z*chunkDepth);
+}
+
+void VoxelWorld::FillBox(s32 x0, s32 y0, s32 z0, s32 x1, s32 y1, s32 z1, u8 block, stbvox_rgb color) {
+	if(x0 >= x1 || y0 >= y1 || z0 >= z1) return;
+
+	auto cmin = ChunkCoordAt(x0, y0, z0);
+	auto cmax = ChunkCoordAt(x1-1, y1-1, z1-1);
+
+	for(s32 cx = cmin.x; cx <= cmax.x; cx++)
+	for(s32 cy = cmin.y; cy <= cmax.y; cy++)
+	for(s32 cz = cmin.z; cz <= cmax.z; cz++) {
+		ChunkCoord c{cx, cy, cz};
+		auto chunk = block? GetOrCreateChunk(c) : GetChunk(c);
+		if(!chunk) continue;
+
+		// Relative to the chunk, clamped so they never go negative
+		s32 bx = cx*chunkWidth, by = cy*chunkHeight, bz = cz*chunkDepth;
+		u32 lx0 = std::max(x0-bx, 0), ly0 = std::max(y0-by, 0), lz0 = std::max(z0-bz, 0);
+		u32 lx1 = std::min(x1-bx, (s32)chunkWidth), ly1 = std::min(y1-by, (s32)chunkHeight), lz1 = std::min(z1-bz, (s32)chunkDepth);
+
+		if(!lighting) {
+			chunk->FillBox(lx0,ly0,lz0, lx1,ly1,lz1, block, color);
+			continue;
+		}
+
+		std::vector<u8> old((lx1-lx0)*(ly1-ly0)*(lz1-lz0));
+		chunk->CopyBox(lx0,ly0,lz0, lx1-lx0,ly1-ly0,lz1-lz0, old.data(), nullptr);
+		chunk->FillBox(lx0,ly0,lz0, lx1,ly1,lz1, block, color);
+
+		u32 i = 0;
+		for(u32 lx = lx0; lx < lx1; lx++)
+		for(u32 ly = ly0; ly < ly1; ly++)
+		for(u32 lz = lz0; lz < lz1; lz++)
+			lighting->OnBlockChanged(chunk, lx, ly, lz, old[i++], block);
+	}
+}
+
+u32 VoxelWorld::LodLevel(const VoxelChunk* chunk, const vec3& cameraPos) const {
+	if(lodDistance <= 0.f) return 0;
+
+	// Distance to the nearest point of the whole chunk, since the mesh
+	//	bounds depend on which lod gets meshed
+	AABB box = chunk->ChunkBounds();
+	vec3 outside = glm::max(glm::max(box.min - cameraPos, cameraPos - box.max), vec3{0.f});
+	f32 dist = glm::length(outside);
+	if(dist < lodDistance) return 0;
+
+	return std::min(1u + (u32)std::log2(dist / lodDistance), VoxelChunk::numLods-1);
+}
+
+void VoxelWorld::Render(ShaderProgram& program, const mat4& viewProjection, const vec3& cameraPos) {
+	for(auto& n: numChunksAtLod) n = 0;
+	numChunksTested = 0;
+	numChunksCulled = 0;
+	numChunksOccluded = 0;
+	numChunksDrawn = 0;
+	numQuadsDrawn = 0;
+	numChunksInstanced = 0;
+	numTransparentChunks = 0;
+	numTransparentSorts = 0;
+
+	if(meshWorkers) meshWorkers->Update(uploadScheduler);
+	if(lighting) lighting->Update(lightStepsPerFrame);
+
+	// Only between uploads, since it moves every chunk's mesh
+	VoxelChunk::meshArena.DefragmentIfNeeded();
+	VoxelChunk::instanceArena.DefragmentIfNeeded();
+
+	auto frustum = Frustum::FromMatrix(viewProjection);
+	if(uploadScheduler) uploadScheduler->Update(frustum, cameraPos);
+
+	std::vector<VoxelChunk*> visibleChunks;
+
+	chunks.ForEach([&](ChunkCoord c, VoxelChunk* chunk) {
+		// Chunk offsets are in voxel space, so they need to go through 
+		//	the same correction as the chunk itself
+		vec3 offset {
+			(f32)c.x*chunkWidth, 
+			(f32)c.y*chunkHeight, 
+			(f32)c.z*chunkDepth
+		};
+		offset = vec3(VoxelChunk::coordinateCorrection * vec4{offset, 0.f});
+		chunk->modelMatrix = modelMatrix * glm::translate(offset);
+
+		if(chunk->meshMethod != meshMethod && !chunk->meshing) {
+			chunk->meshMethod = meshMethod;
+			chunk->Invalidate();
+		}
+
+		// Lods keep their borders closed, so where neighbours are at 
+		//	different levels the border faces cover the step between them
+		u32 level = LodLevel(chunk, cameraPos);
+		numChunksAtLod[level]++;
+
+		if(level != chunk->lodLevel) {
+			chunk->lodLevel = level;
+			for(u32 face = 0; face < 6; face++)
+				if(chunk->neighbours[face]) chunk->neighbours[face]->MarkFaceDirty(face^1);
+		}
+
+		auto drawn = chunk->GetLod(level);
+		if(level) drawn->modelMatrix = chunk->LodMatrix(level);
+
+		bool instancing = (instanceProgram != nullptr);
+		if(drawn->instancing != instancing && !drawn->meshing) {
+			drawn->instancing = instancing;
+			drawn->Invalidate();
+		}
+
+		// Bounds come from the mesh, so culled chunks still need meshing
+		if(drawn->dirty && !drawn->meshing) {
+			if(meshWorkers) {
+				meshWorkers->Submit(drawn);
+			}else if(uploadScheduler) {
+				drawn->BuildMesh();
+				drawn->meshing = true;
+				uploadScheduler->Add(drawn);
+			}else{
+				drawn->GenerateMesh();
+			}
+		}
+
+		if(!drawn->numQuads && !drawn->numTransparentQuads) return;
+
+		numChunksTested++;
+		if(!frustum.Intersects(drawn->WorldBounds())) {
+			numChunksCulled++;
+			return;
+		}
+
+		visibleChunks.push_back(drawn);
+	});
+
+	if(occlusionCuller) {
+		occlusionCuller->Begin(viewProjection);
+
+		for(auto chunk: visibleChunks) {
+			mat4 toWorld = chunk->modelMatrix * VoxelChunk::coordinateCorrection;
+			for(auto& slab: chunk->slabs)
+			for(auto& box: slab.occluders)
+				occlusionCuller->AddOccluder(box.Transformed(toWorld));
+		}
+
+		occlusionCuller->Rasterise();
+	}
+
+	if(indirectDrawer) indirectDrawer->Begin();
+	std::vector<VoxelChunk*> instancedChunks, transparentChunks;
+
+	for(auto chunk: visibleChunks) {
+		if(occlusionCuller && occlusionCuller->IsOccluded(chunk->WorldBounds())) {
+			numChunksOccluded++;
+			continue;
+		}
+
+		if(chunk->instanced) instancedChunks.push_back(chunk);
+		else if(indirectDrawer) indirectDrawer->Add(*chunk);
+		else chunk->Render(program);
+
+		numChunksDrawn++;
+		numQuadsDrawn += chunk->numQuads;
+		if(chunk->numTransparentQuads) transparentChunks.push_back(chunk);
+	}
+
+	if(indirectDrawer) indirectDrawer->Draw(program);
+
+	// After the rest so the program only changes once. Chunks still 
+	//	instanced after instancing is turned off wait to be remeshed
+	if(instanceProgram && !instancedChunks.empty()) {
+		instanceProgram->Use();
+		for(auto chunk: instancedChunks) chunk->DrawInstances(*instanceProgram);
+		program.Use();
+
+		numChunksInstanced = instancedChunks.size();
+	}
+
+	if(transparentChunks.empty()) return;
+
+	// Chunks don't overlap, so ordering them by the distance to their 
+	//	middles and then their quads within them is enough to draw back to front
+	std::vector<SortKey> keys, scratch;
+	for(u32 i = 0; i < transparentChunks.size(); i++) {
+		auto bounds = transparentChunks[i]->WorldBounds();
+		vec3 diff = (bounds.min + bounds.max) * 0.5f - cameraPos;
+		keys.push_back(SortKey{~FloatKey(glm::dot(diff, diff)), i});
+	}
+
+	RadixSort(keys, scratch);
+
+	glEnable(GL_BLEND);
+	glBlendColor(0.f, 0.f, 0.f, transparentAlpha);
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	if(indirectDrawer) indirectDrawer->Begin();
+
+	for(auto& key: keys) {
+		auto chunk = transparentChunks[key.index];
+		if(chunk->PrepareTransparent(cameraPos)) numTransparentSorts++;
+
+		if(indirectDrawer) indirectDrawer->AddTransparent(*chunk);
+		else chunk->RenderTransparent(program);
+
+		numTransparentChunks++;
+		numQuadsDrawn += chunk->numTransparentQuads;
+	}
+
+	if(indirectDrawer) indirectDrawer->Draw(program);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
@@ -0,0 +1,128 @@
+#ifndef VOXELWORLD_H
+#define VOXELWORLD_H
+
+#include "common.h"
+#include "voxelchunk.h"
+
+struct ShaderProgram;
+struct MeshWorkerPool;
+struct OcclusionCuller;
+struct LightEngine;
+struct IndirectDrawer;
+struct UploadScheduler;
+
+struct ChunkCoord {
+	s32 x, y, z;
+
+	bool operator==(const ChunkCoord& o) const { return x == o.x && y == o.y && z == o.z; }
+	bool operator!=(const ChunkCoord& o) const { return !(*this == o); }
+};
+
+// Open addressing hash map from chunk coordinate to chunk, linear probing
+//	with backward shift deletion so there are no tombstones
+struct ChunkMap {
+	struct Slot {
+		ChunkCoord coord;
+		VoxelChunk* chunk;
+	};
+
+	Slot* slots;
+	u32 capacity; // Always a power of two
+	u32 count;
+
+	ChunkMap();
+	~ChunkMap();
+
+	VoxelChunk* Find(ChunkCoord) const;
+	void Insert(ChunkCoord, VoxelChunk*);
+	VoxelChunk* Remove(ChunkCoord);
+
+	static u32 Hash(ChunkCoord);
+	void Grow();
+
+	template<class F>
+	void ForEach(F&& func) const {
+		for(u32 i = 0; i < capacity; i++)
+			if(slots[i].chunk) func(slots[i].coord, slots[i].chunk);
+	}
+};
+
+struct VoxelWorld {
+	ChunkMap chunks;
+	u32 chunkWidth, chunkHeight, chunkDepth;
+	mat4 modelMatrix;
+	MeshMethod meshMethod;
+
+	// Dirty chunks are meshed on these if set, otherwise synchronously in Render
+	MeshWorkerPool* meshWorkers;
+
+	// If set, built meshes wait here to be uploaded within its per frame 
+	//	budgets instead of all at once. Flush it before unsetting
+	UploadScheduler* uploadScheduler;
+
+	// If set, chunks in the frustum are tested against each other's occluders
+	OcclusionCuller* occlusionCuller;
+
+	// If set, edits relight incrementally and Render works through up to
+	//	lightStepsPerFrame queued light updates
+	LightEngine* lighting;
+	u32 lightStepsPerFrame;
+
+	// If set, visible chunks are drawn with one indirect call. The program
+	//	passed to Render then needs to be built from voxel_indirect.vs
+	IndirectDrawer* indirectDrawer;
+
+	// If set, chunks that can be are meshed as one instance per quad and drawn 
+	//	with this, which needs building from voxel_instanced.vs and its uniforms
+	//	set like the program passed to Render. The indirect drawer skips them
+	ShaderProgram* instanceProgram;
+
+	// Chunks this far from the camera are drawn at lod 1, and each 
+	//	doubling of the distance after that drops another level. 0 disables
+	f32 lodDistance;
+
+	// Opacity of transparent blocks, applied as a constant blend alpha
+	f32 transparentAlpha;
+
+	u32 numChunksAtLod[VoxelChunk::numLods];
+	u32 numChunksTested;
+	u32 numChunksCulled;
+	u32 numChunksOccluded;
+	u32 numChunksDrawn;
+	u32 numQuadsDrawn;
+	u32 numChunksInstanced;
+	u32 numTransparentChunks;
+	u32 numTransparentSorts; // Chunks whose transparent quads were re-sorted
+
+	VoxelWorld(u32 chunkWidth, u32 chunkHeight, u32 chunkDepth);
+	~VoxelWorld();
+
+	VoxelChunk* GetChunk(ChunkCoord) const;
+	VoxelChunk* GetOrCreateChunk(ChunkCoord);
+	void DestroyChunk(ChunkCoord);
+	void SetMeshMethod(MeshMethod); // Chunks being meshed switch over in Render
+
+	// Packs every chunk into palette storage, they unpack again when edited
+	void CompressChunks();
+
+	// Across face, in VoxelChunk::neighbours order
+	static ChunkCoord Neighbour(ChunkCoord, u32 face);
+
+	// World space voxel coordinates, z up like VoxelChunk
+	ChunkCoord ChunkCoordAt(s32 x, s32 y, s32 z) const;
+
+	void SetBlock(s32,s32,s32, u8);
+	void SetColor(s32,s32,s32, u8,u8,u8);
+	u8 GetBlock(s32,s32,s32) const;
+
+	// Max exclusive. Creates chunks as needed unless block is empty
+	void FillBox(s32 x0, s32 y0, s32 z0, s32 x1, s32 y1, s32 z1, u8 block, stbvox_rgb color);
+
+	u32 LodLevel(const VoxelChunk*, const vec3& cameraPos) const;
+
+	// Chunks outside the frustum of viewProjection are skipped before any GL calls.
+	//	Transparent quads are drawn after everything opaque, chunks back to front
+	void Render(ShaderProgram&, const mat4& viewProjection, const vec3& cameraPos);
+};
+
+#endif